@@ -2,10 +2,212 @@
 #include <fstream>
 #include <string>
 #include <stdexcept>
+#include <new>
 #include <limits> // Required for clearing input buffer
+#include <vector>
+#include <queue>
+#include <deque>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <ctime>
+#include <string_view>
+#include <charconv>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <functional>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <sstream>
+#include <csignal>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
+// Per-thread allocation counters, fed by the global operator new below.
+// Benchmarks read them before and after a run to report allocations per operation.
+struct AllocationCounter {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+thread_local AllocationCounter threadAllocations;
+
+// Opt-in allocation profile ("--alloc-profile"): allocations and bytes per site, where the
+// site is the label of the innermost AllocationSite scope on the allocating thread.
+// Workflow stages open one per stage and buildProject one per object type, so the report
+// ties every allocation to the stage or constructor that made it. Tables are fixed-size
+// statics because the hook runs inside operator new and must not allocate itself.
+class AllocationProfiler {
+public:
+    static constexpr size_t MAX_THREADS = 256;  // Later threads share the last table
+    static constexpr size_t MAX_SITES = 32;     // Later sites share the last entry
+
+    struct SiteTotals {
+        string site;
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+    };
+
+private:
+    struct SiteCounters {
+        atomic<const char*> site;
+        atomic<uint64_t> count;
+        atomic<uint64_t> bytes;
+    };
+
+    struct ThreadTable {
+        SiteCounters sites[MAX_SITES];
+    };
+
+    static atomic<bool> enabled;
+    static atomic<size_t> threadCount;
+    static ThreadTable tables[MAX_THREADS];
+    static thread_local ThreadTable* local;
+    static thread_local const char* currentSite;
+
+    static SiteCounters& counters(ThreadTable& table, const char* site) {
+        for (size_t i = 0; i + 1 < MAX_SITES; i++) {
+            const char* existing = table.sites[i].site.load(memory_order_acquire);
+            if (existing == site) return table.sites[i];
+            if (!existing && table.sites[i].site.compare_exchange_strong(existing, site, memory_order_acq_rel)) {
+                return table.sites[i];
+            }
+            if (existing == site) return table.sites[i];
+        }
+        const char* overflow = nullptr;
+        table.sites[MAX_SITES - 1].site.compare_exchange_strong(overflow, "(other sites)", memory_order_acq_rel);
+        return table.sites[MAX_SITES - 1];
+    }
+
+public:
+    static void enable() { enabled.store(true, memory_order_relaxed); }
+    static bool isEnabled() { return enabled.load(memory_order_relaxed); }
+
+    static const char* exchangeSite(const char* site) {
+        const char* previous = currentSite;
+        currentSite = site;
+        return previous;
+    }
+
+    // Called from operator new; a no-op unless profiling is enabled
+    static void record(size_t size) {
+        if (!enabled.load(memory_order_relaxed)) return;
+        if (!local) local = &tables[min(threadCount.fetch_add(1, memory_order_relaxed), MAX_THREADS - 1)];
+        SiteCounters& entry = counters(*local, currentSite);
+        entry.count.fetch_add(1, memory_order_relaxed);
+        entry.bytes.fetch_add(size, memory_order_relaxed);
+    }
+
+    // Totals per site across all threads, largest byte count first
+    static vector<SiteTotals> snapshot() {
+        vector<SiteTotals> totals;
+        size_t threads = min(threadCount.load(memory_order_relaxed), MAX_THREADS);
+        for (size_t t = 0; t < threads; t++) {
+            for (const SiteCounters& entry : tables[t].sites) {
+                const char* site = entry.site.load(memory_order_acquire);
+                if (!site) break;
+                auto it = find_if(totals.begin(), totals.end(),
+                    [site](const SiteTotals& existing) { return existing.site == site; });
+                if (it == totals.end()) {
+                    totals.push_back(SiteTotals());
+                    totals.back().site = site;
+                    it = totals.end() - 1;
+                }
+                it->count += entry.count.load(memory_order_relaxed);
+                it->bytes += entry.bytes.load(memory_order_relaxed);
+            }
+        }
+        sort(totals.begin(), totals.end(),
+            [](const SiteTotals& a, const SiteTotals& b) { return a.bytes > b.bytes; });
+        return totals;
+    }
+};
+
+atomic<bool> AllocationProfiler::enabled(false);
+atomic<size_t> AllocationProfiler::threadCount(0);
+AllocationProfiler::ThreadTable AllocationProfiler::tables[AllocationProfiler::MAX_THREADS];
+thread_local AllocationProfiler::ThreadTable* AllocationProfiler::local = nullptr;
+thread_local const char* AllocationProfiler::currentSite = "other";
+
+// Labels allocations made on this thread while in scope; scopes nest
+class AllocationSite {
+private:
+    const char* previous;
+
+public:
+    explicit AllocationSite(const char* site) : previous(AllocationProfiler::exchangeSite(site)) {}
+    ~AllocationSite() { AllocationProfiler::exchangeSite(previous); }
+
+    // Moves to a sibling label without opening a new scope
+    void relabel(const char* site) { AllocationProfiler::exchangeSite(site); }
+
+    AllocationSite(const AllocationSite&) = delete;
+    AllocationSite& operator=(const AllocationSite&) = delete;
+};
+
+// Kept out of line so the compiler does not pair inlined malloc/free with new/delete call sites
+#if defined(__GNUC__)
+#define ENGINE_NOINLINE __attribute__((noinline))
+#else
+#define ENGINE_NOINLINE
+#endif
+
+ENGINE_NOINLINE void* operator new(size_t size) {
+    threadAllocations.count++;
+    threadAllocations.bytes += size;
+    AllocationProfiler::record(size);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+ENGINE_NOINLINE void operator delete(void* p) noexcept {
+    free(p);
+}
+
+ENGINE_NOINLINE void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+ENGINE_NOINLINE void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+ENGINE_NOINLINE void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
 // Forward declarations for exception classes
 class InvalidHoursException;
 class NullPointerException;
@@ -53,10 +255,13 @@ class Freelancer : public User {
 private:
     string skillSet;
     double hourlyRate;
+    int completedMilestones;
+    int onTimeMilestones;
 
 public:
     Freelancer(const string& userName, const string& userEmail, const string& skills, double rate)
-        : User(userName, userEmail), skillSet(skills), hourlyRate(rate) {
+        : User(userName, userEmail), skillSet(skills), hourlyRate(rate),
+        completedMilestones(0), onTimeMilestones(0) {
     }
 
     ~Freelancer() override = default;
@@ -67,6 +272,19 @@ public:
     }
 
     double getHourlyRate() const { return hourlyRate; }
+    const string& getSkillSet() const { return skillSet; }
+
+    // Track delivery history used when ranking freelancers for new work
+    void recordCompletion(bool onTime) {
+        completedMilestones++;
+        if (onTime) onTimeMilestones++;
+    }
+
+    // Freelancers without history get a neutral score instead of zero
+    double getOnTimeRate() const {
+        if (completedMilestones == 0) return 0.5;
+        return static_cast<double>(onTimeMilestones) / completedMilestones;
+    }
 };
 
 // Abstract base class for Payment methods
@@ -168,6 +386,8 @@ public:
         : Milestone(title, desc, payment), fixedAmount(amount) {
     }
 
+    double getFixedAmount() const { return fixedAmount; }
+
     double calculatePayment() override {
         if (isCompleted) {
             return fixedAmount;
@@ -198,6 +418,36 @@ public:
     PaymentFailureException() : runtime_error("Payment processing failed: amount is zero or negative") {}
 };
 
+class UnknownProjectException : public runtime_error {
+public:
+    UnknownProjectException(long id) : runtime_error("Unknown project id " + to_string(id)) {}
+};
+
+// Why Project::executeProjectWorkflow returned false
+enum WorkflowFailure {
+    FAILURE_NONE,
+    FAILURE_INVALID_HOURS,
+    FAILURE_NULL_POINTER,
+    FAILURE_PAYMENT,
+    FAILURE_OTHER
+};
+
+const char* const workflowFailureNames[] = { "none", "InvalidHoursException", "NullPointerException",
+    "PaymentFailureException", "other" };
+
+// Thrown by the engine service when a project's workflow fails; carries the cause
+class WorkflowFailedException : public runtime_error {
+private:
+    WorkflowFailure cause;
+
+public:
+    WorkflowFailedException(const string& project, WorkflowFailure failure)
+        : runtime_error("Workflow failed for project " + project + " (" + workflowFailureNames[failure] + ")"),
+        cause(failure) {}
+
+    WorkflowFailure getCause() const { return cause; }
+};
+
 // Concrete implementation of Milestone - Hourly type
 class HourlyMilestone : public Milestone {
 private:
@@ -227,23 +477,297 @@ public:
     }
 
     void setHoursWorked(double hours) {
-        if (hours < 0) {
+        if (hours < 0 || !isfinite(hours)) {
             throw InvalidHoursException();
         }
         hoursWorked = hours;
     }
+
+    double getHoursWorked() const { return hoursWorked; }
+    double getHourlyRate() const { return hourlyRate; }
+};
+
+// Engine-wide counters and gauges for monitoring. Counters live in per-thread
+// blocks aligned and padded to whole cache lines, so hot-path increments never
+// contend or false-share; exporting sums the blocks of every thread.
+enum EngineCounter {
+    METRIC_PROJECTS_EXECUTED,
+    METRIC_MILESTONES_FIXED,
+    METRIC_MILESTONES_HOURLY,
+    METRIC_PAYMENTS_ESCROW,
+    METRIC_PAYMENTS_DIRECT,
+    METRIC_FAILURES_INVALID_HOURS,
+    METRIC_FAILURES_NULL_POINTER,
+    METRIC_FAILURES_PAYMENT,
+    METRIC_FAILURES_OTHER,
+    METRIC_RECEIPT_BYTES,
+    METRIC_ESCROW_RELEASED,
+    METRIC_ESCROW_REFUNDED,
+    METRIC_ESCROW_HELD,
+    METRIC_ANOMALY_HOURS,
+    METRIC_ANOMALY_RATE,
+    METRIC_ANOMALY_CLIENT_SPEND,
+    METRIC_RETAINER_SETTLED,
+    METRIC_RETAINER_FAILED,
+    METRIC_RETAINER_ABANDONED,
+    METRIC_COUNTER_COUNT
+};
+
+enum EngineGauge {
+    GAUGE_OPEN_CONNECTIONS,
+    GAUGE_OPEN_PROJECTS,
+    GAUGE_PENDING_OUTPUT_BYTES,
+    METRIC_GAUGE_COUNT
+};
+
+class EngineMetrics {
+private:
+    struct alignas(64) ThreadCounters {
+        atomic<uint64_t> values[METRIC_COUNTER_COUNT];
+
+        ThreadCounters() {
+            for (atomic<uint64_t>& v : values) v.store(0, memory_order_relaxed);
+        }
+    };
+
+    static mutex registryLock;
+    static vector<ThreadCounters*> registry;  // Kept after thread exit so totals never go backwards
+    static atomic<int64_t> gauges[METRIC_GAUGE_COUNT];
+
+    static ThreadCounters& local() {
+        thread_local ThreadCounters* counters = nullptr;
+        if (!counters) {
+            counters = new ThreadCounters();
+            lock_guard<mutex> guard(registryLock);
+            registry.push_back(counters);
+        }
+        return *counters;
+    }
+
+public:
+    static void increment(EngineCounter counter, uint64_t amount = 1) {
+        atomic<uint64_t>& value = local().values[counter];
+        value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+    // Gauges change rarely (connections opening, projects created) so they are shared
+    static void adjustGauge(EngineGauge gauge, int64_t delta) {
+        gauges[gauge].fetch_add(delta, memory_order_relaxed);
+    }
+
+    static uint64_t total(EngineCounter counter) {
+        uint64_t sum = 0;
+        lock_guard<mutex> guard(registryLock);
+        for (ThreadCounters* counters : registry) sum += counters->values[counter].load(memory_order_relaxed);
+        return sum;
+    }
+
+    static int64_t gauge(EngineGauge gauge) {
+        return gauges[gauge].load(memory_order_relaxed);
+    }
+
+    // Renders every metric in the Prometheus text exposition format
+    static string prometheusText() {
+        string out;
+        auto metric = [&out](const char* name, const char* type, const char* help) {
+            out += string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+        };
+        auto sample = [&out](const char* name, const char* labels, uint64_t value) {
+            out += name;
+            out += labels;
+            out += " " + to_string(value) + "\n";
+        };
+
+        metric("engine_projects_executed_total", "counter", "Workflows run by executeProjectWorkflow.");
+        sample("engine_projects_executed_total", "", total(METRIC_PROJECTS_EXECUTED));
+        metric("engine_milestones_completed_total", "counter", "Milestones completed and paid, by type.");
+        sample("engine_milestones_completed_total", "{type=\"fixed\"}", total(METRIC_MILESTONES_FIXED));
+        sample("engine_milestones_completed_total", "{type=\"hourly\"}", total(METRIC_MILESTONES_HOURLY));
+        metric("engine_payments_total", "counter", "Payments processed, by method.");
+        sample("engine_payments_total", "{method=\"escrow\"}", total(METRIC_PAYMENTS_ESCROW));
+        sample("engine_payments_total", "{method=\"direct\"}", total(METRIC_PAYMENTS_DIRECT));
+        metric("engine_workflow_failures_total", "counter", "Failed workflows, by exception type.");
+        sample("engine_workflow_failures_total", "{exception=\"InvalidHoursException\"}", total(METRIC_FAILURES_INVALID_HOURS));
+        sample("engine_workflow_failures_total", "{exception=\"NullPointerException\"}", total(METRIC_FAILURES_NULL_POINTER));
+        sample("engine_workflow_failures_total", "{exception=\"PaymentFailureException\"}", total(METRIC_FAILURES_PAYMENT));
+        sample("engine_workflow_failures_total", "{exception=\"other\"}", total(METRIC_FAILURES_OTHER));
+        metric("engine_receipt_bytes_logged_total", "counter", "Bytes appended to the receipt log.");
+        sample("engine_receipt_bytes_logged_total", "", total(METRIC_RECEIPT_BYTES));
+        metric("engine_escrow_expired_total", "counter", "Escrow holds settled by the expiry sweeper, by action.");
+        sample("engine_escrow_expired_total", "{action=\"release\"}", total(METRIC_ESCROW_RELEASED));
+        sample("engine_escrow_expired_total", "{action=\"refund\"}", total(METRIC_ESCROW_REFUNDED));
+        sample("engine_escrow_expired_total", "{action=\"held\"}", total(METRIC_ESCROW_HELD));
+        metric("engine_settlement_anomalies_total", "counter", "Settlements flagged by the anomaly screen, by rule.");
+        sample("engine_settlement_anomalies_total", "{rule=\"hours\"}", total(METRIC_ANOMALY_HOURS));
+        sample("engine_settlement_anomalies_total", "{rule=\"rate\"}", total(METRIC_ANOMALY_RATE));
+        sample("engine_settlement_anomalies_total", "{rule=\"client_spend\"}", total(METRIC_ANOMALY_CLIENT_SPEND));
+        metric("engine_retainer_instances_total", "counter", "Retainer instance attempts, by outcome.");
+        sample("engine_retainer_instances_total", "{outcome=\"settled\"}", total(METRIC_RETAINER_SETTLED));
+        sample("engine_retainer_instances_total", "{outcome=\"failed\"}", total(METRIC_RETAINER_FAILED));
+        sample("engine_retainer_instances_total", "{outcome=\"abandoned\"}", total(METRIC_RETAINER_ABANDONED));
+
+        metric("engine_open_connections", "gauge", "Client connections held by the service event loops.");
+        out += "engine_open_connections " + to_string(gauge(GAUGE_OPEN_CONNECTIONS)) + "\n";
+        metric("engine_open_projects", "gauge", "Projects created but not yet completed or cancelled.");
+        out += "engine_open_projects " + to_string(gauge(GAUGE_OPEN_PROJECTS)) + "\n";
+        metric("engine_pending_output_bytes", "gauge", "Response bytes queued for slow clients.");
+        out += "engine_pending_output_bytes " + to_string(gauge(GAUGE_PENDING_OUTPUT_BYTES)) + "\n";
+        return out;
+    }
+};
+
+mutex EngineMetrics::registryLock;
+vector<EngineMetrics::ThreadCounters*> EngineMetrics::registry;
+atomic<int64_t> EngineMetrics::gauges[METRIC_GAUGE_COUNT];
+
+// Periodically rewrites a Prometheus text file (for node_exporter's textfile
+// collector or similar) from a background thread. The file is replaced
+// atomically via rename so scrapers never see a partial write.
+class MetricsFileExporter {
+private:
+    string path;
+    chrono::milliseconds interval;
+    atomic<bool> stopping;
+    mutex wakeLock;
+    condition_variable wake;
+    thread worker;
+
+    void writeOnce() {
+        string temp = path + ".tmp";
+        {
+            ofstream out(temp, ios::trunc);
+            if (!out.is_open()) return;
+            out << EngineMetrics::prometheusText();
+        }
+        rename(temp.c_str(), path.c_str());
+    }
+
+public:
+    MetricsFileExporter(const string& fileName, chrono::milliseconds period)
+        : path(fileName), interval(period), stopping(false) {
+        worker = thread([this]() {
+            unique_lock<mutex> guard(wakeLock);
+            while (!stopping) {
+                wake.wait_for(guard, interval, [this]() { return stopping.load(); });
+                writeOnce();
+            }
+        });
+    }
+
+    MetricsFileExporter(const MetricsFileExporter&) = delete;
+    MetricsFileExporter& operator=(const MetricsFileExporter&) = delete;
+
+    // Stops the thread after a final export
+    ~MetricsFileExporter() {
+        {
+            lock_guard<mutex> guard(wakeLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+};
+
+// Rules of the settlement anomaly screen, as bit flags
+enum AnomalyRule {
+    ANOMALY_HOURS = 1,         // Hours far above the freelancer's history
+    ANOMALY_RATE = 2,          // Billed hourly rate far from the freelancer's profile or usual rate
+    ANOMALY_CLIENT_SPEND = 4   // Amount far above what the client usually pays
 };
 
+// "hours, client spend" for ANOMALY_HOURS | ANOMALY_CLIENT_SPEND
+string describeAnomalies(uint8_t flags) {
+    string text;
+    if (flags & ANOMALY_HOURS) text += "hours";
+    if (flags & ANOMALY_RATE) text += string(text.empty() ? "" : ", ") + "rate";
+    if (flags & ANOMALY_CLIENT_SPEND) text += string(text.empty() ? "" : ", ") + "client spend";
+    return text;
+}
+
+// Payment type of escrow handed back to the client when a hold expires. Refund
+// receipts name no freelancer and move no earnings, so the receipt listeners
+// and the ledger loaders leave them out.
+const char* const ESCROW_REFUND_TYPE = "Escrow Refund";
+
 // Logger class for file handling
+// One settled payment as handed to the receipt log. Views are only valid
+// for the duration of the call that receives the record.
+struct PaymentRecord {
+    string_view clientName, clientEmail;
+    string_view freelancerName, freelancerEmail;
+    string_view freelancerSkills;
+    string_view milestoneTitle;
+    string_view paymentType;
+    double amount = 0.0;
+    time_t timestamp = 0;
+    uint8_t anomalies = 0;  // AnomalyRule flags from the settlement screen
+
+    bool isRefund() const { return paymentType == ESCROW_REFUND_TYPE; }
+};
+
+// Observer for receipts as they are logged, e.g. the in-memory analytics store.
+// Called on the logging thread, so implementations synchronize themselves.
+class ReceiptListener {
+public:
+    virtual ~ReceiptListener() {}
+    virtual void onPaymentReceipt(const PaymentRecord& record) = 0;
+};
+
 class Logger {
 private:
     string logFileName;
 
+    // Listeners are registered before workflows start and removed after they stop
+    static vector<ReceiptListener*> listeners;
+
+    // "Jan 14 2026 11:50:53" in local time, reformatted at most once a second per thread
+    static const char* formatTimestamp(time_t when) {
+        thread_local time_t cachedSecond = -1;
+        thread_local char cachedText[32];
+        if (when != cachedSecond) {
+            tm local;
+#ifdef _WIN32
+            localtime_s(&local, &when);
+#else
+            localtime_r(&when, &local);
+#endif
+            strftime(cachedText, sizeof(cachedText), "%b %d %Y %H:%M:%S", &local);
+            cachedSecond = when;
+        }
+        return cachedText;
+    }
+
+    static void formatReceipt(ostringstream& receipt, const PaymentRecord& record) {
+        // Shortest round-trip form, so "2500" stays "2500" and large amounts keep every digit
+        char amountText[32];
+        to_chars_result amountEnd = to_chars(amountText, amountText + sizeof(amountText), record.amount);
+
+        receipt << "=== PAYMENT RECEIPT ===" << endl;
+        receipt << "Milestone: " << record.milestoneTitle << endl;
+        if (!record.clientName.empty() || !record.clientEmail.empty()) {
+            receipt << "Client: " << record.clientName << " <" << record.clientEmail << ">" << endl;
+        }
+        if (!record.freelancerName.empty() || !record.freelancerEmail.empty()) {
+            receipt << "Freelancer: " << record.freelancerName << " <" << record.freelancerEmail << ">" << endl;
+        }
+        receipt << "Amount: $" << string_view(amountText, amountEnd.ptr - amountText) << endl;
+        receipt << "Payment Type: " << record.paymentType << endl;
+        if (record.anomalies) receipt << "Anomalies: " << describeAnomalies(record.anomalies) << endl;
+        receipt << "Timestamp: " << formatTimestamp(record.timestamp) << endl;
+        receipt << "========================" << endl << endl;
+    }
+
 public:
     Logger(const string& fileName) : logFileName(fileName) {}
 
+    static void addListener(ReceiptListener* listener) { listeners.push_back(listener); }
+
+    static void removeListener(ReceiptListener* listener) {
+        listeners.erase(remove(listeners.begin(), listeners.end(), listener), listeners.end());
+    }
+
     // --- THIS IS WHERE FILE HANDLING WORKS ---
-    void logPaymentReceipt(const string& milestoneTitle, double amount, const string& paymentType) {
+    void logPaymentReceipt(const PaymentRecord& record) {
         // ofstream is the class for Output File Streams
         // ios::app means "Append" mode (add to the end of file instead of overwriting)
         ofstream logFile(logFileName, ios::app);
@@ -252,168 +776,8627 @@ public:
             throw runtime_error("Unable to open log file");
         }
 
-        logFile << "=== PAYMENT RECEIPT ===" << endl;
-        logFile << "Milestone: " << milestoneTitle << endl;
-        logFile << "Amount: $" << amount << endl;
-        logFile << "Payment Type: " << paymentType << endl;
-        logFile << "Timestamp: " << __DATE__ << " " << __TIME__ << endl;
-        logFile << "========================" << endl << endl;
+        // Format the receipt first so it is written in one go and its size can be counted
+        ostringstream receipt;
+        formatReceipt(receipt, record);
 
+        string text = receipt.str();
+        logFile << text;
         logFile.close(); // Always close the file to save changes
+        EngineMetrics::increment(METRIC_RECEIPT_BYTES, text.size());
+        if (!record.isRefund()) {
+            for (ReceiptListener* listener : listeners) listener->onPaymentReceipt(record);
+        }
         cout << "Payment receipt logged to file: " << logFileName << endl;
     }
-};
-
-// Project class - The Engine that orchestrates the workflow
-class Project {
-private:
-    string projectName;
-    User* client;
-    User* freelancer;
-    Milestone* milestone;
-    Logger* logger;
 
-public:
-    Project(const string& name, User* cl, User* fl, Milestone* ms, Logger* lg)
-        : projectName(name), client(cl), freelancer(fl), milestone(ms), logger(lg) {
+    // Appends several receipts with a single open and write, e.g. a sweep of expired escrow holds
+    void logPaymentReceipts(const vector<PaymentRecord>& records) {
+        if (records.empty()) return;
+        ofstream logFile(logFileName, ios::app);
+        if (!logFile.is_open()) {
+            throw runtime_error("Unable to open log file");
+        }
+        ostringstream receipts;
+        for (const PaymentRecord& record : records) formatReceipt(receipts, record);
+        string text = receipts.str();
+        logFile << text;
+        logFile.close();
+        EngineMetrics::increment(METRIC_RECEIPT_BYTES, text.size());
+        for (const PaymentRecord& record : records) {
+            if (record.isRefund()) continue;  // Not a payment; listeners only see money paid out
+            for (ReceiptListener* listener : listeners) listener->onPaymentReceipt(record);
+        }
+        cout << records.size() << " payment receipt(s) logged to file: " << logFileName << endl;
     }
 
-    ~Project() {
-        delete client;
-        delete freelancer;
-        delete milestone;
-        delete logger;
+    // Receipt without participants, stamped now
+    void logPaymentReceipt(const string& milestoneTitle, double amount, const string& paymentType) {
+        PaymentRecord record;
+        record.milestoneTitle = milestoneTitle;
+        record.paymentType = paymentType;
+        record.amount = amount;
+        record.timestamp = time(nullptr);
+        logPaymentReceipt(record);
     }
+};
 
-    void executeProjectWorkflow() {
-        try {
-            if (!client || !freelancer || !milestone) {
-                throw NullPointerException();
-            }
+vector<ReceiptListener*> Logger::listeners;
 
-            cout << "\n=== PROJECT WORKFLOW START ===" << endl;
-            cout << "Project: " << projectName << endl << endl;
+// Stages of Project::executeProjectWorkflow that are timed separately
+enum WorkflowStage {
+    STAGE_VALIDATE,
+    STAGE_DISPLAY,
+    STAGE_COMPLETE,
+    STAGE_SCREEN,
+    STAGE_SETTLE,
+    STAGE_LOG,
+    STAGE_COUNT
+};
 
-            cout << "Participants:" << endl;
-            client->displayInfo();
-            freelancer->displayInfo();
-            cout << endl;
+const char* const workflowStageNames[STAGE_COUNT] = { "validate", "display", "complete", "screen", "settle", "log" };
 
-            cout << "Milestone Details:" << endl;
-            milestone->displayMilestone();
-            cout << endl;
+// Log-linear latency histogram in the style of HdrHistogram: each power of two
+// of nanoseconds is split into 16 linear sub-buckets, giving ~6% precision from
+// 1 ns up to 2^43 ns (~2.4 hours). Only the owning thread writes; other threads
+// may read concurrently while merging, hence relaxed atomics instead of plain
+// counters.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAGNITUDES = 40;
+    static constexpr int BUCKETS = MAGNITUDES * SUB_BUCKETS;
 
-            milestone->complete();
+private:
+    atomic<uint64_t> counts[BUCKETS];
+    atomic<uint64_t> total;
+    atomic<uint64_t> maxValue;
 
-            double paymentAmount = milestone->calculatePayment();
+    static int bucketFor(uint64_t nanos) {
+        if (nanos < SUB_BUCKETS) return static_cast<int>(nanos);
+        int magnitude = 63 - __builtin_clzll(nanos) - SUB_BUCKET_BITS + 1;
+        if (magnitude >= MAGNITUDES) return BUCKETS - 1;
+        int sub = static_cast<int>(nanos >> (magnitude - 1)) - SUB_BUCKETS;
+        return magnitude * SUB_BUCKETS + sub;
+    }
 
-            if (paymentAmount <= 0) {
-                throw PaymentFailureException();
-            }
+    // Upper bound (inclusive) of the values that land in a bucket
+    static uint64_t valueOf(int bucket) {
+        int magnitude = bucket / SUB_BUCKETS;
+        uint64_t sub = bucket % SUB_BUCKETS;
+        if (magnitude == 0) return sub;
+        return ((SUB_BUCKETS + sub + 1) << (magnitude - 1)) - 1;
+    }
 
-            milestone->paymentMethod->processPayment();
+    static void bump(atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
 
-            logger->logPaymentReceipt(milestone->getTitle(), paymentAmount,
-                milestone->paymentMethod->getPaymentType());
+public:
+    LatencyHistogram() : total(0), maxValue(0) {
+        for (atomic<uint64_t>& c : counts) c.store(0, memory_order_relaxed);
+    }
 
-            cout << "\n=== PROJECT WORKFLOW COMPLETED SUCCESSFULLY ===" << endl;
+    void record(uint64_t nanos) {
+        bump(counts[bucketFor(nanos)], 1);
+        bump(total, 1);
+        if (nanos > maxValue.load(memory_order_relaxed)) maxValue.store(nanos, memory_order_relaxed);
+    }
 
+    void mergeFrom(const LatencyHistogram& other) {
+        for (int i = 0; i < BUCKETS; i++) {
+            uint64_t c = other.counts[i].load(memory_order_relaxed);
+            if (c) bump(counts[i], c);
         }
-        catch (const exception& e) {
-            cerr << "Error during execution: " << e.what() << endl;
+        bump(total, other.total.load(memory_order_relaxed));
+        uint64_t otherMax = other.maxValue.load(memory_order_relaxed);
+        if (otherMax > maxValue.load(memory_order_relaxed)) maxValue.store(otherMax, memory_order_relaxed);
+    }
+
+    uint64_t getCount() const { return total.load(memory_order_relaxed); }
+    uint64_t getMax() const { return maxValue.load(memory_order_relaxed); }
+
+    // Value at the given quantile (0..1), in nanoseconds
+    uint64_t percentile(double quantile) const {
+        uint64_t count = getCount();
+        if (count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(ceil(quantile * count));
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i].load(memory_order_relaxed);
+            if (seen >= rank) return min(valueOf(i), getMax());
         }
+        return getMax();
     }
 };
 
-// Helper function to handle input buffer cleaning
-void clearInput() {
-    cin.clear();
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-}
-
-void runCustomProject() {
-    string cName, cEmail, cCompany;
-    string fName, fEmail, fSkill;
-    string pName, mTitle, mDesc;
-    double fRate, mAmount;
-    int typeChoice, payChoice;
+// Samples per-stage workflow latencies into per-thread histograms that are
+// merged only when a report is requested. Sampling is off by default; the
+// disabled cost is one relaxed load per workflow.
+class WorkflowProfiler {
+private:
+    struct ThreadStages {
+        LatencyHistogram stages[STAGE_COUNT];
+        uint32_t countdown = 0;
+    };
 
-    cout << "\n--- CREATE CUSTOM PROJECT ---\n";
+    static atomic<uint32_t> samplingPeriod;  // 0 = off, N = one workflow in N
+    static mutex registryLock;
+    static vector<ThreadStages*> registry;   // Kept after thread exit so reports stay complete
 
-    // Client Input
-    clearInput();
-    cout << "Enter Client Name: "; getline(cin, cName);
-    cout << "Enter Client Email: "; getline(cin, cEmail);
-    cout << "Enter Client Company: "; getline(cin, cCompany);
+    static ThreadStages& local() {
+        thread_local ThreadStages* stages = nullptr;
+        if (!stages) {
+            stages = new ThreadStages();
+            lock_guard<mutex> guard(registryLock);
+            registry.push_back(stages);
+        }
+        return *stages;
+    }
 
-    // Freelancer Input
-    cout << "Enter Freelancer Name: "; getline(cin, fName);
-    cout << "Enter Freelancer Email: "; getline(cin, fEmail);
-    cout << "Enter Freelancer Skill: "; getline(cin, fSkill);
-    cout << "Enter Freelancer Hourly Rate: "; cin >> fRate;
-    clearInput();
+public:
+    static void setSamplingPeriod(uint32_t period) { samplingPeriod.store(period, memory_order_relaxed); }
+    static uint32_t getSamplingPeriod() { return samplingPeriod.load(memory_order_relaxed); }
 
-    // Project Details
-    cout << "Enter Project Name: "; getline(cin, pName);
-    cout << "Enter Milestone Title: "; getline(cin, mTitle);
-    cout << "Enter Milestone Description: "; getline(cin, mDesc);
+    // Decides once per workflow whether its stages are timed
+    static bool shouldSample() {
+        uint32_t period = samplingPeriod.load(memory_order_relaxed);
+        if (period == 0) return false;
+        ThreadStages& stages = local();
+        if (stages.countdown == 0) {
+            stages.countdown = period - 1;
+            return true;
+        }
+        stages.countdown--;
+        return false;
+    }
 
-    // Type Selection
-    cout << "Select Milestone Type (1: Fixed Price, 2: Hourly): ";
-    cin >> typeChoice;
+    static void record(WorkflowStage stage, uint64_t nanos) {
+        local().stages[stage].record(nanos);
+    }
 
-    // Payment Selection
-    cout << "Select Payment Method (1: Escrow, 2: Direct): ";
-    cin >> payChoice;
+    // Merges every thread's histogram for one stage
+    static void merged(WorkflowStage stage, LatencyHistogram& out) {
+        lock_guard<mutex> guard(registryLock);
+        for (ThreadStages* stages : registry) out.mergeFrom(stages->stages[stage]);
+    }
 
-    // Object Creation
-    User* client = new Client(cName, cEmail, cCompany);
-    User* freelancer = new Freelancer(fName, fEmail, fSkill, fRate);
-    Payment* payment = nullptr;
-    Milestone* milestone = nullptr;
+    // Samples and p50/p99/p99.9/max in microseconds for one stage, e.g.
+    // "settle: n=120 p50=0.4 p99=1.2 p99.9=3.1 max=8.7"
+    static string summary(WorkflowStage stage) {
+        LatencyHistogram* histogram = new LatencyHistogram();
+        merged(stage, *histogram);
+        char line[160];
+        snprintf(line, sizeof(line), "%s: n=%llu p50=%.3f p99=%.3f p99.9=%.3f max=%.3f",
+            workflowStageNames[stage], static_cast<unsigned long long>(histogram->getCount()),
+            histogram->percentile(0.50) / 1000.0, histogram->percentile(0.99) / 1000.0,
+            histogram->percentile(0.999) / 1000.0, histogram->getMax() / 1000.0);
+        delete histogram;
+        return line;
+    }
 
-    // 1. Setup Payment
-    if (payChoice == 1) payment = new Escrow(0); // Amount set later based on milestone
-    else payment = new Direct(0);
+    static void report(ostream& out) {
+        out << "Workflow stage latency (us, 1 in " << getSamplingPeriod() << " workflows sampled):" << endl;
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            out << "  " << summary(static_cast<WorkflowStage>(s)) << endl;
+        }
+    }
+};
 
-    // 2. Setup Milestone
-    if (typeChoice == 1) {
-        cout << "Enter Fixed Price Amount: "; cin >> mAmount;
-        // Re-create payment with correct amount for fixed price
-        delete payment;
-        if (payChoice == 1) payment = new Escrow(mAmount);
-        else payment = new Direct(mAmount);
+atomic<uint32_t> WorkflowProfiler::samplingPeriod(0);
+mutex WorkflowProfiler::registryLock;
+vector<WorkflowProfiler::ThreadStages*> WorkflowProfiler::registry;
 
-        milestone = new FixedPriceMilestone(mTitle, mDesc, payment, mAmount);
-    }
-    else {
-        // Hourly
-        double hours;
-        cout << "Enter Hours Worked: "; cin >> hours;
+// Optional timeline tracing of workflow spans, written as Chrome trace-event
+// JSON (opens in Perfetto or chrome://tracing). One project in N is traced;
+// N can be changed at any time and 0 turns tracing off. Each thread appends
+// spans to its own ring buffer with no locks: slots carry a sequence number
+// that is odd while being written, so a concurrent dump skips torn slots.
+class WorkflowTracer {
+private:
+    struct Span {
+        atomic<uint64_t> sequence;
+        const char* name;
+        uint64_t traceId;
+        uint64_t startNanos;
+        uint64_t durationNanos;
+    };
 
-        // Use freelancer rate for payment calculation
-        if (payChoice == 1) payment = new Escrow(0); // Calculated dynamically
-        else payment = new Direct(0);
+    struct ThreadBuffer {
+        static constexpr size_t CAPACITY = 1 << 16;  // Oldest spans are overwritten
+        Span spans[CAPACITY];
+        atomic<uint64_t> written;
+        uint32_t threadId;
+        uint32_t countdown = 0;
 
-        HourlyMilestone* hm = new HourlyMilestone(mTitle, mDesc, payment, fRate);
-        try {
-            hm->setHoursWorked(hours);
-            milestone = hm;
+        ThreadBuffer(uint32_t id) : written(0), threadId(id) {
+            for (Span& span : spans) span.sequence.store(0, memory_order_relaxed);
         }
-        catch (...) {
-            delete client; delete freelancer; delete hm;
-            cout << "Invalid hours input. Aborting.\n";
-            return;
+    };
+
+    static atomic<uint32_t> samplingPeriod;
+    static atomic<uint64_t> nextTraceId;
+    static mutex registryLock;
+    static vector<ThreadBuffer*> registry;
+    static const chrono::steady_clock::time_point epoch;
+
+    static ThreadBuffer& local() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            lock_guard<mutex> guard(registryLock);
+            buffer = new ThreadBuffer(static_cast<uint32_t>(registry.size() + 1));
+            registry.push_back(buffer);
         }
+        return *buffer;
     }
 
-    // Execute
-    Project* project = new Project(pName, client, freelancer, milestone, new Logger("payment_receipts.txt"));
+public:
+    static void setSamplingPeriod(uint32_t period) { samplingPeriod.store(period, memory_order_relaxed); }
+    static uint32_t getSamplingPeriod() { return samplingPeriod.load(memory_order_relaxed); }
+
+    static uint64_t now() {
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - epoch).count());
+    }
+
+    // Returns a trace id for a new project, or 0 if it is not sampled
+    static uint64_t startTrace() {
+        uint32_t period = samplingPeriod.load(memory_order_relaxed);
+        if (period == 0) return 0;
+        ThreadBuffer& buffer = local();
+        if (buffer.countdown > 0) {
+            buffer.countdown--;
+            return 0;
+        }
+        buffer.countdown = period - 1;
+        return nextTraceId.fetch_add(1, memory_order_relaxed);
+    }
+
+    static void record(const char* name, uint64_t traceId, uint64_t startNanos, uint64_t endNanos) {
+        ThreadBuffer& buffer = local();
+        uint64_t index = buffer.written.load(memory_order_relaxed);
+        Span& span = buffer.spans[index % ThreadBuffer::CAPACITY];
+        uint64_t sequence = span.sequence.load(memory_order_relaxed);
+        span.sequence.store(sequence + 1, memory_order_relaxed);  // Odd: write in progress
+        atomic_thread_fence(memory_order_release);
+        span.name = name;
+        span.traceId = traceId;
+        span.startNanos = startNanos;
+        span.durationNanos = endNanos - startNanos;
+        span.sequence.store(sequence + 2, memory_order_release);
+        buffer.written.store(index + 1, memory_order_release);
+    }
+
+    // Writes every buffered span as Chrome trace-event JSON; returns the span count
+    static size_t dump(const string& fileName) {
+        ofstream out(fileName, ios::trunc);
+        if (!out.is_open()) {
+            throw runtime_error("Unable to write trace file: " + fileName);
+        }
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        size_t count = 0;
+        char event[256];
+        lock_guard<mutex> guard(registryLock);
+        for (ThreadBuffer* buffer : registry) {
+            uint64_t written = buffer->written.load(memory_order_acquire);
+            uint64_t first = written > ThreadBuffer::CAPACITY ? written - ThreadBuffer::CAPACITY : 0;
+            for (uint64_t i = first; i < written; i++) {
+                const Span& span = buffer->spans[i % ThreadBuffer::CAPACITY];
+                uint64_t before = span.sequence.load(memory_order_acquire);
+                const char* name = span.name;
+                uint64_t traceId = span.traceId, start = span.startNanos, duration = span.durationNanos;
+                atomic_thread_fence(memory_order_acquire);
+                if ((before & 1) || span.sequence.load(memory_order_relaxed) != before) continue;
+
+                snprintf(event, sizeof(event),
+                    "%s\n{\"name\":\"%s\",\"cat\":\"workflow\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":1,\"tid\":%u,\"args\":{\"project\":%llu}}",
+                    count == 0 ? "" : ",", name, start / 1000.0, duration / 1000.0,
+                    buffer->threadId, static_cast<unsigned long long>(traceId));
+                out << event;
+                count++;
+            }
+        }
+        out << "\n]}\n";
+        return count;
+    }
+};
+
+atomic<uint32_t> WorkflowTracer::samplingPeriod(0);
+atomic<uint64_t> WorkflowTracer::nextTraceId(1);
+mutex WorkflowTracer::registryLock;
+vector<WorkflowTracer::ThreadBuffer*> WorkflowTracer::registry;
+const chrono::steady_clock::time_point WorkflowTracer::epoch = chrono::steady_clock::now();
+
+enum HardwareEvent {
+    HW_CYCLES,
+    HW_INSTRUCTIONS,
+    HW_CACHE_MISSES,
+    HW_BRANCH_MISSES,
+    HW_EVENT_COUNT
+};
+
+const char* const hardwareEventNames[HW_EVENT_COUNT] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+struct HardwareSample {
+    uint64_t values[HW_EVENT_COUNT] = {};
+    bool valid[HW_EVENT_COUNT] = {};
+};
+
+// User-space hardware counters for the calling thread, read through perf_event_open.
+// Each event is opened on its own so one missing event (common under virtualization)
+// only drops that column; if none open, available() is false and reason() says why.
+class HardwareCounters {
+private:
+    int fds[HW_EVENT_COUNT];
+    string unavailableReason;
+
+public:
+    HardwareCounters() {
+        for (int& fd : fds) fd = -1;
+#ifdef __linux__
+        static const uint64_t configs[HW_EVENT_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        int lastError = 0;
+        for (int event = 0; event < HW_EVENT_COUNT; event++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[event];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            long fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+            if (fd < 0) lastError = errno;
+            else fds[event] = static_cast<int>(fd);
+        }
+        if (!available()) {
+            unavailableReason = string("perf_event_open failed: ") + strerror(lastError);
+            if (lastError == EACCES || lastError == EPERM) {
+                unavailableReason += " (check /proc/sys/kernel/perf_event_paranoid)";
+            }
+            else if (lastError == ENOENT || lastError == EOPNOTSUPP) {
+                unavailableReason += " (no hardware PMU exposed, e.g. inside a VM)";
+            }
+        }
+#else
+        unavailableReason = "hardware counters require Linux perf_event_open";
+#endif
+    }
+
+    ~HardwareCounters() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    HardwareCounters(const HardwareCounters&) = delete;
+    HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+    bool available() const {
+        for (int fd : fds) {
+            if (fd >= 0) return true;
+        }
+        return false;
+    }
+
+    const string& reason() const { return unavailableReason; }
+
+    // Current counts, scaled up when the kernel multiplexed an event off the PMU
+    HardwareSample read() const {
+        HardwareSample sample;
+#ifdef __linux__
+        for (int event = 0; event < HW_EVENT_COUNT; event++) {
+            uint64_t data[3];  // value, time enabled, time running
+            if (fds[event] < 0 || ::read(fds[event], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) {
+                continue;
+            }
+            sample.values[event] = data[2] > 0 && data[2] < data[1]
+                ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+            sample.valid[event] = data[2] > 0;
+        }
+#endif
+        return sample;
+    }
+
+    static HardwareSample delta(const HardwareSample& before, const HardwareSample& after) {
+        HardwareSample result;
+        for (int event = 0; event < HW_EVENT_COUNT; event++) {
+            result.valid[event] = before.valid[event] && after.valid[event];
+            if (result.valid[event]) result.values[event] = after.values[event] - before.values[event];
+        }
+        return result;
+    }
+};
+
+// Per-stage hardware counter totals for the diagnostic mode. Installing one on a thread
+// makes every StageTimer there read the counters on entry and exit; that is two reads
+// per counter per stage, far too costly to leave on outside diagnostics.
+class HardwareStageProfile {
+private:
+    static thread_local HardwareStageProfile* installed;
+
+    HardwareCounters counters;
+    HardwareSample totals[STAGE_COUNT];
+    uint64_t calls[STAGE_COUNT] = {};
+
+public:
+    static HardwareStageProfile* current() { return installed; }
+
+    void install() { installed = this; }
+    void uninstall() { if (installed == this) installed = nullptr; }
+
+    const HardwareCounters& getCounters() const { return counters; }
+    HardwareSample read() const { return counters.read(); }
+    const HardwareSample& getTotals(WorkflowStage stage) const { return totals[stage]; }
+    uint64_t getCalls(WorkflowStage stage) const { return calls[stage]; }
+
+    void add(WorkflowStage stage, const HardwareSample& before, const HardwareSample& after) {
+        HardwareSample spent = HardwareCounters::delta(before, after);
+        calls[stage]++;
+        for (int event = 0; event < HW_EVENT_COUNT; event++) {
+            if (!spent.valid[event]) continue;
+            totals[stage].valid[event] = true;
+            totals[stage].values[event] += spent.values[event];
+        }
+    }
+};
+
+thread_local HardwareStageProfile* HardwareStageProfile::installed = nullptr;
+
+// Times one workflow stage for as long as it is in scope, feeding the latency
+// histograms when sampled and the timeline when the project is traced
+class StageTimer {
+private:
+    WorkflowStage stage;
+    bool active;
+    uint64_t traceId;
+    AllocationSite allocationSite;  // Attributes the stage's allocations to it
+    HardwareStageProfile* hardware;  // Set only in the diagnostic mode
+    HardwareSample hardwareStart;
+    chrono::steady_clock::time_point start;
+
+public:
+    StageTimer(WorkflowStage workflowStage, bool sampled, uint64_t projectTraceId = 0)
+        : stage(workflowStage), active(sampled), traceId(projectTraceId),
+        allocationSite(workflowStageNames[workflowStage]), hardware(HardwareStageProfile::current()) {
+        if (active || traceId) start = chrono::steady_clock::now();
+        if (hardware) hardwareStart = hardware->read();
+    }
+
+    ~StageTimer() {
+        if (hardware) hardware->add(stage, hardwareStart, hardware->read());
+        if (!active && !traceId) return;
+        auto end = chrono::steady_clock::now();
+        uint64_t nanos = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+        if (active) WorkflowProfiler::record(stage, nanos);
+        if (traceId) {
+            uint64_t endNanos = WorkflowTracer::now();
+            WorkflowTracer::record(workflowStageNames[stage], traceId, endNanos - nanos, endNanos);
+        }
+    }
+};
+
+struct AnomalyRules {
+    float zThreshold = 4.0f;      // Standard deviations above an entity's mean
+    uint32_t minHistory = 5;      // Settlements before an entity's history is trusted
+    float minSpread = 0.1f;       // Floor on the deviation as a fraction of the mean
+    float rateRatio = 1.5f;       // Billed/profile rate outside [1/ratio, ratio]
+};
+
+// Settlements to screen, one row per settlement across parallel columns.
+// Hours and billed rate are 0 for fixed-price milestones. The profile rate
+// comes from a source other than the bill, e.g. a user directory; with 0 the
+// freelancer's mean billed rate so far stands in for it. Scores and flags are
+// filled in by AnomalyScorer::evaluate.
+struct AnomalyBatch {
+    vector<uint32_t> freelancers;
+    vector<uint32_t> clients;
+    vector<float> hours;
+    vector<float> billedRates;
+    vector<float> profileRates;
+    vector<float> amounts;
+    vector<float> scores;   // Highest rule score; 1 or more is flagged
+    vector<uint8_t> flags;  // AnomalyRule bits
+
+    size_t size() const { return freelancers.size(); }
+
+    void add(uint32_t freelancer, uint32_t client, float hoursWorked, float billedRate, float profileRate, float amount) {
+        freelancers.push_back(freelancer);
+        clients.push_back(client);
+        hours.push_back(hoursWorked);
+        billedRates.push_back(billedRate);
+        profileRates.push_back(profileRate);
+        amounts.push_back(amount);
+    }
+
+    void clear() {
+        freelancers.clear();
+        clients.clear();
+        hours.clear();
+        billedRates.clear();
+        profileRates.clear();
+        amounts.clear();
+    }
+};
+
+// Screens settlements before payment against per-entity running statistics:
+// Welford mean and variance of hours per freelancer and of amounts per client.
+// A batch is scored in L1-sized blocks: each row's features and entity
+// statistics are gathered into fixed-size columns, the rules run as one
+// branch-free loop over the columns that the compiler vectorizes, and finally
+// the rows are folded into the statistics in order. Rows of one batch are therefore judged against
+// the history before the batch. A single workflow is screened as a batch of one.
+class AnomalyScorer {
+private:
+    static constexpr size_t BLOCK = 1024;
+    static constexpr size_t CHUNK = 16;  // One AVX-512 vector of floats
+
+    struct RunningStats {
+        double mean = 0.0;
+        double m2 = 0.0;  // Sum of squared deviations from the mean
+        uint32_t count = 0;
+
+        void add(double value) {
+            count++;
+            double delta = value - mean;
+            mean += delta / count;
+            m2 += delta * (value - mean);
+        }
+    };
+
+    struct FreelancerStats {
+        RunningStats hours;
+        RunningStats rates;  // Billed hourly rates
+    };
+
+    AnomalyRules rules;
+    unordered_map<string, uint32_t> freelancerIds;
+    unordered_map<string, uint32_t> clientIds;
+    vector<FreelancerStats> freelancerStats;
+    vector<RunningStats> clientSpend;
+    // One block of rows being scored. Fixed-size member arrays let the compiler
+    // see that they never overlap and vectorize the rule pass without runtime checks.
+    struct ScoreBlock {
+        float hours[BLOCK], hoursMean[BLOCK], hoursScale[BLOCK];  // Scale 0 = no trusted history
+        float amounts[BLOCK], spendMean[BLOCK], spendScale[BLOCK];
+        float rateAbove[BLOCK], rateBelow[BLOCK];  // Billed/profile rate relative to the allowed ratio, both ways
+        float scores[BLOCK];
+        uint8_t flags[BLOCK];
+    };
+
+    ScoreBlock block;
+    AnomalyBatch single;
+    uint64_t screened = 0;
+    mutex lock;
+
+    static AnomalyScorer* activeScorer;
+
+    // 1 / (threshold * deviation), so a row's z-score over the threshold is (x - mean) * scale
+    float scaleFor(const RunningStats& stats) const {
+        if (stats.count < rules.minHistory) return 0.0f;
+        double deviation = max(sqrt(stats.m2 / (stats.count - 1)), rules.minSpread * fabs(stats.mean));
+        return deviation > 0.0 ? static_cast<float>(1.0 / (rules.zThreshold * deviation)) : 0.0f;
+    }
+
+    template <typename Stats>
+    static uint32_t idFor(unordered_map<string, uint32_t>& ids, vector<Stats>& stats, const string& key) {
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(stats.size());
+        ids.emplace(key, id);
+        stats.push_back(Stats());
+        return id;
+    }
+
+    // Rule pass over N rows from offset, branch-free; every rule scores 1 at its threshold.
+    // The fixed trip count lets the compiler vectorize it without a scalar remainder.
+    template <size_t N>
+    void scoreRows(size_t offset) {
+        ScoreBlock& b = block;
+        for (size_t i = offset; i < offset + N; i++) {
+            float hoursScore = (b.hours[i] - b.hoursMean[i]) * b.hoursScale[i];
+            float spendScore = (b.amounts[i] - b.spendMean[i]) * b.spendScale[i];
+            float rateScore = b.rateAbove[i] > b.rateBelow[i] ? b.rateAbove[i] : b.rateBelow[i];
+            uint8_t flagged = hoursScore > 1.0f ? ANOMALY_HOURS : 0;
+            flagged |= rateScore > 1.0f ? ANOMALY_RATE : 0;
+            flagged |= spendScore > 1.0f ? ANOMALY_CLIENT_SPEND : 0;
+            b.flags[i] = flagged;
+            float score = hoursScore > spendScore ? hoursScore : spendScore;
+            b.scores[i] = score > rateScore ? score : rateScore;
+        }
+    }
+
+    void evaluateLocked(AnomalyBatch& batch) {
+        size_t rows = batch.size();
+        batch.scores.resize(rows);
+        batch.flags.resize(rows);
+        const float ratio = rules.rateRatio;
+
+        for (size_t base = 0; base < rows; base += BLOCK) {
+            size_t count = min(BLOCK, rows - base);
+            // Gather pass: row features plus the history of the row's entities
+            for (size_t i = 0; i < count; i++) {
+                const FreelancerStats& history = freelancerStats[batch.freelancers[base + i]];
+                const RunningStats& worked = history.hours;
+                const RunningStats& spent = clientSpend[batch.clients[base + i]];
+                float hours = batch.hours[base + i];
+                float billed = batch.billedRates[base + i];
+                float profile = batch.profileRates[base + i];
+                if (profile <= 0.0f && history.rates.count >= rules.minHistory) {
+                    profile = static_cast<float>(history.rates.mean);
+                }
+                bool priced = billed > 0.0f && profile > 0.0f;
+                block.hours[i] = hours;
+                block.hoursMean[i] = static_cast<float>(worked.mean);
+                block.hoursScale[i] = hours > 0.0f ? scaleFor(worked) : 0.0f;
+                block.amounts[i] = batch.amounts[base + i];
+                block.spendMean[i] = static_cast<float>(spent.mean);
+                block.spendScale[i] = scaleFor(spent);
+                block.rateAbove[i] = priced ? billed / (profile * ratio) : 0.0f;
+                block.rateBelow[i] = priced ? profile / (billed * ratio) : 0.0f;
+            }
+            // Short blocks (a single workflow) only score the vectors they touch
+            size_t padded = count == BLOCK ? BLOCK : (count + CHUNK - 1) / CHUNK * CHUNK;
+            for (size_t i = count; i < padded; i++) {
+                block.hoursScale[i] = block.spendScale[i] = block.rateAbove[i] = block.rateBelow[i] = 0.0f;
+            }
+            if (padded == BLOCK) scoreRows<BLOCK>(0);
+            else for (size_t offset = 0; offset < padded; offset += CHUNK) scoreRows<CHUNK>(offset);
+            copy(block.scores, block.scores + count, &batch.scores[base]);
+            copy(block.flags, block.flags + count, &batch.flags[base]);
+        }
+
+        for (size_t i = 0; i < rows; i++) {
+            FreelancerStats& history = freelancerStats[batch.freelancers[i]];
+            if (batch.hours[i] > 0.0f) history.hours.add(batch.hours[i]);
+            if (batch.billedRates[i] > 0.0f) history.rates.add(batch.billedRates[i]);
+            clientSpend[batch.clients[i]].add(batch.amounts[i]);
+        }
+        screened += rows;
+    }
+
+public:
+    explicit AnomalyScorer(const AnomalyRules& anomalyRules = AnomalyRules()) : rules(anomalyRules) {}
+
+    // The scorer consulted by executeProjectWorkflow; set before workflows start
+    static void setActive(AnomalyScorer* scorer) { activeScorer = scorer; }
+    static AnomalyScorer* active() { return activeScorer; }
+
+    uint32_t freelancerId(const string& email) {
+        lock_guard<mutex> guard(lock);
+        return idFor(freelancerIds, freelancerStats, email);
+    }
+
+    uint32_t clientId(const string& email) {
+        lock_guard<mutex> guard(lock);
+        return idFor(clientIds, clientSpend, email);
+    }
+
+    uint64_t screenedCount() {
+        lock_guard<mutex> guard(lock);
+        return screened;
+    }
+
+    // Scores every row of batch, then adds the rows to the history
+    void evaluate(AnomalyBatch& batch) {
+        lock_guard<mutex> guard(lock);
+        evaluateLocked(batch);
+    }
+
+    // Screens one milestone about to be paid amount; returns its AnomalyRule flags.
+    // Flagged payments still go ahead; the caller marks them on the receipt.
+    // A workflow's Freelancer is built from the same request as its milestone,
+    // so its rate says nothing about the bill: the rate rule compares against
+    // the freelancer's usual billed rate instead.
+    uint8_t screen(const User& client, const User& freelancer, const Milestone& milestone, double amount) {
+        float hours = 0.0f, billedRate = 0.0f, profileRate = 0.0f;
+        if (const HourlyMilestone* hourly = dynamic_cast<const HourlyMilestone*>(&milestone)) {
+            hours = static_cast<float>(hourly->getHoursWorked());
+            billedRate = static_cast<float>(hourly->getHourlyRate());
+        }
+
+        uint8_t flags;
+        {
+            lock_guard<mutex> guard(lock);
+            single.clear();
+            single.add(idFor(freelancerIds, freelancerStats, freelancer.getEmail()),
+                idFor(clientIds, clientSpend, client.getEmail()), hours, billedRate, profileRate, static_cast<float>(amount));
+            evaluateLocked(single);
+            flags = single.flags[0];
+        }
+        if (flags == 0) return 0;
+        if (flags & ANOMALY_HOURS) EngineMetrics::increment(METRIC_ANOMALY_HOURS);
+        if (flags & ANOMALY_RATE) EngineMetrics::increment(METRIC_ANOMALY_RATE);
+        if (flags & ANOMALY_CLIENT_SPEND) EngineMetrics::increment(METRIC_ANOMALY_CLIENT_SPEND);
+        return flags;
+    }
+};
+
+AnomalyScorer* AnomalyScorer::activeScorer = nullptr;
+
+// Project class - The Engine that orchestrates the workflow
+class Project {
+private:
+    string projectName;
+    User* client;
+    User* freelancer;
+    Milestone* milestone;
+    Logger* logger;
+    uint64_t traceId;  // Non-zero when this project's spans are traced
+    WorkflowFailure failure;  // Of the last workflow run
+
+public:
+    Project(const string& name, User* cl, User* fl, Milestone* ms, Logger* lg)
+        : projectName(name), client(cl), freelancer(fl), milestone(ms), logger(lg),
+        traceId(WorkflowTracer::startTrace()), failure(FAILURE_NONE) {
+    }
+
+    ~Project() {
+        delete client;
+        delete freelancer;
+        delete milestone;
+        delete logger;
+    }
+
+    const string& getName() const { return projectName; }
+    User* getClient() const { return client; }
+    User* getFreelancer() const { return freelancer; }
+    Milestone* getMilestone() const { return milestone; }
+    uint64_t getTraceId() const { return traceId; }
+    WorkflowFailure getFailure() const { return failure; }
+
+    // Returns true when the milestone was completed, paid and logged
+    bool executeProjectWorkflow() {
+        bool sampled = WorkflowProfiler::shouldSample();
+        EngineMetrics::increment(METRIC_PROJECTS_EXECUTED);
+        failure = FAILURE_NONE;
+        try {
+            {
+                StageTimer timer(STAGE_VALIDATE, sampled, traceId);
+                if (!client || !freelancer || !milestone) {
+                    throw NullPointerException();
+                }
+            }
+
+            {
+                StageTimer timer(STAGE_DISPLAY, sampled, traceId);
+                cout << "\n=== PROJECT WORKFLOW START ===" << endl;
+                cout << "Project: " << projectName << endl << endl;
+
+                cout << "Participants:" << endl;
+                client->displayInfo();
+                freelancer->displayInfo();
+                cout << endl;
+
+                cout << "Milestone Details:" << endl;
+                milestone->displayMilestone();
+                cout << endl;
+            }
+
+            double paymentAmount;
+            {
+                StageTimer timer(STAGE_COMPLETE, sampled, traceId);
+                milestone->complete();
+
+                paymentAmount = milestone->calculatePayment();
+
+                if (paymentAmount <= 0 || !isfinite(paymentAmount)) {
+                    throw PaymentFailureException();
+                }
+            }
+
+            uint8_t anomalies = 0;
+            if (AnomalyScorer* scorer = AnomalyScorer::active()) {
+                StageTimer timer(STAGE_SCREEN, sampled, traceId);
+                anomalies = scorer->screen(*client, *freelancer, *milestone, paymentAmount);
+                if (anomalies) {
+                    cerr << "Anomaly flagged for project " << projectName << ": unusual " << describeAnomalies(anomalies)
+                        << endl;
+                }
+            }
+
+            {
+                StageTimer timer(STAGE_SETTLE, sampled, traceId);
+                milestone->paymentMethod->processPayment();
+            }
+
+            {
+                StageTimer timer(STAGE_LOG, sampled, traceId);
+                PaymentRecord record;
+                record.clientName = client->getName();
+                record.clientEmail = client->getEmail();
+                record.freelancerName = freelancer->getName();
+                record.freelancerEmail = freelancer->getEmail();
+                if (const Freelancer* worker = dynamic_cast<const Freelancer*>(freelancer)) {
+                    record.freelancerSkills = worker->getSkillSet();
+                }
+                record.milestoneTitle = milestone->getTitle();
+                record.paymentType = milestone->paymentMethod->getPaymentType();
+                record.amount = paymentAmount;
+                record.timestamp = time(nullptr);
+                record.anomalies = anomalies;
+                logger->logPaymentReceipt(record);
+            }
+
+            bool hourly = dynamic_cast<HourlyMilestone*>(milestone) != nullptr;
+            bool escrow = dynamic_cast<Escrow*>(milestone->paymentMethod) != nullptr;
+            EngineMetrics::increment(hourly ? METRIC_MILESTONES_HOURLY : METRIC_MILESTONES_FIXED);
+            EngineMetrics::increment(escrow ? METRIC_PAYMENTS_ESCROW : METRIC_PAYMENTS_DIRECT);
+
+            cout << "\n=== PROJECT WORKFLOW COMPLETED SUCCESSFULLY ===" << endl;
+            return true;
+        }
+        catch (const exception& e) {
+            if (dynamic_cast<const InvalidHoursException*>(&e)) {
+                failure = FAILURE_INVALID_HOURS;
+                EngineMetrics::increment(METRIC_FAILURES_INVALID_HOURS);
+            }
+            else if (dynamic_cast<const NullPointerException*>(&e)) {
+                failure = FAILURE_NULL_POINTER;
+                EngineMetrics::increment(METRIC_FAILURES_NULL_POINTER);
+            }
+            else if (dynamic_cast<const PaymentFailureException*>(&e)) {
+                failure = FAILURE_PAYMENT;
+                EngineMetrics::increment(METRIC_FAILURES_PAYMENT);
+            }
+            else {
+                failure = FAILURE_OTHER;
+                EngineMetrics::increment(METRIC_FAILURES_OTHER);
+            }
+            cerr << "Error during execution: " << e.what() << endl;
+            return false;
+        }
+    }
+};
+
+// One project request as read from a batch file. Text fields view into the
+// parser's buffer and are only valid until the next request is read.
+struct ProjectRequest {
+    string_view clientName, clientEmail, clientCompany;
+    string_view freelancerName, freelancerEmail, freelancerSkills;
+    double freelancerRate = 0.0;
+    string_view projectName, milestoneTitle, milestoneDesc;
+    bool hourly = false;    // "milestone_type": "fixed" or "hourly"
+    bool escrow = true;     // "payment": "escrow" or "direct"
+    double amount = 0.0;    // Fixed price amount
+    double hours = 0.0;     // Hours worked for hourly milestones
+};
+
+// Receipts are line-based records in the ledger, so request text may not hold
+// line breaks or other control characters that could forge a receipt
+inline bool hasControlCharacter(string_view text) {
+    for (char c : text) {
+        if (static_cast<unsigned char>(c) < 0x20 || c == 0x7F) return true;
+    }
+    return false;
+}
+
+// Builds a ready-to-run Project from a request, mirroring runCustomProject.
+// Throws InvalidHoursException for negative hours and runtime_error for text
+// with control characters or non-finite numbers; nothing is leaked.
+Project* buildProject(const ProjectRequest& req, Logger* logger) {
+    if (!isfinite(req.amount) || !isfinite(req.freelancerRate) || !isfinite(req.hours)) {
+        delete logger;
+        throw runtime_error("Request amounts, rates and hours must be finite numbers");
+    }
+    for (string_view text : {req.clientName, req.clientEmail, req.clientCompany, req.freelancerName,
+            req.freelancerEmail, req.freelancerSkills, req.projectName, req.milestoneTitle, req.milestoneDesc}) {
+        if (hasControlCharacter(text)) {
+            delete logger;
+            throw runtime_error("Request text cannot contain control characters");
+        }
+    }
+    uint64_t startNanos = WorkflowTracer::getSamplingPeriod() ? WorkflowTracer::now() : 0;
+    AllocationSite site("construct:payment");
+    double paymentAmount = req.hourly ? 0.0 : req.amount;
+    Payment* payment = nullptr;
+    if (req.escrow) payment = new Escrow(paymentAmount);
+    else payment = new Direct(paymentAmount);
+
+    site.relabel("construct:milestone");
+    Milestone* milestone = nullptr;
+    if (req.hourly) {
+        HourlyMilestone* hm = new HourlyMilestone(string(req.milestoneTitle), string(req.milestoneDesc),
+            payment, req.freelancerRate);
+        try {
+            hm->setHoursWorked(req.hours);
+        }
+        catch (...) {
+            delete hm;
+            delete logger;
+            throw;
+        }
+        milestone = hm;
+    }
+    else {
+        milestone = new FixedPriceMilestone(string(req.milestoneTitle), string(req.milestoneDesc),
+            payment, req.amount);
+    }
+
+    site.relabel("construct:users");
+    User* client = new Client(string(req.clientName), string(req.clientEmail), string(req.clientCompany));
+    User* freelancer = new Freelancer(string(req.freelancerName), string(req.freelancerEmail),
+        string(req.freelancerSkills), req.freelancerRate);
+    site.relabel("construct:project");
+    Project* project = new Project(string(req.projectName), client, freelancer, milestone, logger);
+    if (project->getTraceId()) {
+        WorkflowTracer::record("construct", project->getTraceId(), startNanos, WorkflowTracer::now());
+    }
+    return project;
+}
+
+// Streaming JSON Lines reader specialized for the ProjectRequest schema.
+// The file is read in large chunks, lines are located with memchr (which the
+// C library vectorizes) and each line is scanned once, token by token, without
+// building a DOM. Strings are returned as views; only strings containing
+// escape sequences are decoded, into a per-line scratch buffer.
+class ProjectRequestParser {
+private:
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+    ifstream input;
+    vector<char> buffer;
+    size_t begin;        // Start of unconsumed data in buffer
+    size_t end;          // End of valid data in buffer
+    bool eof;
+    size_t lineNumber;
+    size_t bytesRead;
+    string scratch;
+
+    enum Field {
+        UNKNOWN, CLIENT_NAME, CLIENT_EMAIL, CLIENT_COMPANY, FREELANCER_NAME, FREELANCER_EMAIL,
+        FREELANCER_SKILLS, FREELANCER_RATE, PROJECT, MILESTONE, DESCRIPTION, MILESTONE_TYPE,
+        PAYMENT, AMOUNT, HOURS
+    };
+
+    // Fixed-length compare that the compiler turns into a few integer compares
+    template <size_t N>
+    static bool sameKey(string_view key, const char(&name)[N]) {
+        return memcmp(key.data(), name, N - 1) == 0;
+    }
+
+    static Field lookupField(string_view key) {
+        switch (key.size()) {
+        case 5:
+            if (sameKey(key, "hours")) return HOURS;
+            break;
+        case 6:
+            if (sameKey(key, "amount")) return AMOUNT;
+            break;
+        case 7:
+            if (sameKey(key, "project")) return PROJECT;
+            if (sameKey(key, "payment")) return PAYMENT;
+            break;
+        case 9:
+            if (sameKey(key, "milestone")) return MILESTONE;
+            break;
+        case 11:
+            if (sameKey(key, "client_name")) return CLIENT_NAME;
+            if (sameKey(key, "description")) return DESCRIPTION;
+            break;
+        case 12:
+            if (sameKey(key, "client_email")) return CLIENT_EMAIL;
+            break;
+        case 14:
+            if (sameKey(key, "client_company")) return CLIENT_COMPANY;
+            if (sameKey(key, "milestone_type")) return MILESTONE_TYPE;
+            break;
+        case 15:
+            if (sameKey(key, "freelancer_name")) return FREELANCER_NAME;
+            if (sameKey(key, "freelancer_rate")) return FREELANCER_RATE;
+            break;
+        case 16:
+            if (sameKey(key, "freelancer_email")) return FREELANCER_EMAIL;
+            break;
+        case 17:
+            if (sameKey(key, "freelancer_skills")) return FREELANCER_SKILLS;
+            break;
+        }
+        return UNKNOWN;
+    }
+
+    static const char* skipSpace(const char* p, const char* last) {
+        while (p < last && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        return p;
+    }
+
+    // Structural index of the current line: offsets of every '"', built in one
+    // SIMD pass. Lines containing a backslash skip the index and use the
+    // escape-aware path instead.
+    vector<uint32_t> quotes;
+    size_t quoteCount;
+    size_t quoteCursor;
+    bool lineHasEscape;
+    const char* lineStart;
+
+    void indexQuotes(const char* p, const char* last) {
+        size_t length = last - p;
+        if (quotes.size() < length) quotes.resize(length);
+        uint32_t* out = quotes.data();
+        size_t count = 0;
+        quoteCursor = 0;
+        quoteCount = 0;
+        lineHasEscape = false;
+        lineStart = p;
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        for (; i + 16 <= length; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            unsigned quoteBits = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, quote)));
+            unsigned escapeBits = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, backslash)));
+            if (escapeBits) {
+                lineHasEscape = true;
+                return;
+            }
+            while (quoteBits) {
+                out[count++] = static_cast<uint32_t>(i + __builtin_ctz(quoteBits));
+                quoteBits &= quoteBits - 1;
+            }
+        }
+#endif
+        for (; i < length; i++) {
+            if (p[i] == '\\') {
+                lineHasEscape = true;
+                return;
+            }
+            if (p[i] == '"') out[count++] = static_cast<uint32_t>(i);
+        }
+        quoteCount = count;
+    }
+
+    // Parses a string starting at the opening quote; p is left after the closing quote
+    bool parseString(const char*& p, const char* last, string_view& out) {
+        if (!lineHasEscape) {
+            uint32_t open = static_cast<uint32_t>(p - lineStart);
+            while (quoteCursor < quoteCount && quotes[quoteCursor] < open) quoteCursor++;
+            if (quoteCursor + 1 >= quoteCount || quotes[quoteCursor] != open) return false;
+            const char* close = lineStart + quotes[quoteCursor + 1];
+            quoteCursor += 2;
+            out = string_view(p + 1, close - p - 1);
+            p = close + 1;
+            return true;
+        }
+
+        // Slow path: decode escapes into scratch (reserved per line, so views stay valid)
+        size_t offset = scratch.size();
+        const char* q = p + 1;
+        while (q < last && *q != '"') {
+            if (*q != '\\') {
+                scratch.push_back(*q++);
+                continue;
+            }
+            if (++q >= last) return false;
+            switch (*q) {
+            case 'n': scratch.push_back('\n'); break;
+            case 't': scratch.push_back('\t'); break;
+            case 'r': scratch.push_back('\r'); break;
+            case 'b': scratch.push_back('\b'); break;
+            case 'f': scratch.push_back('\f'); break;
+            case 'u':
+                // Non-ASCII code points are not expected in this schema
+                if (last - q < 5) return false;
+                scratch.push_back('?');
+                q += 4;
+                break;
+            default: scratch.push_back(*q); break;
+            }
+            q++;
+        }
+        if (q >= last) return false;
+        out = string_view(scratch.data() + offset, scratch.size() - offset);
+        p = q + 1;
+        return true;
+    }
+
+    // Plain decimals such as 2500 or 37.5 are converted exactly with integer
+    // arithmetic; anything else (exponents, long mantissas) goes to from_chars
+    static bool parseNumber(const char*& p, const char* last, double& out) {
+        static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+            1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+        const char* q = p;
+        bool negative = q < last && *q == '-';
+        if (negative) q++;
+        uint64_t mantissa = 0;
+        int digits = 0, fractionDigits = 0;
+        while (q < last && *q >= '0' && *q <= '9') {
+            mantissa = mantissa * 10 + (*q++ - '0');
+            digits++;
+        }
+        if (q < last && *q == '.') {
+            q++;
+            while (q < last && *q >= '0' && *q <= '9') {
+                mantissa = mantissa * 10 + (*q++ - '0');
+                digits++;
+                fractionDigits++;
+            }
+        }
+        bool simple = digits > 0 && digits <= 15 && (q == last || (*q != 'e' && *q != 'E'));
+        if (simple) {
+            double value = static_cast<double>(mantissa) / powersOfTen[fractionDigits];
+            out = negative ? -value : value;
+            p = q;
+            return true;
+        }
+
+        from_chars_result result = from_chars(p, last, out);
+        if (result.ec != errc() || !isfinite(out)) return false;  // JSON has no nan or inf
+        p = result.ptr;
+        return true;
+    }
+
+    // Skips a value of a field this schema does not use
+    static bool skipValue(const char*& p, const char* last) {
+        int depth = 0;
+        bool inString = false;
+        for (; p < last; p++) {
+            char c = *p;
+            if (inString) {
+                if (c == '\\') p++;
+                else if (c == '"') inString = false;
+                continue;
+            }
+            if (c == '"') inString = true;
+            else if (c == '{' || c == '[') depth++;
+            else if (c == '}' || c == ']') {
+                if (depth == 0) return true;
+                depth--;
+            }
+            else if (c == ',' && depth == 0) return true;
+        }
+        return depth == 0 && !inString;
+    }
+
+    bool parseLine(const char* p, const char* last, ProjectRequest& req) {
+        req = ProjectRequest();
+        indexQuotes(p, last);
+        if (lineHasEscape) {
+            scratch.clear();
+            scratch.reserve(last - p);
+        }
+
+        p = skipSpace(p, last);
+        if (p == last || *p != '{') return false;
+        p = skipSpace(p + 1, last);
+        if (p < last && *p == '}') return true;
+
+        while (p < last) {
+            string_view key, text;
+            if (*p != '"' || !parseString(p, last, key)) return false;
+            p = skipSpace(p, last);
+            if (p == last || *p != ':') return false;
+            p = skipSpace(p + 1, last);
+            if (p == last) return false;
+
+            Field field = lookupField(key);
+            bool ok = true;
+            switch (field) {
+            case FREELANCER_RATE: ok = parseNumber(p, last, req.freelancerRate); break;
+            case AMOUNT: ok = parseNumber(p, last, req.amount); break;
+            case HOURS: ok = parseNumber(p, last, req.hours); break;
+            case UNKNOWN: ok = skipValue(p, last); break;
+            default:
+                ok = *p == '"' && parseString(p, last, text) && !hasControlCharacter(text);
+                switch (field) {
+                case CLIENT_NAME: req.clientName = text; break;
+                case CLIENT_EMAIL: req.clientEmail = text; break;
+                case CLIENT_COMPANY: req.clientCompany = text; break;
+                case FREELANCER_NAME: req.freelancerName = text; break;
+                case FREELANCER_EMAIL: req.freelancerEmail = text; break;
+                case FREELANCER_SKILLS: req.freelancerSkills = text; break;
+                case PROJECT: req.projectName = text; break;
+                case MILESTONE: req.milestoneTitle = text; break;
+                case DESCRIPTION: req.milestoneDesc = text; break;
+                case MILESTONE_TYPE: req.hourly = text.size() == 6 && sameKey(text, "hourly"); break;
+                case PAYMENT: req.escrow = !(text.size() == 6 && sameKey(text, "direct")); break;
+                default: break;
+                }
+            }
+            if (!ok) return false;
+
+            p = skipSpace(p, last);
+            if (p == last) return false;
+            if (*p == '}') return true;
+            if (*p != ',') return false;
+            p = skipSpace(p + 1, last);
+        }
+        return false;
+    }
+
+    // Moves leftover bytes to the front and appends the next chunk of the file
+    bool refill() {
+        if (eof) return false;
+        size_t leftover = end - begin;
+        if (begin > 0 && leftover > 0) memmove(buffer.data(), buffer.data() + begin, leftover);
+        begin = 0;
+        end = leftover;
+        if (buffer.size() - end < CHUNK_SIZE) buffer.resize(end + CHUNK_SIZE);
+        input.read(buffer.data() + end, CHUNK_SIZE);
+        size_t got = static_cast<size_t>(input.gcount());
+        end += got;
+        bytesRead += got;
+        if (got < CHUNK_SIZE) eof = true;
+        return got > 0;
+    }
+
+public:
+    enum Status { OK, MALFORMED, END };
+
+    ProjectRequestParser(const string& fileName)
+        : input(fileName, ios::binary), buffer(CHUNK_SIZE), begin(0), end(0), eof(false),
+        lineNumber(0), bytesRead(0), quoteCount(0), quoteCursor(0), lineHasEscape(false), lineStart(nullptr) {
+    }
+
+    // Parser for requests that arrive in memory (e.g. over a socket) rather than from a file
+    ProjectRequestParser()
+        : buffer(0), begin(0), end(0), eof(true), lineNumber(0), bytesRead(0),
+        quoteCount(0), quoteCursor(0), lineHasEscape(false), lineStart(nullptr) {
+    }
+
+    // Parses a single JSON object; views in req stay valid until the next call
+    bool parse(string_view line, ProjectRequest& req) {
+        return parseLine(line.data(), line.data() + line.size(), req);
+    }
+
+    bool isOpen() const { return input.is_open(); }
+    size_t getLineNumber() const { return lineNumber; }
+    size_t getBytesRead() const { return bytesRead; }
+
+    // Reads the next non-blank line into req
+    Status next(ProjectRequest& req) {
+        while (true) {
+            const char* start = buffer.data() + begin;
+            const char* newline = static_cast<const char*>(memchr(start, '\n', end - begin));
+            if (!newline) {
+                if (refill()) continue;
+                if (begin == end) return END;
+                newline = buffer.data() + end;  // Final line without a newline
+            }
+
+            const char* last = newline;
+            begin = min(end, static_cast<size_t>(newline - buffer.data()) + 1);
+            lineNumber++;
+            if (skipSpace(start, last) == last) continue;
+            return parseLine(start, last, req) ? OK : MALFORMED;
+        }
+    }
+};
+
+// Discards everything written to cout while in scope, so batch runs
+// are not slowed down by per-project console output
+class ConsoleSilencer {
+private:
+    streambuf* previous;
+
+public:
+    ConsoleSilencer() : previous(cout.rdbuf()) {
+        cout.rdbuf(nullptr);
+    }
+
+    ~ConsoleSilencer() {
+        cout.rdbuf(previous);
+        cout.clear();
+    }
+};
+
+// Replays project requests from a JSON Lines file without any prompts.
+// With parseOnly the workflows are not executed, which measures raw parser speed.
+void runBatch(const string& fileName, bool parseOnly) {
+    ProjectRequestParser parser(fileName);
+    if (!parser.isOpen()) {
+        cerr << "Unable to open batch file: " << fileName << endl;
+        return;
+    }
+
+    size_t succeeded = 0, failed = 0;
+    double checksum = 0.0;  // Keeps parse-only runs from being optimized away
+    ProjectRequest req;
+    ProjectRequestParser::Status status;
+    auto start = chrono::steady_clock::now();
+    {
+        ConsoleSilencer silence;
+        while ((status = parser.next(req)) != ProjectRequestParser::END) {
+            if (status == ProjectRequestParser::MALFORMED) {
+                cerr << "Malformed request on line " << parser.getLineNumber() << endl;
+                failed++;
+                continue;
+            }
+            if (parseOnly) {
+                checksum += req.amount + req.hours + req.clientEmail.size();
+                succeeded++;
+                continue;
+            }
+            try {
+                Project* project = buildProject(req, new Logger("payment_receipts.txt"));
+                if (project->executeProjectWorkflow()) succeeded++;
+                else failed++;
+                delete project;
+            }
+            catch (const exception& e) {
+                cerr << "Rejected request: " << e.what() << endl;
+                failed++;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t total = succeeded + failed;
+    cout << "Batch complete: " << total << " requests, " << succeeded << " succeeded, "
+        << failed << " failed in " << seconds << " s";
+    if (seconds > 0) {
+        cout << " (" << static_cast<size_t>(total / seconds) << " projects/s, "
+            << parser.getBytesRead() / seconds / 1e6 << " MB/s)";
+    }
+    cout << endl;
+    if (parseOnly && checksum < 0) cout << checksum << endl;
+}
+
+// Owns every known client and freelancer, keyed by lower-cased email
+class UserDirectory {
+private:
+    unordered_map<string, User*> users;
+    mutable mutex lock;
+
+public:
+    UserDirectory() = default;
+    UserDirectory(const UserDirectory&) = delete;
+    UserDirectory& operator=(const UserDirectory&) = delete;
+
+    ~UserDirectory() {
+        for (auto& entry : users) delete entry.second;
+    }
+
+    static string keyFor(const string& email) {
+        string key = email;
+        for (char& c : key) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        return key;
+    }
+
+    // Takes ownership of user. Returns false (and deletes it) if the email is already taken.
+    bool add(User* user) {
+        string key = keyFor(user->getEmail());
+        lock_guard<mutex> guard(lock);
+        if (!users.emplace(key, user).second) {
+            delete user;
+            return false;
+        }
+        return true;
+    }
+
+    // Adds a batch under one lock acquisition; rejected duplicates are deleted.
+    // Returns how many users were added.
+    size_t addAll(vector<User*>& batch) {
+        vector<string> keys;
+        keys.reserve(batch.size());
+        for (User* user : batch) keys.push_back(keyFor(user->getEmail()));
+
+        size_t added = 0;
+        lock_guard<mutex> guard(lock);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (users.emplace(move(keys[i]), batch[i]).second) added++;
+            else delete batch[i];
+        }
+        batch.clear();
+        return added;
+    }
+
+    User* find(const string& email) const {
+        lock_guard<mutex> guard(lock);
+        auto it = users.find(keyFor(email));
+        return it == users.end() ? nullptr : it->second;
+    }
+
+    void reserve(size_t count) {
+        lock_guard<mutex> guard(lock);
+        users.reserve(count);
+    }
+
+    size_t size() const {
+        lock_guard<mutex> guard(lock);
+        return users.size();
+    }
+
+    // Runs fn on every user while holding the directory lock
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        lock_guard<mutex> guard(lock);
+        for (const auto& entry : users) fn(*entry.second);
+    }
+};
+
+// Basic shape check: one '@', something before it, a dot in the domain, no spaces
+bool isValidEmail(string_view email) {
+    size_t at = email.find('@');
+    if (at == string_view::npos || at == 0 || email.find('@', at + 1) != string_view::npos) return false;
+    string_view domain = email.substr(at + 1);
+    size_t dot = domain.find('.');
+    if (dot == string_view::npos || dot == 0 || dot == domain.size() - 1) return false;
+    return email.find_first_of(" \t,;") == string_view::npos;
+}
+
+// Parallel loader for user CSV files with rows of the form
+//   type,name,email,company_or_skills,hourly_rate
+// where type is "client" or "freelancer". Fields may be double-quoted.
+// The file is split into byte ranges on line boundaries, each thread reads
+// its range in chunks, validates rows and inserts them into the directory.
+class UserCsvImporter {
+public:
+    struct Stats {
+        size_t rows = 0;
+        size_t imported = 0;
+        size_t duplicates = 0;
+        size_t invalidEmail = 0;
+        size_t invalidRate = 0;
+        size_t malformed = 0;
+
+        void add(const Stats& other) {
+            rows += other.rows;
+            imported += other.imported;
+            duplicates += other.duplicates;
+            invalidEmail += other.invalidEmail;
+            invalidRate += other.invalidRate;
+            malformed += other.malformed;
+        }
+    };
+
+private:
+    static constexpr size_t CHUNK_SIZE = 4 << 20;
+    static constexpr size_t MAX_FIELDS = 5;
+    static constexpr size_t BATCH_SIZE = 4096;
+
+    string fileName;
+    UserDirectory& directory;
+    atomic<size_t> bytesDone;
+
+    // Splits one CSV line into fields; quoted fields may contain commas and "" escapes
+    static size_t splitFields(string_view line, string_view* fields, string& unquoted) {
+        size_t count = 0;
+        size_t pos = 0;
+        unquoted.clear();
+        while (count < MAX_FIELDS) {
+            if (pos < line.size() && line[pos] == '"') {
+                size_t start = unquoted.size();
+                pos++;
+                while (pos < line.size()) {
+                    if (line[pos] == '"') {
+                        if (pos + 1 < line.size() && line[pos + 1] == '"') {
+                            unquoted.push_back('"');
+                            pos += 2;
+                            continue;
+                        }
+                        break;
+                    }
+                    unquoted.push_back(line[pos++]);
+                }
+                fields[count++] = string_view(unquoted).substr(start);
+                pos++;  // Closing quote
+            }
+            else {
+                size_t comma = line.find(',', pos);
+                if (comma == string_view::npos) comma = line.size();
+                fields[count++] = line.substr(pos, comma - pos);
+                pos = comma;
+            }
+            if (pos >= line.size() || line[pos] != ',') break;
+            pos++;
+        }
+        return count;
+    }
+
+    void flush(vector<User*>& pending, Stats& stats) {
+        size_t count = pending.size();
+        size_t added = directory.addAll(pending);
+        stats.imported += added;
+        stats.duplicates += count - added;
+    }
+
+    void importLine(string_view line, string& unquoted, vector<User*>& pending, Stats& stats) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line.substr(0, 5) == "type,") return;  // Blank line or header
+        stats.rows++;
+
+        // Quoted fields are decoded into unquoted, so keep its storage stable for this line
+        unquoted.reserve(line.size());
+        string_view fields[MAX_FIELDS];
+        size_t count = splitFields(line, fields, unquoted);
+        if (count < 4) {
+            stats.malformed++;
+            return;
+        }
+        if (!isValidEmail(fields[2])) {
+            stats.invalidEmail++;
+            return;
+        }
+
+        User* user = nullptr;
+        if (fields[0] == "client") {
+            user = new Client(string(fields[1]), string(fields[2]), string(fields[3]));
+        }
+        else if (fields[0] == "freelancer") {
+            double rate = 0.0;
+            if (count < 5) {
+                stats.invalidRate++;
+                return;
+            }
+            from_chars_result result = from_chars(fields[4].data(), fields[4].data() + fields[4].size(), rate);
+            if (result.ec != errc() || result.ptr != fields[4].data() + fields[4].size() || !(rate > 0.0 && rate <= 10000.0)) {
+                stats.invalidRate++;
+                return;
+            }
+            user = new Freelancer(string(fields[1]), string(fields[2]), string(fields[3]), rate);
+        }
+        else {
+            stats.malformed++;
+            return;
+        }
+
+        pending.push_back(user);
+        if (pending.size() >= BATCH_SIZE) flush(pending, stats);
+    }
+
+    // Imports every line that starts inside [rangeStart, rangeEnd)
+    void importRange(size_t rangeStart, size_t rangeEnd, Stats& stats) {
+        vector<User*> pending;
+        pending.reserve(BATCH_SIZE);
+        importRange(rangeStart, rangeEnd, pending, stats);
+        flush(pending, stats);
+    }
+
+    void importRange(size_t rangeStart, size_t rangeEnd, vector<User*>& pending, Stats& stats) {
+        ifstream input(fileName, ios::binary);
+        if (!input.is_open()) return;
+
+        // A line belongs to the range its first byte is in, so unless we start
+        // at the top of the file, skip the partial line owned by the previous range
+        size_t position = rangeStart;
+        if (rangeStart > 0) {
+            input.seekg(static_cast<streamoff>(rangeStart - 1));
+            string skipped;
+            getline(input, skipped);
+            position = rangeStart - 1 + skipped.size() + 1;
+        }
+        bytesDone += position - rangeStart;
+
+        vector<char> buffer(CHUNK_SIZE);
+        string carry, unquoted;
+        input.seekg(static_cast<streamoff>(position));
+        // A line that starts inside the range is read to its end even past rangeEnd
+        while ((position < rangeEnd || (!carry.empty() && position - carry.size() < rangeEnd)) && input) {
+            input.read(buffer.data(), CHUNK_SIZE);
+            size_t got = static_cast<size_t>(input.gcount());
+            if (got == 0) break;
+
+            const char* data = buffer.data();
+            const char* last = data + got;
+            while (data < last) {
+                const char* newline = static_cast<const char*>(memchr(data, '\n', last - data));
+                if (!newline) {
+                    carry.append(data, last);
+                    break;
+                }
+                size_t lineStart = position - carry.size();
+                if (!carry.empty()) {
+                    carry.append(data, newline);
+                    if (lineStart < rangeEnd) importLine(carry, unquoted, pending, stats);
+                    carry.clear();
+                }
+                else if (lineStart < rangeEnd) {
+                    importLine(string_view(data, newline - data), unquoted, pending, stats);
+                }
+                position += newline - data + 1;
+                bytesDone += newline - data + 1;
+                data = newline + 1;
+                if (lineStart >= rangeEnd) return;
+            }
+            position += last - data;
+        }
+        if (!carry.empty() && position - carry.size() < rangeEnd) {
+            importLine(carry, unquoted, pending, stats);
+            bytesDone += carry.size();
+        }
+    }
+
+public:
+    UserCsvImporter(const string& csvFile, UserDirectory& target)
+        : fileName(csvFile), directory(target), bytesDone(0) {
+    }
+
+    // Imports the whole file using threadCount threads, printing progress to cout
+    Stats run(unsigned threadCount) {
+        Stats total;
+        ifstream probe(fileName, ios::binary | ios::ate);
+        if (!probe.is_open()) {
+            throw runtime_error("Unable to open user file: " + fileName);
+        }
+        size_t fileSize = static_cast<size_t>(probe.tellg());
+        probe.close();
+
+        if (threadCount == 0) threadCount = 1;
+        vector<Stats> perThread(threadCount);
+        vector<thread> workers;
+        for (unsigned i = 0; i < threadCount; i++) {
+            size_t rangeStart = fileSize * i / threadCount;
+            size_t rangeEnd = fileSize * (i + 1) / threadCount;
+            workers.emplace_back([this, rangeStart, rangeEnd, &perThread, i]() {
+                importRange(rangeStart, rangeEnd, perThread[i]);
+            });
+        }
+
+        // Progress is sampled from the shared byte counter while workers run
+        atomic<bool> finished(false);
+        thread progress([this, fileSize, &finished]() {
+            while (!finished) {
+                this_thread::sleep_for(chrono::milliseconds(500));
+                if (finished || fileSize == 0) break;
+                cout << "  Imported " << (100 * bytesDone / fileSize) << "% ("
+                    << bytesDone / (1 << 20) << " MB)" << endl;
+            }
+        });
+
+        for (thread& worker : workers) worker.join();
+        finished = true;
+        progress.join();
+
+        for (const Stats& stats : perThread) total.add(stats);
+        return total;
+    }
+};
+
+// Writes a synthetic user CSV with a sprinkling of duplicate and invalid rows
+void generateUserCsv(const string& fileName, size_t rows) {
+    ofstream out(fileName, ios::binary);
+    if (!out.is_open()) {
+        throw runtime_error("Unable to create user file: " + fileName);
+    }
+    const char* skills[] = { "C++ Development", "\"Web Design, JavaScript\"", "Python", "SQL", "Testing" };
+    mt19937 rng(7);
+    string line;
+    out << "type,name,email,company_or_skills,hourly_rate\n";
+    for (size_t i = 0; i < rows; i++) {
+        size_t id = (i % 100 == 99) ? i - 1 : i;  // 1% duplicate emails
+        line.clear();
+        if (i % 3 == 0) {
+            line += "client,Client " + to_string(id) + ",client" + to_string(id) + "@company.com,Company " + to_string(id % 1000);
+        }
+        else {
+            int rate = (i % 500 == 1) ? -5 : 15 + static_cast<int>(rng() % 135);  // A few invalid rates
+            line += "freelancer,Freelancer " + to_string(id) + ",dev" + to_string(id) + "@freelance.com,";
+            line += skills[rng() % 5];
+            line += "," + to_string(rate);
+        }
+        if (i % 1000 == 7) line += ",extra";  // Extra columns are ignored
+        line += '\n';
+        out << line;
+    }
+}
+
+void runUserImport(const string& fileName, unsigned threadCount) {
+    UserDirectory directory;
+    UserCsvImporter importer(fileName, directory);
+    cout << "Importing users from " << fileName << " with " << threadCount << " thread(s)..." << endl;
+
+    auto start = chrono::steady_clock::now();
+    UserCsvImporter::Stats stats;
+    try {
+        stats = importer.run(threadCount);
+    }
+    catch (const exception& e) {
+        cerr << "Import failed: " << e.what() << endl;
+        return;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Import complete in " << seconds << " s";
+    if (seconds > 0) cout << " (" << static_cast<size_t>(stats.rows / seconds) << " rows/s)";
+    cout << endl;
+    cout << "  Rows: " << stats.rows << ", imported: " << stats.imported
+        << ", duplicates: " << stats.duplicates << endl;
+    cout << "  Rejected - invalid email: " << stats.invalidEmail << ", invalid rate: " << stats.invalidRate
+        << ", malformed: " << stats.malformed << endl;
+    cout << "  Directory size: " << directory.size() << endl;
+}
+
+// Interns strings as dense ids so a column holds small integers instead of text
+class StringDictionary {
+private:
+    unordered_map<string, uint32_t> ids;
+    vector<string> values;
+
+public:
+    uint32_t intern(string_view value) {
+        string key(value);
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(values.size());
+        ids.emplace(key, id);
+        values.push_back(key);
+        return id;
+    }
+
+    bool find(string_view value, uint32_t& id) const {
+        auto it = ids.find(string(value));
+        if (it == ids.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    const string& lookup(uint32_t id) const { return values[id]; }
+    size_t size() const { return values.size(); }
+};
+
+enum ReceiptDimension {
+    GROUP_BY_CLIENT,
+    GROUP_BY_FREELANCER,
+    GROUP_BY_PAYMENT_TYPE
+};
+
+struct GroupTotal {
+    string key;
+    int64_t cents = 0;
+    uint64_t receipts = 0;
+};
+
+// Formats cents as dollars, e.g. 123456 -> "1234.56"
+string formatCents(int64_t cents) {
+    char text[32];
+    uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+    snprintf(text, sizeof(text), "%s%llu.%02llu", cents < 0 ? "-" : "",
+        static_cast<unsigned long long>(magnitude / 100), static_cast<unsigned long long>(magnitude % 100));
+    return text;
+}
+
+// Raw view of the receipt columns, valid while ReceiptStore::read holds the store
+struct ReceiptColumns {
+    size_t rows = 0;
+    const uint32_t* clients = nullptr;
+    const uint32_t* freelancers = nullptr;
+    const uint8_t* types = nullptr;
+    const uint32_t* milestones = nullptr;
+    const int64_t* amounts = nullptr;  // Cents
+    const int64_t* times = nullptr;    // Seconds since the epoch
+    bool timeOrdered = false;
+    const StringDictionary* clientNames = nullptr;
+    const StringDictionary* freelancerNames = nullptr;
+    const StringDictionary* typeNames = nullptr;
+    const StringDictionary* milestoneNames = nullptr;
+};
+
+// In-memory column store of payment receipts for finance queries. Each receipt
+// is one row across parallel columns: dictionary ids for client, freelancer,
+// payment type and milestone title, the amount in cents and the epoch
+// timestamp. Queries scan only the columns they need in cache-sized blocks:
+// the period filter is computed branch-free into a mask the compiler
+// vectorizes, then masked amounts are summed per group. Large scans are split
+// across threads with private partial sums. Receipts normally arrive in time
+// order, in which case a period query binary-searches its row range instead of
+// scanning the whole year. Parties are keyed by email, or by name for receipts
+// without one.
+class ReceiptStore : public ReceiptListener {
+private:
+    static constexpr size_t BLOCK = 1024;  // Rows per filter pass, sized to stay in L1
+
+    // Sum and count side by side so each row touches one cache line of the group table
+    struct GroupAccumulator {
+        int64_t cents;
+        uint64_t receipts;
+    };
+
+    StringDictionary clients;
+    StringDictionary freelancers;
+    StringDictionary paymentTypes;
+    StringDictionary milestones;
+    vector<uint32_t> clientColumn;
+    vector<uint32_t> freelancerColumn;
+    vector<uint8_t> typeColumn;
+    vector<uint32_t> milestoneColumn;
+    vector<int64_t> amountColumn;  // Cents
+    vector<int64_t> timeColumn;    // Seconds since the epoch
+    bool timeOrdered = true;       // Whether timeColumn is non-decreasing
+    mutable mutex lock;
+
+    static string_view partyKey(string_view name, string_view email) {
+        if (!email.empty()) return email;
+        if (!name.empty()) return name;
+        return "(unknown)";
+    }
+
+    uint8_t internPaymentType(string_view type) {
+        uint32_t id = paymentTypes.intern(type);
+        if (id > numeric_limits<uint8_t>::max()) throw runtime_error("Too many payment types for the receipt store");
+        return static_cast<uint8_t>(id);
+    }
+
+    void appendRow(uint32_t client, uint32_t freelancer, uint8_t type, uint32_t milestone, int64_t cents,
+        int64_t timestamp) {
+        if (!timeColumn.empty() && timestamp < timeColumn.back()) timeOrdered = false;
+        clientColumn.push_back(client);
+        freelancerColumn.push_back(freelancer);
+        typeColumn.push_back(type);
+        milestoneColumn.push_back(milestone);
+        amountColumn.push_back(cents);
+        timeColumn.push_back(timestamp);
+    }
+
+    // Adds the amounts of rows in [begin, end) with from <= time < to into sums[key]
+    template <typename Key>
+    static void sumRange(const Key* keys, const int64_t* amounts, const int64_t* times, size_t begin, size_t end,
+        int64_t from, int64_t to, GroupAccumulator* groups) {
+        int64_t selected[BLOCK];
+        for (size_t blockStart = begin; blockStart < end; blockStart += BLOCK) {
+            size_t rows = min(BLOCK, end - blockStart);
+            const int64_t* blockTimes = times + blockStart;
+            for (size_t j = 0; j < rows; j++) {
+                selected[j] = -static_cast<int64_t>((blockTimes[j] >= from) & (blockTimes[j] < to));  // 0 or all ones
+            }
+            const Key* blockKeys = keys + blockStart;
+            const int64_t* blockAmounts = amounts + blockStart;
+            for (size_t j = 0; j < rows; j++) {
+                GroupAccumulator& group = groups[blockKeys[j]];
+                group.cents += blockAmounts[j] & selected[j];
+                group.receipts += static_cast<uint64_t>(selected[j]) & 1;
+            }
+        }
+    }
+
+    template <typename Key>
+    vector<GroupTotal> groupSum(const vector<Key>& keys, const StringDictionary& names, int64_t from, int64_t to,
+        unsigned threads) const {
+        size_t first = 0;
+        size_t last = keys.size();
+        if (timeOrdered) {
+            first = lower_bound(timeColumn.begin(), timeColumn.end(), from) - timeColumn.begin();
+            last = max(first, static_cast<size_t>(lower_bound(timeColumn.begin(), timeColumn.end(), to) - timeColumn.begin()));
+        }
+        size_t rows = last - first;
+        size_t groups = names.size();
+        threads = static_cast<unsigned>(max<size_t>(1, min<size_t>(threads, rows / (BLOCK * 64) + 1)));
+
+        vector<vector<GroupAccumulator>> partials(threads, vector<GroupAccumulator>(groups, GroupAccumulator{0, 0}));
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            size_t begin = first + rows * t / threads;
+            size_t end = first + rows * (t + 1) / threads;
+            auto work = [&, t, begin, end]() {
+                sumRange(keys.data(), amountColumn.data(), timeColumn.data(), begin, end, from, to, partials[t].data());
+            };
+            if (t + 1 == threads) work();  // The calling thread takes the last range
+            else workers.emplace_back(work);
+        }
+        for (thread& worker : workers) worker.join();
+
+        vector<GroupTotal> totals;
+        for (size_t g = 0; g < groups; g++) {
+            GroupTotal total;
+            for (unsigned t = 0; t < threads; t++) {
+                total.cents += partials[t][g].cents;
+                total.receipts += partials[t][g].receipts;
+            }
+            if (total.receipts == 0) continue;
+            total.key = names.lookup(static_cast<uint32_t>(g));
+            totals.push_back(total);
+        }
+        sort(totals.begin(), totals.end(), [](const GroupTotal& a, const GroupTotal& b) { return a.cents > b.cents; });
+        return totals;
+    }
+
+    // Parses "Jan 14 2026 11:50:53" (also __DATE__ style "Jan  4 2026") as local time
+    static bool parseTimestamp(const string& text, int64_t& timestamp) {
+        static const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+        char month[4] = {};
+        tm fields = {};
+        if (sscanf(text.c_str(), "%3s %d %d %d:%d:%d", month, &fields.tm_mday, &fields.tm_year,
+            &fields.tm_hour, &fields.tm_min, &fields.tm_sec) != 6) {
+            return false;
+        }
+        fields.tm_mon = -1;
+        for (int m = 0; m < 12; m++) {
+            if (strcmp(month, months[m]) == 0) fields.tm_mon = m;
+        }
+        if (fields.tm_mon < 0) return false;
+        fields.tm_year -= 1900;
+        fields.tm_isdst = -1;
+        timestamp = static_cast<int64_t>(mktime(&fields));
+        return true;
+    }
+
+public:
+    ReceiptStore() {}
+    ReceiptStore(const ReceiptStore&) = delete;
+    ReceiptStore& operator=(const ReceiptStore&) = delete;
+
+    size_t size() const {
+        lock_guard<mutex> guard(lock);
+        return amountColumn.size();
+    }
+
+    void reserve(size_t rows) {
+        lock_guard<mutex> guard(lock);
+        clientColumn.reserve(rows);
+        freelancerColumn.reserve(rows);
+        typeColumn.reserve(rows);
+        milestoneColumn.reserve(rows);
+        amountColumn.reserve(rows);
+        timeColumn.reserve(rows);
+    }
+
+    void append(string_view client, string_view freelancer, string_view paymentType, string_view milestone,
+        int64_t cents, int64_t timestamp) {
+        lock_guard<mutex> guard(lock);
+        appendRow(clients.intern(client), freelancers.intern(freelancer), internPaymentType(paymentType),
+            milestones.intern(milestone), cents, timestamp);
+    }
+
+    void onPaymentReceipt(const PaymentRecord& record) override {
+        append(partyKey(record.clientName, record.clientEmail), partyKey(record.freelancerName, record.freelancerEmail),
+            record.paymentType, record.milestoneTitle, llround(record.amount * 100.0),
+            static_cast<int64_t>(record.timestamp));
+    }
+
+    // Loads every receipt in a payment_receipts.txt style log and returns how many were
+    // read; a missing file loads nothing. Receipts written before participants were
+    // logged are attributed to "(unknown)".
+    size_t loadReceiptFile(const string& fileName) {
+        ifstream in(fileName);
+        if (!in.is_open()) return 0;
+
+        size_t loaded = 0;
+        string line, client, freelancer, paymentType, milestone;
+        double amount = 0.0;
+        int64_t timestamp = 0;
+        bool inReceipt = false;
+        while (getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line == "=== PAYMENT RECEIPT ===") {
+                inReceipt = true;
+                client = freelancer = paymentType = milestone = "";
+                amount = 0.0;
+                timestamp = 0;
+                continue;
+            }
+            if (!inReceipt) continue;
+
+            string_view text = line;
+            size_t colon = text.find(": ");
+            string_view value = colon == string_view::npos ? string_view() : text.substr(colon + 2);
+            string_view label = text.substr(0, colon);
+            if (label == "Client" || label == "Freelancer") {
+                size_t open = value.rfind('<');
+                string key(value.substr(0, open == string_view::npos ? value.size() : open));
+                if (open != string_view::npos && value.back() == '>') {
+                    key = string(value.substr(open + 1, value.size() - open - 2));
+                }
+                while (!key.empty() && key.back() == ' ') key.pop_back();
+                (label == "Client" ? client : freelancer) = key;
+            }
+            else if (label == "Amount") {
+                if (!value.empty() && value.front() == '$') value.remove_prefix(1);
+                amount = strtod(string(value).c_str(), nullptr);
+            }
+            else if (label == "Payment Type") {
+                paymentType = string(value);
+            }
+            else if (label == "Milestone") {
+                milestone = string(value);
+            }
+            else if (label == "Timestamp") {
+                parseTimestamp(string(value), timestamp);
+            }
+            else if (!text.empty() && text.find_first_not_of('=') == string_view::npos) {
+                inReceipt = false;
+                if (paymentType == ESCROW_REFUND_TYPE) continue;
+                append(partyKey("", client), partyKey("", freelancer), paymentType, milestone, llround(amount * 100.0),
+                    timestamp);
+                loaded++;
+            }
+        }
+        return loaded;
+    }
+
+    // Fills the store with synthetic receipts spread evenly over [start, end), for benchmarks
+    void generateSynthetic(size_t rows, size_t clientCount, size_t freelancerCount, int64_t start, int64_t end,
+        uint64_t seed) {
+        lock_guard<mutex> guard(lock);
+        size_t firstClient = clients.size();
+        size_t firstFreelancer = freelancers.size();
+        for (size_t i = 0; i < clientCount; i++) clients.intern("client" + to_string(i) + "@example.com");
+        for (size_t i = 0; i < freelancerCount; i++) freelancers.intern("freelancer" + to_string(i) + "@example.com");
+        uint8_t escrow = internPaymentType("Escrow");
+        uint8_t direct = internPaymentType("Direct");
+        const char* const titles[] = {"Website", "Website Redesign", "Mobile App", "Logo Design", "API Integration",
+            "Data Migration", "Marketing Copy", "Security Audit"};
+        uint32_t titleIds[8];
+        for (int t = 0; t < 8; t++) titleIds[t] = milestones.intern(titles[t]);
+
+        mt19937_64 random(seed);
+        int64_t span = max<int64_t>(1, end - start);
+        for (size_t i = 0; i < rows; i++) {
+            uint64_t bits = random();
+            appendRow(static_cast<uint32_t>(firstClient + bits % clientCount),
+                static_cast<uint32_t>(firstFreelancer + (bits >> 20) % freelancerCount),
+                (bits >> 40) & 1 ? escrow : direct, titleIds[(bits >> 61) & 7],
+                static_cast<int64_t>(5000 + (bits >> 41) % 500000),
+                start + static_cast<int64_t>(i * span / rows));
+        }
+    }
+
+    // Calls reader(columns) with a view of every column and dictionary while appends
+    // are held off, and returns what the reader returns
+    template <typename Reader>
+    auto read(Reader reader) const {
+        lock_guard<mutex> guard(lock);
+        ReceiptColumns columns;
+        columns.rows = amountColumn.size();
+        columns.clients = clientColumn.data();
+        columns.freelancers = freelancerColumn.data();
+        columns.types = typeColumn.data();
+        columns.milestones = milestoneColumn.data();
+        columns.amounts = amountColumn.data();
+        columns.times = timeColumn.data();
+        columns.timeOrdered = timeOrdered;
+        columns.clientNames = &clients;
+        columns.freelancerNames = &freelancers;
+        columns.typeNames = &paymentTypes;
+        columns.milestoneNames = &milestones;
+        return reader(columns);
+    }
+
+    // Hands the dictionaries to prepare(clients, freelancers, paymentTypes), then calls
+    // visit(worker, client, freelancer, type, cents, timestamp) for every row, split into
+    // one contiguous range per worker thread. Appends wait until the scan finishes.
+    template <typename Prepare, typename Visitor>
+    void parallelScan(unsigned threads, Prepare prepare, Visitor visit) const {
+        lock_guard<mutex> guard(lock);
+        prepare(clients, freelancers, paymentTypes);
+        size_t rows = amountColumn.size();
+        threads = static_cast<unsigned>(max<size_t>(1, min<size_t>(threads, rows / (BLOCK * 64) + 1)));
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            size_t begin = rows * t / threads;
+            size_t end = rows * (t + 1) / threads;
+            auto work = [&, t, begin, end]() {
+                for (size_t i = begin; i < end; i++) {
+                    visit(t, clientColumn[i], freelancerColumn[i], typeColumn[i], amountColumn[i], timeColumn[i]);
+                }
+            };
+            if (t + 1 == threads) work();
+            else workers.emplace_back(work);
+        }
+        for (thread& worker : workers) worker.join();
+    }
+
+    // Sum of amounts and receipt count per group for receipts with from <= timestamp < to,
+    // largest total first
+    vector<GroupTotal> sumBy(ReceiptDimension dimension, int64_t from, int64_t to,
+        unsigned threads = thread::hardware_concurrency()) const {
+        lock_guard<mutex> guard(lock);
+        switch (dimension) {
+        case GROUP_BY_CLIENT:
+            return groupSum(clientColumn, clients, from, to, threads);
+        case GROUP_BY_FREELANCER:
+            return groupSum(freelancerColumn, freelancers, from, to, threads);
+        default:
+            return groupSum(typeColumn, paymentTypes, from, to, threads);
+        }
+    }
+};
+
+enum RollupGranularity {
+    ROLLUP_HOUR,
+    ROLLUP_DAY,
+    ROLLUP_MONTH,
+    ROLLUP_GRANULARITY_COUNT
+};
+
+const char* const rollupGranularityNames[ROLLUP_GRANULARITY_COUNT] = {"hour", "day", "month"};
+
+// Which dimensions a rollup table is keyed by; every combination a query can
+// filter on has its own table so a query costs one lookup per bucket
+enum RollupView {
+    VIEW_ALL,
+    VIEW_CLIENT,
+    VIEW_FREELANCER,
+    VIEW_TYPE,
+    VIEW_CLIENT_TYPE,
+    VIEW_FREELANCER_TYPE,
+    VIEW_CLIENT_FREELANCER_TYPE,
+    VIEW_COUNT
+};
+
+struct RollupTotals {
+    int64_t cents = 0;
+    uint64_t receipts = 0;
+};
+
+// Restricts a rollup query; empty fields match everything
+struct RollupFilter {
+    string_view client;
+    string_view freelancer;
+    string_view paymentType;
+};
+
+struct RollupPoint {
+    int64_t bucketStart;  // Epoch seconds (UTC) where the bucket begins
+    RollupTotals totals;
+};
+
+// Open-addressing map from a packed rollup key to its totals, 24 bytes per slot
+// with no per-entry allocation. A slot with no receipts is empty, since every
+// stored cell counts at least one.
+class RollupTable {
+private:
+    struct Slot {
+        uint64_t key;
+        RollupTotals totals;
+    };
+
+    vector<Slot> slots;  // Capacity is zero or a power of two
+    size_t used = 0;
+
+    size_t home(uint64_t key) const {
+        uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash ^ (hash >> 32)) & (slots.size() - 1);
+    }
+
+    void grow() {
+        vector<Slot> old(slots.size() ? slots.size() * 2 : 4, Slot{0, RollupTotals()});
+        old.swap(slots);
+        used = 0;
+        for (const Slot& slot : old) {
+            if (slot.totals.receipts) add(slot.key, slot.totals.cents, slot.totals.receipts);
+        }
+    }
+
+public:
+    void add(uint64_t key, int64_t cents, uint64_t receipts) {
+        if ((used + 1) * 10 > slots.size() * 7) grow();  // Load factor at most 0.7
+        for (size_t i = home(key);; i = (i + 1) & (slots.size() - 1)) {
+            Slot& slot = slots[i];
+            if (slot.totals.receipts == 0) {
+                slot.key = key;
+                used++;
+            }
+            else if (slot.key != key) continue;
+            slot.totals.cents += cents;
+            slot.totals.receipts += receipts;
+            return;
+        }
+    }
+
+    const RollupTotals* find(uint64_t key) const {
+        if (slots.empty()) return nullptr;
+        for (size_t i = home(key);; i = (i + 1) & (slots.size() - 1)) {
+            const Slot& slot = slots[i];
+            if (slot.totals.receipts == 0) return nullptr;
+            if (slot.key == key) return &slot.totals;
+        }
+    }
+
+    size_t size() const { return used; }
+
+    template <typename Visitor>
+    void forEach(Visitor visit) const {
+        for (const Slot& slot : slots) {
+            if (slot.totals.receipts) visit(slot.key, slot.totals);
+        }
+    }
+};
+
+// Payment totals per hour, day and month (UTC) for every combination of client,
+// freelancer and payment type, updated as each receipt is logged. Each bucket
+// keeps one flat RollupTable per RollupView keyed by packed ids (28 bits per
+// party, 8 for the payment type), so a query walks the buckets in its range and
+// does one lookup in each. rebuild() recomputes everything from a ReceiptStore, with
+// each thread rolling up its share of the rows before the partials are merged.
+class RollupStore : public ReceiptListener {
+private:
+    static constexpr uint32_t MAX_PARTY_ID = (1u << 28) - 1;
+
+    struct Bucket {
+        RollupTable views[VIEW_COUNT];
+    };
+
+    typedef map<int64_t, Bucket> BucketSeries;
+
+    StringDictionary clients;
+    StringDictionary freelancers;
+    StringDictionary paymentTypes;
+    BucketSeries series[ROLLUP_GRANULARITY_COUNT];
+    mutable mutex lock;
+
+    static int64_t floorDiv(int64_t value, int64_t divisor) {
+        int64_t quotient = value / divisor;
+        return quotient - ((value % divisor) < 0 ? 1 : 0);
+    }
+
+    // Days since 1970-01-01 to year*12 + month-1 and back (proleptic Gregorian)
+    static int64_t monthIndex(int64_t days) {
+        days += 719468;
+        int64_t era = floorDiv(days, 146097);
+        int64_t dayOfEra = days - era * 146097;
+        int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int64_t shiftedMonth = (5 * dayOfYear + 2) / 153;  // March = 0
+        int64_t month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+        int64_t year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+        return year * 12 + month - 1;
+    }
+
+    static int64_t daysFromMonthIndex(int64_t index) {
+        int64_t year = floorDiv(index, 12);
+        int64_t month = index - year * 12 + 1;
+        year -= month <= 2 ? 1 : 0;
+        int64_t era = floorDiv(year, 400);
+        int64_t yearOfEra = year - era * 400;
+        int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5;
+        int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    static int64_t bucketOf(RollupGranularity granularity, int64_t timestamp) {
+        switch (granularity) {
+        case ROLLUP_HOUR:
+            return floorDiv(timestamp, 3600);
+        case ROLLUP_DAY:
+            return floorDiv(timestamp, 86400);
+        default:
+            return monthIndex(floorDiv(timestamp, 86400));
+        }
+    }
+
+    static int64_t bucketStart(RollupGranularity granularity, int64_t bucket) {
+        switch (granularity) {
+        case ROLLUP_HOUR:
+            return bucket * 3600;
+        case ROLLUP_DAY:
+            return bucket * 86400;
+        default:
+            return daysFromMonthIndex(bucket) * 86400;
+        }
+    }
+
+    static uint64_t viewKey(RollupView view, uint32_t client, uint32_t freelancer, uint8_t type) {
+        switch (view) {
+        case VIEW_CLIENT:
+            return client;
+        case VIEW_FREELANCER:
+            return freelancer;
+        case VIEW_TYPE:
+            return type;
+        case VIEW_CLIENT_TYPE:
+            return static_cast<uint64_t>(client) << 8 | type;
+        case VIEW_FREELANCER_TYPE:
+            return static_cast<uint64_t>(freelancer) << 8 | type;
+        case VIEW_CLIENT_FREELANCER_TYPE:
+            return static_cast<uint64_t>(client) << 36 | static_cast<uint64_t>(freelancer) << 8 | type;
+        default:
+            return 0;
+        }
+    }
+
+    static uint32_t internParty(StringDictionary& dictionary, string_view party) {
+        uint32_t id = dictionary.intern(party);
+        if (id > MAX_PARTY_ID) throw runtime_error("Too many distinct parties for the rollup tables");
+        return id;
+    }
+
+    static uint8_t internType(StringDictionary& dictionary, string_view type) {
+        uint32_t id = dictionary.intern(type);
+        if (id > numeric_limits<uint8_t>::max()) throw runtime_error("Too many payment types for the rollup tables");
+        return static_cast<uint8_t>(id);
+    }
+
+    static void addRow(BucketSeries* target, uint32_t client, uint32_t freelancer, uint8_t type, int64_t cents,
+        int64_t timestamp) {
+        for (int g = 0; g < ROLLUP_GRANULARITY_COUNT; g++) {
+            Bucket& bucket = target[g][bucketOf(static_cast<RollupGranularity>(g), timestamp)];
+            for (int view = 0; view < VIEW_COUNT; view++) {
+                bucket.views[view].add(viewKey(static_cast<RollupView>(view), client, freelancer, type), cents, 1);
+            }
+        }
+    }
+
+    // Adds partial into target, taking partial's tables outright where target has none
+    static void mergeInto(BucketSeries* target, BucketSeries* partial) {
+        for (int g = 0; g < ROLLUP_GRANULARITY_COUNT; g++) {
+            if (target[g].empty()) {
+                target[g].swap(partial[g]);
+                continue;
+            }
+            for (const auto& entry : partial[g]) {
+                Bucket& bucket = target[g][entry.first];
+                for (int view = 0; view < VIEW_COUNT; view++) {
+                    RollupTable& table = bucket.views[view];
+                    entry.second.views[view].forEach([&table](uint64_t key, const RollupTotals& totals) {
+                        table.add(key, totals.cents, totals.receipts);
+                    });
+                }
+            }
+        }
+    }
+
+    // Resolves a filter to a table and the keys to add up in it; false when a
+    // named party or type has never been seen, so nothing can match
+    bool resolve(const RollupFilter& filter, RollupView& view, vector<uint64_t>& keys) const {
+        uint32_t client = 0, freelancer = 0;
+        uint8_t type = 0;
+        bool byClient = !filter.client.empty(), byFreelancer = !filter.freelancer.empty();
+        bool byType = !filter.paymentType.empty();
+        if (byClient && !clients.find(filter.client, client)) return false;
+        if (byFreelancer && !freelancers.find(filter.freelancer, freelancer)) return false;
+        if (byType) {
+            uint32_t typeId = 0;
+            if (!paymentTypes.find(filter.paymentType, typeId)) return false;
+            type = static_cast<uint8_t>(typeId);
+        }
+
+        keys.clear();
+        if (byClient && byFreelancer) {
+            // No client x freelancer table: add up the few per-type cells instead
+            view = VIEW_CLIENT_FREELANCER_TYPE;
+            for (uint32_t t = 0; t < paymentTypes.size(); t++) {
+                if (!byType || t == type) keys.push_back(viewKey(view, client, freelancer, static_cast<uint8_t>(t)));
+            }
+            return true;
+        }
+        if (byClient) view = byType ? VIEW_CLIENT_TYPE : VIEW_CLIENT;
+        else if (byFreelancer) view = byType ? VIEW_FREELANCER_TYPE : VIEW_FREELANCER;
+        else view = byType ? VIEW_TYPE : VIEW_ALL;
+        keys.push_back(viewKey(view, client, freelancer, type));
+        return true;
+    }
+
+public:
+    RollupStore() {}
+    RollupStore(const RollupStore&) = delete;
+    RollupStore& operator=(const RollupStore&) = delete;
+
+    void onPaymentReceipt(const PaymentRecord& record) override {
+        string_view client = !record.clientEmail.empty() ? record.clientEmail
+            : !record.clientName.empty() ? record.clientName : string_view("(unknown)");
+        string_view freelancer = !record.freelancerEmail.empty() ? record.freelancerEmail
+            : !record.freelancerName.empty() ? record.freelancerName : string_view("(unknown)");
+        lock_guard<mutex> guard(lock);
+        addRow(series, internParty(clients, client), internParty(freelancers, freelancer),
+            internType(paymentTypes, record.paymentType), llround(record.amount * 100.0),
+            static_cast<int64_t>(record.timestamp));
+    }
+
+    // Replaces every rollup with one recomputed from the ledger's rows
+    void rebuild(const ReceiptStore& ledger, unsigned threads = thread::hardware_concurrency()) {
+        threads = max(1u, threads);
+        vector<BucketSeries*> partials;
+        for (unsigned t = 0; t < threads; t++) partials.push_back(new BucketSeries[ROLLUP_GRANULARITY_COUNT]);
+
+        lock_guard<mutex> guard(lock);
+        try {
+            ledger.parallelScan(threads,
+                [this](const StringDictionary& ledgerClients, const StringDictionary& ledgerFreelancers,
+                    const StringDictionary& ledgerTypes) {
+                    // Same ids as the ledger, so rows need no translation
+                    clients = ledgerClients;
+                    freelancers = ledgerFreelancers;
+                    paymentTypes = ledgerTypes;
+                    if (clients.size() > MAX_PARTY_ID + 1 || freelancers.size() > MAX_PARTY_ID + 1) {
+                        throw runtime_error("Too many distinct parties for the rollup tables");
+                    }
+                },
+                [&partials](unsigned worker, uint32_t client, uint32_t freelancer, uint8_t type, int64_t cents,
+                    int64_t timestamp) {
+                    addRow(partials[worker], client, freelancer, type, cents, timestamp);
+                });
+        }
+        catch (...) {
+            for (BucketSeries* partial : partials) delete[] partial;
+            throw;
+        }
+
+        for (int g = 0; g < ROLLUP_GRANULARITY_COUNT; g++) series[g].clear();
+        for (BucketSeries* partial : partials) {
+            mergeInto(series, partial);
+            delete[] partial;
+        }
+    }
+
+    // Totals per bucket for every bucket overlapping [from, to), oldest first.
+    // Buckets with no matching receipts are omitted.
+    vector<RollupPoint> query(RollupGranularity granularity, int64_t from, int64_t to, const RollupFilter& filter) const {
+        vector<RollupPoint> points;
+        if (from >= to) return points;
+        lock_guard<mutex> guard(lock);
+        RollupView view;
+        vector<uint64_t> keys;
+        if (!resolve(filter, view, keys)) return points;
+
+        const BucketSeries& buckets = series[granularity];
+        auto end = buckets.upper_bound(bucketOf(granularity, to - 1));
+        for (auto it = buckets.lower_bound(bucketOf(granularity, from)); it != end; ++it) {
+            RollupPoint point;
+            point.bucketStart = bucketStart(granularity, it->first);
+            for (uint64_t key : keys) {
+                if (const RollupTotals* cell = it->second.views[view].find(key)) {
+                    point.totals.cents += cell->cents;
+                    point.totals.receipts += cell->receipts;
+                }
+            }
+            if (point.totals.receipts > 0) points.push_back(point);
+        }
+        return points;
+    }
+
+    // Number of buckets and table cells held, as a measure of rollup size
+    void footprint(size_t& buckets, size_t& cells) const {
+        lock_guard<mutex> guard(lock);
+        buckets = cells = 0;
+        for (const BucketSeries& granularity : series) {
+            buckets += granularity.size();
+            for (const auto& entry : granularity) {
+                for (const auto& view : entry.second.views) cells += view.size();
+            }
+        }
+    }
+};
+
+// Weighted Space-Saving summary (Metwally et al.): tracks at most capacity keys.
+// An untracked key takes over the smallest counter and inherits its count as
+// error, so any key whose true total exceeds total / capacity is guaranteed to
+// be tracked, and counts are exact while there are no more keys than counters.
+class SpaceSaving {
+public:
+    struct Counter {
+        string key;
+        int64_t count;  // Overestimates the true total by at most error
+        int64_t error;
+    };
+
+private:
+    size_t capacity;
+    vector<Counter> heap;  // Min-heap on count, so the eviction victim is heap[0]
+    unordered_map<string, size_t> positions;
+
+    void siftUp(size_t i) {
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+            size_t parent = (i - 1) / 2;
+            swap(heap[i], heap[parent]);
+            positions[heap[i].key] = i;
+            positions[heap[parent].key] = parent;
+            i = parent;
+        }
+    }
+
+    // Counts only grow, so an updated counter can only move down the heap
+    void siftDown(size_t i) {
+        while (true) {
+            size_t smallest = i;
+            size_t left = 2 * i + 1, right = left + 1;
+            if (left < heap.size() && heap[left].count < heap[smallest].count) smallest = left;
+            if (right < heap.size() && heap[right].count < heap[smallest].count) smallest = right;
+            if (smallest == i) return;
+            swap(heap[i], heap[smallest]);
+            positions[heap[i].key] = i;
+            positions[heap[smallest].key] = smallest;
+            i = smallest;
+        }
+    }
+
+public:
+    explicit SpaceSaving(size_t counters) : capacity(max<size_t>(1, counters)) {
+        heap.reserve(capacity);
+        positions.reserve(capacity);
+    }
+
+    void add(string_view key, int64_t weight) {
+        string name(key);
+        auto it = positions.find(name);
+        if (it != positions.end()) {
+            heap[it->second].count += weight;
+            siftDown(it->second);
+            return;
+        }
+        if (heap.size() < capacity) {
+            heap.push_back(Counter{name, weight, 0});
+            positions[name] = heap.size() - 1;
+            siftUp(heap.size() - 1);
+            return;
+        }
+        Counter& victim = heap[0];
+        positions.erase(victim.key);
+        victim.error = victim.count;
+        victim.count += weight;
+        victim.key = name;
+        positions[victim.key] = 0;
+        siftDown(0);
+    }
+
+    // The n largest counters, largest first
+    vector<Counter> top(size_t n) const {
+        vector<Counter> result(heap);
+        n = min(n, result.size());
+        partial_sort(result.begin(), result.begin() + n, result.end(),
+            [](const Counter& a, const Counter& b) { return a.count > b.count; });
+        result.resize(n);
+        return result;
+    }
+
+    void clear() {
+        heap.clear();
+        positions.clear();
+    }
+};
+
+// Count-min sketch: depth rows of width counters. Estimates never undercount and
+// overcount by at most 2 * total / width with probability 1 - 2^-depth.
+class CountMinSketch {
+private:
+    static constexpr size_t DEPTH = 4;
+    static constexpr size_t WIDTH = 4096;  // Power of two
+
+    vector<int64_t> counters;
+
+    static size_t slot(uint64_t hash, size_t row) {
+        uint64_t mixed = (hash + row * 0x9E3779B97F4A7C15ull) * 0xBF58476D1CE4E5B9ull;
+        return row * WIDTH + static_cast<size_t>((mixed ^ (mixed >> 31)) & (WIDTH - 1));
+    }
+
+public:
+    CountMinSketch() : counters(DEPTH * WIDTH, 0) {}
+
+    void add(string_view key, int64_t weight) {
+        uint64_t hash = std::hash<string_view>()(key);
+        for (size_t row = 0; row < DEPTH; row++) counters[slot(hash, row)] += weight;
+    }
+
+    int64_t estimate(string_view key) const {
+        uint64_t hash = std::hash<string_view>()(key);
+        int64_t lowest = numeric_limits<int64_t>::max();
+        for (size_t row = 0; row < DEPTH; row++) lowest = min(lowest, counters[slot(hash, row)]);
+        return lowest;
+    }
+
+    void clear() { fill(counters.begin(), counters.end(), 0); }
+};
+
+enum TopNStream {
+    TOP_EARNERS,            // Freelancers by earnings in cents
+    TOP_CLIENT_MILESTONES,  // Clients by milestones paid
+    TOP_STREAM_COUNT
+};
+
+struct HeavyHitter {
+    string key;
+    int64_t estimate;    // Never below the true total
+    int64_t lowerBound;  // Never above the true total
+};
+
+// Continuous top-N over tumbling windows (a week by default, starting Monday
+// 00:00 UTC), fed by the receipt log right after settlement. Each stream keeps
+// a Space-Saving summary for candidates plus a count-min sketch that tightens
+// their estimates, so memory per window is constant however many parties pay.
+// The current and the previous window are kept; receipts older than that are
+// ignored.
+class TopNTracker : public ReceiptListener {
+private:
+    static constexpr int64_t WINDOW_ORIGIN = 4 * 86400;  // 1970-01-05, a Monday
+
+    struct Window {
+        int64_t index = numeric_limits<int64_t>::min();
+        SpaceSaving* summaries[TOP_STREAM_COUNT];
+        CountMinSketch* sketches[TOP_STREAM_COUNT];
+
+        explicit Window(size_t counters) {
+            for (int s = 0; s < TOP_STREAM_COUNT; s++) {
+                summaries[s] = new SpaceSaving(counters);
+                sketches[s] = new CountMinSketch();
+            }
+        }
+
+        ~Window() {
+            for (int s = 0; s < TOP_STREAM_COUNT; s++) {
+                delete summaries[s];
+                delete sketches[s];
+            }
+        }
+
+        void reset(int64_t newIndex) {
+            index = newIndex;
+            for (int s = 0; s < TOP_STREAM_COUNT; s++) {
+                summaries[s]->clear();
+                sketches[s]->clear();
+            }
+        }
+
+        void add(TopNStream stream, string_view key, int64_t weight) {
+            summaries[stream]->add(key, weight);
+            sketches[stream]->add(key, weight);
+        }
+    };
+
+    int64_t windowSeconds;
+    Window* current;
+    Window* previous;
+    mutable mutex lock;
+
+    int64_t windowOf(int64_t timestamp) const {
+        int64_t offset = timestamp - WINDOW_ORIGIN;
+        return offset / windowSeconds - (offset % windowSeconds < 0 ? 1 : 0);
+    }
+
+public:
+    TopNTracker(size_t counters = 1024, int64_t windowLength = 7 * 86400)
+        : windowSeconds(max<int64_t>(1, windowLength)), current(new Window(counters)), previous(new Window(counters)) {
+    }
+
+    TopNTracker(const TopNTracker&) = delete;
+    TopNTracker& operator=(const TopNTracker&) = delete;
+
+    ~TopNTracker() {
+        delete current;
+        delete previous;
+    }
+
+    void add(string_view client, string_view freelancer, int64_t cents, int64_t timestamp) {
+        int64_t index = windowOf(timestamp);
+        lock_guard<mutex> guard(lock);
+        if (index > current->index) {
+            // Roll forward: the current window becomes the previous one unless it is stale too
+            swap(current, previous);
+            if (previous->index != index - 1) previous->reset(index - 1);
+            current->reset(index);
+        }
+        Window* window = index == current->index ? current : index == previous->index ? previous : nullptr;
+        if (!window) return;
+        window->add(TOP_EARNERS, freelancer, cents);
+        window->add(TOP_CLIENT_MILESTONES, client, 1);
+    }
+
+    void onPaymentReceipt(const PaymentRecord& record) override {
+        string_view client = !record.clientEmail.empty() ? record.clientEmail
+            : !record.clientName.empty() ? record.clientName : string_view("(unknown)");
+        string_view freelancer = !record.freelancerEmail.empty() ? record.freelancerEmail
+            : !record.freelancerName.empty() ? record.freelancerName : string_view("(unknown)");
+        add(client, freelancer, llround(record.amount * 100.0), static_cast<int64_t>(record.timestamp));
+    }
+
+    static constexpr int64_t LATEST = numeric_limits<int64_t>::min();  // As of the newest receipt
+
+    // Largest n keys of a stream in the window containing asOf (or the one
+    // before it), largest first. Windows only roll when receipts arrive, so a
+    // quiet spell leaves them behind the clock and they then count as empty.
+    vector<HeavyHitter> top(TopNStream stream, size_t n, bool previousWindow = false, int64_t asOf = LATEST) const {
+        lock_guard<mutex> guard(lock);
+        vector<HeavyHitter> result;
+        if (current->index == numeric_limits<int64_t>::min()) return result;  // No receipts yet
+        // Receipts stamped ahead of the clock keep their window current
+        int64_t index = asOf == LATEST ? current->index : max(windowOf(asOf), current->index);
+        int64_t wanted = previousWindow ? index - 1 : index;
+        const Window* window = current->index == wanted ? current : previous->index == wanted ? previous : nullptr;
+        if (!window) return result;
+        for (const SpaceSaving::Counter& counter : window->summaries[stream]->top(n)) {
+            HeavyHitter hitter;
+            hitter.key = counter.key;
+            hitter.estimate = min(counter.count, window->sketches[stream]->estimate(counter.key));
+            hitter.lowerBound = counter.count - counter.error;
+            result.push_back(hitter);
+        }
+        stable_sort(result.begin(), result.end(),
+            [](const HeavyHitter& a, const HeavyHitter& b) { return a.estimate > b.estimate; });
+        return result;
+    }
+
+    // Epoch seconds (UTC) where the current window starts, or 0 before any receipt
+    int64_t currentWindowStart() const {
+        lock_guard<mutex> guard(lock);
+        if (current->index == numeric_limits<int64_t>::min()) return 0;
+        return WINDOW_ORIGIN + current->index * windowSeconds;
+    }
+};
+
+// HyperLogLog distinct counter with the small-range correction of HLL++:
+// 2^precision registers keep the longest run of leading zeros seen among the
+// hashes routed to them. Small sketches stay sparse, as a list of
+// (register, rank) entries, until the list would outgrow an eighth of the
+// dense array. Sketches of equal precision merge by register-wise maximum,
+// which is lossless and idempotent, so threads, shards and time buckets
+// combine freely. Standard error is about 1.04 / sqrt(2^precision).
+class HyperLogLog {
+private:
+    uint8_t precision;
+    vector<uint8_t> registers;  // Dense form; empty while sparse
+    vector<uint32_t> sparse;    // register << 8 | rank, one entry per register
+
+    size_t registerCount() const { return size_t(1) << precision; }
+    uint8_t maxRank() const { return static_cast<uint8_t>(65 - precision); }  // addHash caps the run of zeros
+
+    void densify() {
+        if (!registers.empty()) return;
+        registers.assign(registerCount(), 0);
+        for (uint32_t entry : sparse) {
+            uint8_t& slot = registers[entry >> 8];
+            slot = max(slot, static_cast<uint8_t>(entry & 0xFF));
+        }
+        sparse.clear();
+        sparse.shrink_to_fit();
+    }
+
+    void update(uint32_t index, uint8_t rank) {
+        if (!registers.empty()) {
+            if (rank > registers[index]) registers[index] = rank;
+            return;
+        }
+        for (uint32_t& entry : sparse) {
+            if ((entry >> 8) == index) {
+                if (rank > (entry & 0xFF)) entry = index << 8 | rank;
+                return;
+            }
+        }
+        sparse.push_back(index << 8 | rank);
+        if (sparse.size() * sizeof(uint32_t) * 8 > registerCount()) densify();
+    }
+
+public:
+    explicit HyperLogLog(uint8_t bits = 12) : precision(static_cast<uint8_t>(min(max<int>(bits, 4), 18))) {}
+
+    uint8_t getPrecision() const { return precision; }
+
+    static uint64_t hashKey(string_view key) {
+        uint64_t hash = std::hash<string_view>()(key);
+        hash ^= hash >> 33;  // Finalizer so weak hashes still spread across registers
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        return hash ^ (hash >> 33);
+    }
+
+    void add(string_view key) { addHash(hashKey(key)); }
+
+    void addHash(uint64_t hash) {
+        uint32_t index = static_cast<uint32_t>(hash >> (64 - precision));
+        uint64_t rest = (hash << precision) | (uint64_t(1) << (precision - 1));  // Caps the rank
+        update(index, static_cast<uint8_t>(__builtin_clzll(rest) + 1));
+    }
+
+    void merge(const HyperLogLog& other) {
+        if (other.precision != precision) throw runtime_error("Cannot merge HyperLogLog sketches of different precision");
+        if (other.registers.empty()) {
+            for (uint32_t entry : other.sparse) update(entry >> 8, static_cast<uint8_t>(entry & 0xFF));
+            return;
+        }
+        densify();
+        for (size_t i = 0; i < registers.size(); i++) registers[i] = max(registers[i], other.registers[i]);
+    }
+
+    double estimate() const {
+        double m = static_cast<double>(registerCount());
+        double inverseSum = 0.0;
+        size_t zeros = 0;
+        if (registers.empty()) {
+            zeros = registerCount() - sparse.size();
+            inverseSum = static_cast<double>(zeros);
+            for (uint32_t entry : sparse) inverseSum += ldexp(1.0, -static_cast<int>(entry & 0xFF));
+        }
+        else {
+            for (uint8_t rank : registers) {
+                inverseSum += ldexp(1.0, -rank);
+                if (rank == 0) zeros++;
+            }
+        }
+        double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1.0 + 1.079 / m);
+        double raw = alpha * m * m / inverseSum;
+        if (raw <= 2.5 * m && zeros > 0) return m * log(m / static_cast<double>(zeros));  // Linear counting
+        return raw;
+    }
+
+    // Bytes held, for sizing reports
+    size_t footprint() const { return registers.size() + sparse.size() * sizeof(uint32_t); }
+
+    // Binary form: precision, then 0 + entry count + entries when sparse or 1 + registers when dense
+    void write(ostream& out) const {
+        out.put(static_cast<char>(precision));
+        out.put(registers.empty() ? 0 : 1);
+        if (registers.empty()) {
+            uint32_t count = static_cast<uint32_t>(sparse.size());
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            out.write(reinterpret_cast<const char*>(sparse.data()), count * sizeof(uint32_t));
+        }
+        else {
+            out.write(reinterpret_cast<const char*>(registers.data()), registers.size());
+        }
+    }
+
+    static HyperLogLog read(istream& in) {
+        int bits = in.get();
+        int dense = in.get();
+        if (!in || bits < 4 || bits > 18) throw runtime_error("Corrupt HyperLogLog sketch");
+        HyperLogLog sketch(static_cast<uint8_t>(bits));
+        if (dense) {
+            sketch.registers.resize(sketch.registerCount());
+            in.read(reinterpret_cast<char*>(sketch.registers.data()), sketch.registers.size());
+            for (uint8_t rank : sketch.registers) {
+                if (rank > sketch.maxRank()) throw runtime_error("Corrupt HyperLogLog sketch");
+            }
+        }
+        else {
+            uint32_t count = 0;
+            in.read(reinterpret_cast<char*>(&count), sizeof(count));
+            if (!in || count > sketch.registerCount()) throw runtime_error("Corrupt HyperLogLog sketch");
+            sketch.sparse.resize(count);
+            in.read(reinterpret_cast<char*>(sketch.sparse.data()), count * sizeof(uint32_t));
+            // Entries index registers directly once densified, so bad ones must not get in
+            for (uint32_t entry : sketch.sparse) {
+                if ((entry >> 8) >= sketch.registerCount() || (entry & 0xFF) > sketch.maxRank()) {
+                    throw runtime_error("Corrupt HyperLogLog sketch");
+                }
+            }
+        }
+        if (!in) throw runtime_error("Truncated HyperLogLog sketch");
+        return sketch;
+    }
+};
+
+enum CardinalityMetric {
+    DISTINCT_PAYERS,                   // Clients paying per day
+    DISTINCT_CLIENTS_PER_FREELANCER,   // Keyed by freelancer
+    DISTINCT_FREELANCERS_PER_SKILL,    // Keyed by normalized skill
+    CARDINALITY_METRIC_COUNT
+};
+
+// Distinct-count metrics per UTC day, fed from the receipt log at the end of
+// each workflow. Updates go to one of a fixed set of shards picked by thread,
+// each with its own lock, and queries merge the shards and the days in range.
+// Daily payers use 2^14 registers (~0.8% error); the per-freelancer and
+// per-skill sketches use 2^10 (~3%) and stay sparse while small. Days can be
+// saved to and loaded from a directory, one file per day and writer label;
+// loading merges, so files from several shards or restarts simply combine.
+class CardinalityTracker : public ReceiptListener {
+private:
+    static constexpr size_t SHARDS = 16;
+    static constexpr uint8_t PAYER_PRECISION = 14;
+    static constexpr uint8_t KEYED_PRECISION = 10;
+
+    struct DaySketches {
+        HyperLogLog payers{PAYER_PRECISION};
+        unordered_map<string, HyperLogLog> clientsPerFreelancer;
+        unordered_map<string, HyperLogLog> freelancersPerSkill;
+
+        void merge(const DaySketches& other) {
+            payers.merge(other.payers);
+            for (const auto& entry : other.clientsPerFreelancer) {
+                clientsPerFreelancer.emplace(entry.first, HyperLogLog(KEYED_PRECISION)).first->second.merge(entry.second);
+            }
+            for (const auto& entry : other.freelancersPerSkill) {
+                freelancersPerSkill.emplace(entry.first, HyperLogLog(KEYED_PRECISION)).first->second.merge(entry.second);
+            }
+        }
+    };
+
+    struct Shard {
+        mutex lock;
+        map<int64_t, DaySketches> days;
+    };
+
+    Shard shards[SHARDS];
+
+    Shard& localShard() {
+        return shards[std::hash<thread::id>()(this_thread::get_id()) % SHARDS];
+    }
+
+    static int64_t dayOf(int64_t timestamp) {
+        return timestamp / 86400 - (timestamp % 86400 < 0 ? 1 : 0);
+    }
+
+    // Splits "C++, Go ,rust" into trimmed lower-case skills
+    static vector<string> splitSkills(string_view skills) {
+        vector<string> result;
+        while (!skills.empty()) {
+            size_t comma = skills.find(',');
+            string_view skill = skills.substr(0, comma);
+            skills = comma == string_view::npos ? string_view() : skills.substr(comma + 1);
+            size_t first = skill.find_first_not_of(" \t");
+            if (first == string_view::npos) continue;
+            skill = skill.substr(first, skill.find_last_not_of(" \t") - first + 1);
+            string key(skill);
+            for (char& c : key) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            result.push_back(key);
+        }
+        return result;
+    }
+
+    // All shards' sketches for [firstDay, lastDay] merged into one per day
+    map<int64_t, DaySketches> collect(int64_t firstDay, int64_t lastDay) {
+        map<int64_t, DaySketches> merged;
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            for (auto it = shard.days.lower_bound(firstDay); it != shard.days.end() && it->first <= lastDay; ++it) {
+                merged[it->first].merge(it->second);
+            }
+        }
+        return merged;
+    }
+
+public:
+    void add(string_view client, string_view freelancer, string_view skills, int64_t timestamp) {
+        vector<string> skillKeys = splitSkills(skills);
+        uint64_t clientHash = HyperLogLog::hashKey(client);
+        uint64_t freelancerHash = HyperLogLog::hashKey(freelancer);
+        Shard& shard = localShard();
+        lock_guard<mutex> guard(shard.lock);
+        DaySketches& day = shard.days[dayOf(timestamp)];
+        day.payers.addHash(clientHash);
+        day.clientsPerFreelancer.emplace(string(freelancer), HyperLogLog(KEYED_PRECISION)).first->second.addHash(clientHash);
+        for (const string& skill : skillKeys) {
+            day.freelancersPerSkill.emplace(skill, HyperLogLog(KEYED_PRECISION)).first->second.addHash(freelancerHash);
+        }
+    }
+
+    void onPaymentReceipt(const PaymentRecord& record) override {
+        string_view client = !record.clientEmail.empty() ? record.clientEmail
+            : !record.clientName.empty() ? record.clientName : string_view("(unknown)");
+        string_view freelancer = !record.freelancerEmail.empty() ? record.freelancerEmail
+            : !record.freelancerName.empty() ? record.freelancerName : string_view("(unknown)");
+        add(client, freelancer, record.freelancerSkills, static_cast<int64_t>(record.timestamp));
+    }
+
+    // Estimated distinct count over the days overlapping [from, to); key names the
+    // freelancer or skill for the keyed metrics and is ignored for payers
+    double distinct(CardinalityMetric metric, int64_t from, int64_t to, string_view key = string_view()) {
+        if (from >= to) return 0.0;
+        string normalized(key);
+        if (metric == DISTINCT_FREELANCERS_PER_SKILL) {
+            vector<string> skills = splitSkills(key);
+            normalized = skills.empty() ? "" : skills[0];
+        }
+        HyperLogLog total(metric == DISTINCT_PAYERS ? PAYER_PRECISION : KEYED_PRECISION);
+        for (const auto& day : collect(dayOf(from), dayOf(to - 1))) {
+            if (metric == DISTINCT_PAYERS) {
+                total.merge(day.second.payers);
+                continue;
+            }
+            const unordered_map<string, HyperLogLog>& sketches = metric == DISTINCT_CLIENTS_PER_FREELANCER
+                ? day.second.clientsPerFreelancer : day.second.freelancersPerSkill;
+            auto it = sketches.find(normalized);
+            if (it != sketches.end()) total.merge(it->second);
+        }
+        return total.estimate();
+    }
+
+    // Writes one file per day, <directory>/<YYYY-MM-DD>.<label>.hll, and returns how many.
+    // Files hold a "HLL1" tag, the payer sketch, then the keyed sketches with their keys.
+    size_t save(const string& directory, const string& label) {
+        map<int64_t, DaySketches> days = collect(numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max());
+        for (const auto& day : days) {
+            time_t when = static_cast<time_t>(day.first * 86400);
+            tm utc;
+#ifdef _WIN32
+            gmtime_s(&utc, &when);
+#else
+            gmtime_r(&when, &utc);
+#endif
+            char name[16];
+            strftime(name, sizeof(name), "%Y-%m-%d", &utc);
+            string path = directory + "/" + name + "." + label + ".hll";
+            string temporary = path + ".tmp";
+            ofstream out(temporary, ios::binary | ios::trunc);
+            if (!out.is_open()) throw runtime_error("Unable to write sketch file " + temporary);
+            out.write("HLL1", 4);
+            out.write(reinterpret_cast<const char*>(&day.first), sizeof(day.first));
+            day.second.payers.write(out);
+            for (const unordered_map<string, HyperLogLog>* sketches : {&day.second.clientsPerFreelancer,
+                &day.second.freelancersPerSkill}) {
+                uint64_t count = sketches->size();
+                out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+                for (const auto& entry : *sketches) {
+                    uint32_t length = static_cast<uint32_t>(entry.first.size());
+                    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                    out.write(entry.first.data(), length);
+                    entry.second.write(out);
+                }
+            }
+            out.close();
+            if (!out || rename(temporary.c_str(), path.c_str()) != 0) {
+                throw runtime_error("Unable to write sketch file " + path);
+            }
+        }
+        return days.size();
+    }
+
+    // Merges one saved day file into this tracker
+    void load(const string& path) {
+        ifstream in(path, ios::binary);
+        char tag[4];
+        int64_t dayIndex = 0;
+        if (!in.read(tag, 4) || memcmp(tag, "HLL1", 4) != 0
+            || !in.read(reinterpret_cast<char*>(&dayIndex), sizeof(dayIndex))) {
+            throw runtime_error("Not a sketch file: " + path);
+        }
+        DaySketches day;
+        day.payers = HyperLogLog::read(in);
+        for (unordered_map<string, HyperLogLog>* sketches : {&day.clientsPerFreelancer, &day.freelancersPerSkill}) {
+            uint64_t count = 0;
+            in.read(reinterpret_cast<char*>(&count), sizeof(count));
+            for (uint64_t i = 0; in && i < count; i++) {
+                uint32_t length = 0;
+                in.read(reinterpret_cast<char*>(&length), sizeof(length));
+                if (!in || length > 4096) throw runtime_error("Corrupt sketch file: " + path);
+                string key(length, '\0');
+                in.read(&key[0], length);
+                sketches->emplace(key, HyperLogLog::read(in));
+            }
+        }
+        if (!in) throw runtime_error("Truncated sketch file: " + path);
+
+        Shard& shard = localShard();
+        lock_guard<mutex> guard(shard.lock);
+        shard.days[dayIndex].merge(day);
+    }
+
+    // Loads every *.hll file in directory and returns how many were merged
+    size_t loadDirectory(const string& directory) {
+        size_t loaded = 0;
+        error_code error;
+        for (const auto& entry : filesystem::directory_iterator(directory, error)) {
+            if (entry.path().extension() != ".hll") continue;
+            load(entry.path().string());
+            loaded++;
+        }
+        return loaded;
+    }
+
+    // Bytes held by all sketches, for sizing reports
+    size_t footprint() {
+        size_t bytes = 0;
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            for (const auto& day : shard.days) {
+                bytes += day.second.payers.footprint();
+                for (const auto& entry : day.second.clientsPerFreelancer) bytes += entry.second.footprint();
+                for (const auto& entry : day.second.freelancersPerSkill) bytes += entry.second.footprint();
+            }
+        }
+        return bytes;
+    }
+};
+
+// Parses "YYYY-MM-DD" as local midnight
+int64_t parseReportDate(const string& text) {
+    tm fields = {};
+    if (sscanf(text.c_str(), "%d-%d-%d", &fields.tm_year, &fields.tm_mon, &fields.tm_mday) != 3) {
+        throw runtime_error("Invalid date, expected YYYY-MM-DD: " + text);
+    }
+    fields.tm_year -= 1900;
+    fields.tm_mon -= 1;
+    fields.tm_isdst = -1;
+    return static_cast<int64_t>(mktime(&fields));
+}
+
+// Parses YYYY-MM-DD as midnight UTC, for ranges over UTC buckets such as the rollups
+int64_t parseUtcDate(const string& text) {
+    int fields[3];
+    if (sscanf(text.c_str(), "%d-%d-%d", &fields[0], &fields[1], &fields[2]) != 3
+        || fields[1] < 1 || fields[1] > 12 || fields[2] < 1 || fields[2] > 31) {
+        throw runtime_error("Invalid date, expected YYYY-MM-DD: " + text);
+    }
+    int64_t year = fields[0], month = fields[1], day = fields[2];
+    year -= month <= 2 ? 1 : 0;  // Days from the civil date, counting years from March
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return (era * 146097 + dayOfEra - 719468) * 86400;
+}
+
+// Earnings per freelancer, spend per client and totals per payment type over [from, to),
+// each with its query time; at most limit rows are shown per report
+void printReceiptReports(const ReceiptStore& store, int64_t from, int64_t to, size_t limit) {
+    struct Report {
+        const char* title;
+        ReceiptDimension dimension;
+    };
+    const Report reports[] = {
+        {"Earnings per freelancer", GROUP_BY_FREELANCER},
+        {"Spend per client", GROUP_BY_CLIENT},
+        {"Totals by payment type", GROUP_BY_PAYMENT_TYPE},
+    };
+    for (const Report& report : reports) {
+        auto start = chrono::steady_clock::now();
+        vector<GroupTotal> totals = store.sumBy(report.dimension, from, to);
+        double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "\n" << report.title << " (" << totals.size() << " groups, " << millis << " ms)" << endl;
+        for (size_t i = 0; i < totals.size() && i < limit; i++) {
+            cout << "  " << totals[i].key << ": $" << formatCents(totals[i].cents) << " over "
+                << totals[i].receipts << " receipt(s)" << endl;
+        }
+        if (totals.size() > limit) cout << "  ... " << totals.size() - limit << " more" << endl;
+    }
+}
+
+// Loads a receipt log and prints the finance reports for [from, to)
+void runReceiptReport(const string& fileName, int64_t from, int64_t to) {
+    ReceiptStore* store = new ReceiptStore();
+    auto start = chrono::steady_clock::now();
+    size_t loaded = store->loadReceiptFile(fileName);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Loaded " << loaded << " receipts from " << fileName << " in " << seconds << " s" << endl;
+    printReceiptReports(*store, from, to, 20);
+    delete store;
+}
+
+// Times the finance reports over rows synthetic receipts spread across one year,
+// for the whole year and for a single month
+void runAnalyticsBench(size_t rows) {
+    const int64_t yearStart = parseReportDate("2026-01-01");
+    const int64_t yearEnd = parseReportDate("2027-01-01");
+    ReceiptStore* store = new ReceiptStore();
+    auto start = chrono::steady_clock::now();
+    store->reserve(rows);
+    store->generateSynthetic(rows, 20000, 100000, yearStart, yearEnd, 42);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Generated " << rows << " receipts in " << seconds << " s" << endl;
+
+    cout << "\n--- Whole year ---";
+    printReceiptReports(*store, yearStart, yearEnd, 3);
+    cout << "\n--- March only ---";
+    printReceiptReports(*store, parseReportDate("2026-03-01"), parseReportDate("2026-04-01"), 3);
+    delete store;
+}
+
+class QuerySyntaxException : public runtime_error {
+public:
+    QuerySyntaxException(const string& message, size_t position)
+        : runtime_error("Query error at offset " + to_string(position) + ": " + message) {}
+};
+
+// Ad-hoc filters over the receipt columns, for example
+//   type = Escrow and amount > 5000 and milestone ~ website and time in last_month
+// Fields: type, client, freelancer and milestone (text), amount (dollars) and
+// time (YYYY-MM-DD or epoch seconds). Operators: = != < <= > >=, ~ for a
+// case-insensitive substring on text, and "time in <period>" for today,
+// yesterday, this_week, last_week, this_month, last_month or this_year (local
+// time). Terms combine with and, or, not and parentheses; text with spaces is
+// quoted with ' or ".
+// A query is parsed once into a node list. Each execution compiles it against
+// the store's dictionaries into nested closures that narrow a block of row ids
+// in place: text equality becomes an id compare, other text tests a per-id
+// match table, and "and"/"or" only evaluate their right side on rows the left
+// side left undecided. Time bounds in the top-level conjunction also narrow the
+// scanned range when rows are in time order. Blocks are spread over threads.
+class ReceiptQuery {
+public:
+    struct Result {
+        uint64_t matches = 0;
+        int64_t cents = 0;
+        vector<string> rows;  // The first matches in ledger order, formatted for display
+    };
+
+private:
+    static constexpr size_t BLOCK = 1024;
+    static constexpr int MAX_DEPTH = 64;  // Parsing, compiling and filtering all recurse once per level
+
+    enum NodeKind { NODE_AND, NODE_OR, NODE_NOT, NODE_COMPARE };
+    enum QueryField { FIELD_TYPE, FIELD_CLIENT, FIELD_FREELANCER, FIELD_MILESTONE, FIELD_AMOUNT, FIELD_TIME };
+    enum QueryOperator { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_CONTAINS, OP_IN };
+
+    struct Node {
+        NodeKind kind = NODE_COMPARE;
+        int left = -1;
+        int right = -1;
+        QueryField field = FIELD_TYPE;
+        QueryOperator op = OP_EQ;
+        string text;         // Text operand, or the period name for OP_IN
+        int64_t number = 0;  // Cents or epoch seconds for numeric fields
+        int depth = 1;       // Levels in the subtree rooted here
+    };
+
+    // Narrows rows[0, count) to the matching ids, written to out (which may alias rows)
+    typedef function<size_t(const uint32_t* rows, size_t count, uint32_t* out)> RowFilter;
+
+    string source;
+    vector<Node> nodes;
+    int root = -1;
+
+    // --- Parsing ---
+
+    struct Token {
+        string text;
+        bool quoted = false;
+        size_t position = 0;
+    };
+
+    vector<Token> tokens;
+    size_t cursor = 0;
+    int nesting = 0;  // Open parentheses and "not"s around the cursor
+
+    void tokenize() {
+        size_t i = 0;
+        while (i < source.size()) {
+            char c = source[i];
+            if (isspace(static_cast<unsigned char>(c))) {
+                i++;
+                continue;
+            }
+            Token token;
+            token.position = i;
+            if (c == '\'' || c == '"') {
+                size_t close = source.find(c, i + 1);
+                if (close == string::npos) throw QuerySyntaxException("unterminated string", i);
+                token.text = source.substr(i + 1, close - i - 1);
+                token.quoted = true;
+                i = close + 1;
+            }
+            else if (c == '(' || c == ')' || c == '~') {
+                token.text = string(1, c);
+                i++;
+            }
+            else if (c == '=' || c == '!' || c == '<' || c == '>') {
+                size_t length = i + 1 < source.size() && source[i + 1] == '=' ? 2 : 1;
+                token.text = source.substr(i, length);
+                if (token.text == "!") throw QuerySyntaxException("expected !=", i);
+                i += length;
+            }
+            else {
+                size_t end = i;
+                while (end < source.size() && !isspace(static_cast<unsigned char>(source[end]))
+                    && strchr("()~=!<>'\"", source[end]) == nullptr) {
+                    end++;
+                }
+                token.text = source.substr(i, end - i);
+                i = end;
+            }
+            tokens.push_back(token);
+        }
+    }
+
+    bool peekWord(const char* word) const {
+        if (cursor >= tokens.size() || tokens[cursor].quoted) return false;
+        const string& text = tokens[cursor].text;
+        if (text.size() != strlen(word)) return false;
+        for (size_t i = 0; i < text.size(); i++) {
+            if (tolower(static_cast<unsigned char>(text[i])) != word[i]) return false;
+        }
+        return true;
+    }
+
+    const Token& next(const char* expected) {
+        if (cursor >= tokens.size()) throw QuerySyntaxException(string("expected ") + expected, source.size());
+        return tokens[cursor++];
+    }
+
+    // Chains of "and"/"or" count too, as each link is one more level
+    int addNode(const Node& node, size_t position) {
+        nodes.push_back(node);
+        Node& added = nodes.back();
+        if (added.left >= 0) added.depth = max(added.depth, nodes[added.left].depth + 1);
+        if (added.right >= 0) added.depth = max(added.depth, nodes[added.right].depth + 1);
+        if (added.depth > MAX_DEPTH) {
+            throw QuerySyntaxException("query nested more than " + to_string(MAX_DEPTH) + " levels deep", position);
+        }
+        return static_cast<int>(nodes.size() - 1);
+    }
+
+    int parseOr() {
+        int left = parseAnd();
+        while (peekWord("or")) {
+            size_t position = tokens[cursor++].position;
+            Node node;
+            node.kind = NODE_OR;
+            node.left = left;
+            node.right = parseAnd();
+            left = addNode(node, position);
+        }
+        return left;
+    }
+
+    int parseAnd() {
+        int left = parseUnary();
+        while (peekWord("and")) {
+            size_t position = tokens[cursor++].position;
+            Node node;
+            node.kind = NODE_AND;
+            node.left = left;
+            node.right = parseUnary();
+            left = addNode(node, position);
+        }
+        return left;
+    }
+
+    int parseUnary() {
+        bool negated = peekWord("not");
+        bool grouped = !negated && cursor < tokens.size() && !tokens[cursor].quoted && tokens[cursor].text == "(";
+        if (!negated && !grouped) return parseComparison();
+
+        size_t position = tokens[cursor++].position;
+        if (++nesting > MAX_DEPTH) {
+            throw QuerySyntaxException("query nested more than " + to_string(MAX_DEPTH) + " levels deep", position);
+        }
+        int result;
+        if (negated) {
+            Node node;
+            node.kind = NODE_NOT;
+            node.left = parseUnary();
+            result = addNode(node, position);
+        }
+        else {
+            result = parseOr();
+            const Token& close = next(")");
+            if (close.quoted || close.text != ")") throw QuerySyntaxException("expected )", close.position);
+        }
+        nesting--;
+        return result;
+    }
+
+    int parseComparison() {
+        const Token& fieldToken = next("a field");
+        Node node;
+        static const char* const fieldNames[] = {"type", "client", "freelancer", "milestone", "amount", "time"};
+        bool known = false;
+        for (int f = 0; f <= FIELD_TIME; f++) {
+            if (!fieldToken.quoted && fieldToken.text == fieldNames[f]) {
+                node.field = static_cast<QueryField>(f);
+                known = true;
+            }
+        }
+        if (!known) throw QuerySyntaxException("unknown field '" + fieldToken.text + "'", fieldToken.position);
+
+        const Token& opToken = next("an operator");
+        static const char* const operatorNames[] = {"=", "!=", "<", "<=", ">", ">=", "~", "in"};
+        bool validOperator = false;
+        for (int o = 0; o <= OP_IN; o++) {
+            if (!opToken.quoted && opToken.text == operatorNames[o]) {
+                node.op = static_cast<QueryOperator>(o);
+                validOperator = true;
+            }
+        }
+        if (!opToken.quoted && opToken.text == "==") {
+            node.op = OP_EQ;
+            validOperator = true;
+        }
+        if (!validOperator) throw QuerySyntaxException("unknown operator '" + opToken.text + "'", opToken.position);
+
+        const Token& value = next("a value");
+        bool numeric = node.field == FIELD_AMOUNT || node.field == FIELD_TIME;
+        if (node.op == OP_CONTAINS && numeric) throw QuerySyntaxException("~ applies to text fields", opToken.position);
+        if (node.op == OP_IN) {
+            static const char* const periods[] = {"today", "yesterday", "this_week", "last_week", "this_month",
+                "last_month", "this_year"};
+            bool validPeriod = false;
+            for (const char* period : periods) validPeriod = validPeriod || value.text == period;
+            if (node.field != FIELD_TIME || !validPeriod) {
+                throw QuerySyntaxException("\"in\" takes time and a period such as last_month", value.position);
+            }
+            node.text = value.text;
+        }
+        else if (node.field == FIELD_AMOUNT) {
+            string amount = !value.text.empty() && value.text[0] == '$' ? value.text.substr(1) : value.text;
+            char* end = nullptr;
+            double dollars = strtod(amount.c_str(), &end);
+            if (amount.empty() || *end != '\0' || !isfinite(dollars) || fabs(dollars) > 9e15) {
+                throw QuerySyntaxException("expected an amount", value.position);
+            }
+            node.number = llround(dollars * 100.0);
+        }
+        else if (node.field == FIELD_TIME) {
+            if (!value.text.empty() && value.text.find_first_not_of("0123456789") == string::npos) {
+                node.number = strtoll(value.text.c_str(), nullptr, 10);
+            }
+            else {
+                try {
+                    node.number = parseReportDate(value.text);
+                }
+                catch (const exception&) {
+                    throw QuerySyntaxException("expected YYYY-MM-DD or epoch seconds", value.position);
+                }
+            }
+        }
+        else {
+            node.text = value.text;
+        }
+        return addNode(node, fieldToken.position);
+    }
+
+    // --- Compilation ---
+
+    template <typename Value, typename Predicate>
+    static RowFilter columnFilter(const Value* column, Predicate matches) {
+        return [column, matches](const uint32_t* rows, size_t count, uint32_t* out) {
+            size_t kept = 0;
+            for (size_t i = 0; i < count; i++) {
+                uint32_t row = rows[i];
+                out[kept] = row;  // Branch-free compaction: the slot is kept only on a match
+                kept += matches(column[row]) ? 1 : 0;
+            }
+            return kept;
+        };
+    }
+
+    template <typename Value>
+    static RowFilter numericFilter(const Value* column, QueryOperator op, int64_t operand) {
+        switch (op) {
+        case OP_EQ: return columnFilter(column, [operand](Value v) { return v == operand; });
+        case OP_NE: return columnFilter(column, [operand](Value v) { return v != operand; });
+        case OP_LT: return columnFilter(column, [operand](Value v) { return v < operand; });
+        case OP_LE: return columnFilter(column, [operand](Value v) { return v <= operand; });
+        case OP_GT: return columnFilter(column, [operand](Value v) { return v > operand; });
+        default: return columnFilter(column, [operand](Value v) { return v >= operand; });
+        }
+    }
+
+    static bool textMatches(const string& value, QueryOperator op, const string& operand) {
+        switch (op) {
+        case OP_EQ: return value == operand;
+        case OP_NE: return value != operand;
+        case OP_LT: return value < operand;
+        case OP_LE: return value <= operand;
+        case OP_GT: return value > operand;
+        case OP_GE: return value >= operand;
+        default: {
+            auto equalFolded = [](char a, char b) {
+                return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b));
+            };
+            return search(value.begin(), value.end(), operand.begin(), operand.end(), equalFolded) != value.end();
+        }
+        }
+    }
+
+    // Text tests resolve against the dictionary once: equality to a single id,
+    // anything else to a table saying which ids match
+    template <typename Id>
+    static RowFilter textFilter(const Id* column, const StringDictionary& names, QueryOperator op, const string& operand) {
+        if (op == OP_EQ || op == OP_NE) {
+            uint32_t id = 0;
+            if (!names.find(operand, id)) {
+                if (op == OP_EQ) return [](const uint32_t*, size_t, uint32_t*) { return size_t(0); };
+                return [](const uint32_t* rows, size_t count, uint32_t* out) {
+                    if (out != rows) copy(rows, rows + count, out);
+                    return count;
+                };
+            }
+            return numericFilter(column, op, static_cast<int64_t>(id));
+        }
+        vector<uint8_t> table(names.size());
+        for (uint32_t id = 0; id < names.size(); id++) table[id] = textMatches(names.lookup(id), op, operand) ? 1 : 0;
+        return columnFilter(column, [table](Id id) { return table[id] != 0; });
+    }
+
+    // Local-time [start, end) of a named period
+    static void periodBounds(const string& period, time_t now, int64_t& start, int64_t& end) {
+        tm day;
+#ifdef _WIN32
+        localtime_s(&day, &now);
+#else
+        localtime_r(&now, &day);
+#endif
+        day.tm_hour = day.tm_min = day.tm_sec = 0;
+        day.tm_isdst = -1;
+        tm first = day, last = day;
+        if (period == "today" || period == "yesterday") {
+            if (period == "yesterday") first.tm_mday--, last.tm_mday--;
+            last.tm_mday++;
+        }
+        else if (period == "this_week" || period == "last_week") {
+            int sinceMonday = (day.tm_wday + 6) % 7;
+            first.tm_mday -= sinceMonday + (period == "last_week" ? 7 : 0);
+            last.tm_mday = first.tm_mday + 7;
+        }
+        else if (period == "this_month" || period == "last_month") {
+            first.tm_mday = last.tm_mday = 1;
+            if (period == "last_month") first.tm_mon--;
+            else last.tm_mon++;
+        }
+        else {
+            first.tm_mday = last.tm_mday = 1;
+            first.tm_mon = last.tm_mon = 0;
+            last.tm_year++;
+        }
+        start = static_cast<int64_t>(mktime(&first));
+        end = static_cast<int64_t>(mktime(&last));
+    }
+
+    RowFilter compile(int index, const ReceiptColumns& columns, time_t now) const {
+        const Node& node = nodes[index];
+        switch (node.kind) {
+        case NODE_AND: {
+            RowFilter left = compile(node.left, columns, now);
+            RowFilter right = compile(node.right, columns, now);
+            return [left, right](const uint32_t* rows, size_t count, uint32_t* out) {
+                size_t kept = left(rows, count, out);
+                return kept ? right(out, kept, out) : kept;
+            };
+        }
+        case NODE_OR: {
+            RowFilter left = compile(node.left, columns, now);
+            RowFilter right = compile(node.right, columns, now);
+            return [left, right](const uint32_t* rows, size_t count, uint32_t* out) {
+                uint32_t matched[BLOCK], undecided[BLOCK], extra[BLOCK];
+                size_t hits = left(rows, count, matched);
+                size_t pending = 0;
+                for (size_t i = 0, j = 0; i < count; i++) {
+                    if (j < hits && matched[j] == rows[i]) j++;
+                    else undecided[pending++] = rows[i];
+                }
+                size_t more = pending ? right(undecided, pending, extra) : 0;
+                return static_cast<size_t>(merge(matched, matched + hits, extra, extra + more, out) - out);
+            };
+        }
+        case NODE_NOT: {
+            RowFilter inner = compile(node.left, columns, now);
+            return [inner](const uint32_t* rows, size_t count, uint32_t* out) {
+                uint32_t matched[BLOCK];
+                size_t hits = inner(rows, count, matched);
+                size_t kept = 0;
+                for (size_t i = 0, j = 0; i < count; i++) {
+                    if (j < hits && matched[j] == rows[i]) j++;
+                    else out[kept++] = rows[i];
+                }
+                return kept;
+            };
+        }
+        default:
+            break;
+        }
+
+        switch (node.field) {
+        case FIELD_TYPE:
+            return textFilter(columns.types, *columns.typeNames, node.op, node.text);
+        case FIELD_CLIENT:
+            return textFilter(columns.clients, *columns.clientNames, node.op, node.text);
+        case FIELD_FREELANCER:
+            return textFilter(columns.freelancers, *columns.freelancerNames, node.op, node.text);
+        case FIELD_MILESTONE:
+            return textFilter(columns.milestones, *columns.milestoneNames, node.op, node.text);
+        case FIELD_AMOUNT:
+            return numericFilter(columns.amounts, node.op, node.number);
+        default:
+            if (node.op == OP_IN) {
+                int64_t start = 0, end = 0;
+                periodBounds(node.text, now, start, end);
+                return columnFilter(columns.times, [start, end](int64_t t) { return t >= start && t < end; });
+            }
+            return numericFilter(columns.times, node.op, node.number);
+        }
+    }
+
+    // Narrows [from, to) with the time tests that every match must pass
+    void timeBounds(int index, time_t now, int64_t& from, int64_t& to) const {
+        const Node& node = nodes[index];
+        if (node.kind == NODE_AND) {
+            timeBounds(node.left, now, from, to);
+            timeBounds(node.right, now, from, to);
+            return;
+        }
+        if (node.kind != NODE_COMPARE || node.field != FIELD_TIME) return;
+        int64_t start = numeric_limits<int64_t>::min(), end = numeric_limits<int64_t>::max();
+        // One past the operand, saturating; an end of INT64_MAX means unbounded
+        int64_t next = node.number == numeric_limits<int64_t>::max() ? node.number : node.number + 1;
+        switch (node.op) {
+        case OP_EQ: start = node.number; end = next; break;
+        case OP_LT: end = node.number; break;
+        case OP_LE: end = next; break;
+        case OP_GT: start = next; break;
+        case OP_GE: start = node.number; break;
+        case OP_IN: periodBounds(node.text, now, start, end); break;
+        default: break;
+        }
+        from = max(from, start);
+        to = min(to, end);
+    }
+
+    static string formatRow(const ReceiptColumns& columns, size_t row) {
+        time_t when = static_cast<time_t>(columns.times[row]);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &when);
+#else
+        localtime_r(&when, &local);
+#endif
+        char stamp[24];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M", &local);
+        return string(stamp) + " | " + columns.typeNames->lookup(columns.types[row]) + " | $"
+            + formatCents(columns.amounts[row]) + " | " + columns.milestoneNames->lookup(columns.milestones[row])
+            + " | " + columns.clientNames->lookup(columns.clients[row]) + " -> "
+            + columns.freelancerNames->lookup(columns.freelancers[row]);
+    }
+
+public:
+    // Parses text once; throws QuerySyntaxException with the offending offset
+    explicit ReceiptQuery(const string& text) : source(text) {
+        tokenize();
+        if (tokens.empty()) throw QuerySyntaxException("empty query", 0);
+        root = parseOr();
+        if (cursor < tokens.size()) {
+            throw QuerySyntaxException("unexpected '" + tokens[cursor].text + "'", tokens[cursor].position);
+        }
+        tokens.clear();
+    }
+
+    const string& getSource() const { return source; }
+
+    // Count and total of matching receipts plus the first limit matches
+    Result execute(const ReceiptStore& store, size_t limit = 10, unsigned threads = thread::hardware_concurrency()) const {
+        return store.read([&](const ReceiptColumns& columns) {
+            if (columns.rows > numeric_limits<uint32_t>::max()) throw runtime_error("Ledger too large for queries");
+            time_t now = time(nullptr);
+            RowFilter filter = compile(root, columns, now);
+
+            size_t first = 0, last = columns.rows;
+            if (columns.timeOrdered) {
+                int64_t from = numeric_limits<int64_t>::min(), to = numeric_limits<int64_t>::max();
+                timeBounds(root, now, from, to);
+                first = lower_bound(columns.times, columns.times + columns.rows, from) - columns.times;
+                if (to != numeric_limits<int64_t>::max()) {
+                    last = max(first, static_cast<size_t>(lower_bound(columns.times, columns.times + columns.rows, to)
+                        - columns.times));
+                }
+            }
+
+            size_t blocks = (last - first + BLOCK - 1) / BLOCK;
+            unsigned workers = static_cast<unsigned>(max<size_t>(1, min<size_t>(max(1u, threads), blocks / 64 + 1)));
+            vector<Result> partials(workers);
+            vector<vector<uint32_t>> samples(workers);
+            vector<thread> pool;
+            for (unsigned w = 0; w < workers; w++) {
+                auto work = [&, w]() {
+                    uint32_t rows[BLOCK];
+                    size_t blockBegin = blocks * w / workers, blockEnd = blocks * (w + 1) / workers;
+                    for (size_t b = blockBegin; b < blockEnd; b++) {
+                        size_t begin = first + b * BLOCK;
+                        size_t count = min(BLOCK, last - begin);
+                        for (size_t i = 0; i < count; i++) rows[i] = static_cast<uint32_t>(begin + i);
+                        size_t kept = filter(rows, count, rows);
+                        partials[w].matches += kept;
+                        for (size_t i = 0; i < kept; i++) partials[w].cents += columns.amounts[rows[i]];
+                        for (size_t i = 0; i < kept && samples[w].size() < limit; i++) samples[w].push_back(rows[i]);
+                    }
+                };
+                if (w + 1 == workers) work();
+                else pool.emplace_back(work);
+            }
+            for (thread& worker : pool) worker.join();
+
+            Result result;
+            for (unsigned w = 0; w < workers; w++) {
+                result.matches += partials[w].matches;
+                result.cents += partials[w].cents;
+                for (uint32_t row : samples[w]) {
+                    if (result.rows.size() < limit) result.rows.push_back(formatRow(columns, row));
+                }
+            }
+            return result;
+        });
+    }
+};
+
+void printQueryResult(const ReceiptQuery::Result& result, double seconds) {
+    cout << result.matches << " matching receipt(s) totalling $" << formatCents(result.cents) << " in "
+        << seconds * 1000.0 << " ms" << endl;
+    for (const string& row : result.rows) cout << "  " << row << endl;
+}
+
+// Runs one query over a receipt log
+void runReceiptQuery(const string& fileName, const string& text, size_t limit) {
+    ReceiptQuery query(text);
+    ReceiptStore* store = new ReceiptStore();
+    size_t loaded = store->loadReceiptFile(fileName);
+    cout << "Loaded " << loaded << " receipts from " << fileName << endl;
+    auto start = chrono::steady_clock::now();
+    ReceiptQuery::Result result = query.execute(*store, limit);
+    printQueryResult(result, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    delete store;
+}
+
+// Times a query, cold and warm, over rows synthetic receipts spread across the
+// current year so relative periods such as last_month match
+void runQueryBench(size_t rows, const string& text) {
+    ReceiptQuery query(text);
+    time_t now = time(nullptr);
+    tm local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    const int64_t yearStart = parseReportDate(to_string(local.tm_year + 1900) + "-01-01");
+    const int64_t yearEnd = parseReportDate(to_string(local.tm_year + 1901) + "-01-01");
+
+    ReceiptStore* store = new ReceiptStore();
+    store->reserve(rows);
+    store->generateSynthetic(rows, 20000, 100000, yearStart, yearEnd, 42);
+    cout << "Generated " << rows << " receipts; query: " << query.getSource() << endl;
+
+    for (int run = 0; run < 2; run++) {
+        auto start = chrono::steady_clock::now();
+        ReceiptQuery::Result result = query.execute(*store, 3);
+        cout << (run == 0 ? "Cold: " : "Warm: ");
+        printQueryResult(result, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    delete store;
+}
+
+// Placeholders an invoice template can use. Invoice fields may appear anywhere;
+// line fields only inside the {{#lines}} ... {{/lines}} block, repeated per milestone.
+enum InvoiceField {
+    INVOICE_NUMBER,
+    INVOICE_CLIENT,
+    INVOICE_PERIOD,
+    INVOICE_COUNT,
+    INVOICE_TOTAL,
+    LINE_DATE,
+    LINE_MILESTONE,
+    LINE_FREELANCER,
+    LINE_TYPE,
+    LINE_AMOUNT,
+    INVOICE_FIELD_COUNT
+};
+
+const char* const invoiceFieldNames[INVOICE_FIELD_COUNT] = {"number", "client", "period", "count", "total",
+    "date", "milestone", "freelancer", "type", "amount"};
+
+// An invoice layout compiled once into header, line and footer segments. Each
+// segment is literal text followed by at most one field, so rendering is a run
+// of appends with no parsing or name lookups.
+class InvoiceTemplate {
+private:
+    struct Segment {
+        string literal;
+        int field;  // InvoiceField, or -1 after the last literal
+    };
+
+    vector<Segment> header;
+    vector<Segment> line;
+    vector<Segment> footer;
+
+    static void compileSection(string_view text, bool lineSection, vector<Segment>& segments) {
+        string literal;
+        size_t i = 0;
+        while (i < text.size()) {
+            size_t open = text.find("{{", i);
+            if (open == string_view::npos) {
+                literal.append(text.substr(i));
+                break;
+            }
+            literal.append(text.substr(i, open - i));
+            size_t close = text.find("}}", open + 2);
+            if (close == string_view::npos) throw runtime_error("Unterminated placeholder in invoice template");
+            string name(text.substr(open + 2, close - open - 2));
+            int field = -1;
+            for (int f = 0; f < INVOICE_FIELD_COUNT; f++) {
+                if (name == invoiceFieldNames[f]) field = f;
+            }
+            if (field < 0) throw runtime_error("Unknown invoice template field {{" + name + "}}");
+            if (!lineSection && field >= LINE_DATE) {
+                throw runtime_error("Invoice template field {{" + name + "}} is only valid inside {{#lines}}");
+            }
+            segments.push_back(Segment{literal, field});
+            literal.clear();
+            i = close + 2;
+        }
+        segments.push_back(Segment{literal, -1});
+    }
+
+    static void renderSection(const vector<Segment>& segments, const string_view* values, string& out) {
+        for (const Segment& segment : segments) {
+            out.append(segment.literal);
+            if (segment.field >= 0) out.append(values[segment.field]);
+        }
+    }
+
+public:
+    static const char* const defaultText;
+
+    explicit InvoiceTemplate(const string& text) {
+        size_t begin = text.find("{{#lines}}");
+        size_t end = text.find("{{/lines}}");
+        if (begin == string::npos || end == string::npos || end < begin) {
+            throw runtime_error("Invoice template needs a {{#lines}} ... {{/lines}} block");
+        }
+        string_view source = text;
+        compileSection(source.substr(0, begin), false, header);
+        compileSection(source.substr(begin + 10, end - begin - 10), true, line);
+        compileSection(source.substr(end + 10), false, footer);
+    }
+
+    static InvoiceTemplate load(const string& fileName) {
+        ifstream in(fileName, ios::binary);
+        if (!in.is_open()) throw runtime_error("Unable to open invoice template " + fileName);
+        stringstream text;
+        text << in.rdbuf();
+        return InvoiceTemplate(text.str());
+    }
+
+    // values holds one entry per InvoiceField
+    void renderHeader(const string_view* values, string& out) const { renderSection(header, values, out); }
+    void renderLine(const string_view* values, string& out) const { renderSection(line, values, out); }
+    void renderFooter(const string_view* values, string& out) const { renderSection(footer, values, out); }
+};
+
+const char* const InvoiceTemplate::defaultText =
+    "INVOICE {{number}}\n"
+    "Bill to: {{client}}\n"
+    "Period: {{period}}\n"
+    "------------------------------------------------------------\n"
+    "{{#lines}}{{date}}  {{milestone}} ({{type}}, {{freelancer}})  ${{amount}}\n{{/lines}}"
+    "------------------------------------------------------------\n"
+    "Milestones: {{count}}\n"
+    "Total due: ${{total}}\n";
+
+// Writes one invoice per client per calendar month (local time) of paid
+// milestones, as <directory>/<YYYY-MM>/<client>.txt. Receipts are grouped by
+// sorting (client, month, row) keys; worker threads then claim groups and
+// render each invoice into a private buffer that goes to disk whenever it
+// passes FLUSH_BYTES, so memory stays at one buffer per thread however many
+// invoices there are and however long each is. Files are written under a
+// temporary name and renamed once complete.
+class InvoiceGenerator {
+public:
+    struct Summary {
+        size_t invoices = 0;
+        size_t lines = 0;
+        uint64_t bytes = 0;
+        int64_t cents = 0;
+    };
+
+private:
+    static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+    struct Entry {
+        uint64_t key;  // Client id, then month index
+        uint32_t row;
+
+        bool operator<(const Entry& other) const {
+            return key < other.key || (key == other.key && row < other.row);
+        }
+    };
+
+    const InvoiceTemplate& layout;
+    string directory;
+
+    // FNV-1a of the client key: the same on every run and platform, unlike std::hash
+    static uint64_t stableHash(string_view text) {
+        uint64_t hash = 1469598103934665603ULL;
+        for (char c : text) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Readable part of the name plus the client's hash, since replacing
+    // characters alone lets "a+b@x.com" and "a_b@x.com" share a file
+    static string fileSafe(const string& name, uint64_t hash) {
+        string safe = name;
+        for (char& c : safe) {
+            if (!isalnum(static_cast<unsigned char>(c)) && c != '@' && c != '.' && c != '-' && c != '_') c = '_';
+        }
+        if (safe.empty() || safe[0] == '.') safe.insert(safe.begin(), '_');
+        char suffix[24];
+        snprintf(suffix, sizeof(suffix), "-%016llx", static_cast<unsigned long long>(hash));
+        return safe + suffix;
+    }
+
+    static size_t writeCents(int64_t cents, char* out) {
+        char* end = out;
+        uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+        if (cents < 0) *end++ = '-';
+        end = to_chars(end, end + 24, magnitude / 100).ptr;
+        *end++ = '.';
+        *end++ = static_cast<char>('0' + magnitude % 100 / 10);
+        *end++ = static_cast<char>('0' + magnitude % 10);
+        return static_cast<size_t>(end - out);
+    }
+
+    static int64_t monthStart(int64_t timestamp, int monthOffset) {
+        time_t when = static_cast<time_t>(timestamp);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &when);
+#else
+        localtime_r(&when, &local);
+#endif
+        local.tm_mday = 1;
+        local.tm_mon += monthOffset;
+        local.tm_hour = local.tm_min = local.tm_sec = 0;
+        local.tm_isdst = -1;
+        return static_cast<int64_t>(mktime(&local));
+    }
+
+    static string localDate(int64_t timestamp, const char* format) {
+        time_t when = static_cast<time_t>(timestamp);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &when);
+#else
+        localtime_r(&when, &local);
+#endif
+        char text[16];
+        strftime(text, sizeof(text), format, &local);
+        return text;
+    }
+
+    static void flush(ofstream& out, string& buffer, uint64_t& bytes) {
+        out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+        bytes += buffer.size();
+        buffer.clear();
+    }
+
+public:
+    InvoiceGenerator(const InvoiceTemplate& invoiceLayout, const string& outputDirectory)
+        : layout(invoiceLayout), directory(outputDirectory) {}
+
+    // Invoices every client with receipts in [from, to); months are whole calendar months
+    Summary generate(const ReceiptStore& store, int64_t from, int64_t to,
+        unsigned threads = thread::hardware_concurrency()) const {
+        return store.read([&](const ReceiptColumns& columns) {
+            size_t first = 0, last = columns.rows;
+            if (columns.timeOrdered) {
+                first = lower_bound(columns.times, columns.times + columns.rows, from) - columns.times;
+                last = max(first, static_cast<size_t>(lower_bound(columns.times, columns.times + columns.rows, to)
+                    - columns.times));
+            }
+            int64_t earliest = numeric_limits<int64_t>::max(), latest = numeric_limits<int64_t>::min();
+            for (size_t row = first; row < last; row++) {
+                if (columns.times[row] < from || columns.times[row] >= to) continue;
+                earliest = min(earliest, columns.times[row]);
+                latest = max(latest, columns.times[row]);
+            }
+            Summary summary;
+            if (earliest > latest) return summary;
+
+            // Month boundaries covering the receipts; month i is [starts[i], starts[i + 1])
+            vector<int64_t> starts;
+            vector<string> periods;
+            for (int m = 0; starts.empty() || starts.back() <= latest; m++) {
+                starts.push_back(monthStart(earliest, m));
+                periods.push_back(localDate(starts.back(), "%Y-%m"));
+            }
+            periods.pop_back();
+
+            vector<Entry> entries;
+            vector<char> invoiced(periods.size(), 0);  // Only months with receipts get a directory
+            entries.reserve(last - first);
+            for (size_t row = first; row < last; row++) {
+                int64_t when = columns.times[row];
+                if (when < from || when >= to) continue;
+                uint64_t month = static_cast<uint64_t>(upper_bound(starts.begin(), starts.end(), when) - starts.begin() - 1);
+                invoiced[month] = 1;
+                entries.push_back(Entry{static_cast<uint64_t>(columns.clients[row]) << 32 | month,
+                    static_cast<uint32_t>(row)});
+            }
+            for (size_t m = 0; m < periods.size(); m++) {
+                if (invoiced[m]) filesystem::create_directories(directory + "/" + periods[m]);
+            }
+            sort(entries.begin(), entries.end());
+            vector<size_t> groupStarts;
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (i == 0 || entries[i].key != entries[i - 1].key) groupStarts.push_back(i);
+            }
+            groupStarts.push_back(entries.size());
+            size_t groups = groupStarts.size() - 1;
+
+            threads = static_cast<unsigned>(max<size_t>(1, min<size_t>(max(1u, threads), groups)));
+            vector<Summary> partials(threads);
+            atomic<size_t> nextGroup(0);
+            atomic<bool> failed(false);
+            mutex errorLock;
+            string error;
+            vector<thread> workers;
+            for (unsigned t = 0; t < threads; t++) {
+                auto work = [&, t]() {
+                    Summary& mine = partials[t];
+                    string buffer;
+                    buffer.reserve(FLUSH_BYTES + 4096);
+                    string_view values[INVOICE_FIELD_COUNT];
+                    char number[32], count[24], total[32], amount[32];
+                    int64_t dayStart = 0, dayEnd = 0;
+                    string date;
+                    try {
+                        for (size_t g = nextGroup++; g < groups && !failed; g = nextGroup++) {
+                            const Entry* begin = entries.data() + groupStarts[g];
+                            const Entry* end = entries.data() + groupStarts[g + 1];
+                            uint32_t month = static_cast<uint32_t>(begin->key);
+                            const string& client = columns.clientNames->lookup(static_cast<uint32_t>(begin->key >> 32));
+                            int64_t cents = 0;
+                            for (const Entry* e = begin; e != end; e++) cents += columns.amounts[e->row];
+
+                            // Period plus client, so a number never changes with the other receipts in the run
+                            uint64_t clientHash = stableHash(client);
+                            snprintf(number, sizeof(number), "INV-%.4s%.2s-%016llx", periods[month].c_str(),
+                                periods[month].c_str() + 5, static_cast<unsigned long long>(clientHash));
+                            values[INVOICE_NUMBER] = number;
+                            values[INVOICE_CLIENT] = client;
+                            values[INVOICE_PERIOD] = periods[month];
+                            values[INVOICE_COUNT] = string_view(count,
+                                to_chars(count, count + sizeof(count), end - begin).ptr - count);
+                            values[INVOICE_TOTAL] = string_view(total, writeCents(cents, total));
+
+                            string path = directory + "/" + periods[month] + "/" + fileSafe(client, clientHash) + ".txt";
+                            string temporary = path + ".tmp";
+                            ofstream out(temporary, ios::binary | ios::trunc);
+                            if (!out.is_open()) throw runtime_error("Unable to write invoice " + temporary);
+                            layout.renderHeader(values, buffer);
+                            for (const Entry* e = begin; e != end; e++) {
+                                int64_t when = columns.times[e->row];
+                                if (when < dayStart || when >= dayEnd) {
+                                    date = localDate(when, "%Y-%m-%d");
+                                    dayStart = parseReportDate(date);
+                                    dayEnd = parseReportDate(localDate(dayStart + 26 * 3600, "%Y-%m-%d"));
+                                }
+                                values[LINE_DATE] = date;
+                                values[LINE_MILESTONE] = columns.milestoneNames->lookup(columns.milestones[e->row]);
+                                values[LINE_FREELANCER] = columns.freelancerNames->lookup(columns.freelancers[e->row]);
+                                values[LINE_TYPE] = columns.typeNames->lookup(columns.types[e->row]);
+                                values[LINE_AMOUNT] = string_view(amount, writeCents(columns.amounts[e->row], amount));
+                                layout.renderLine(values, buffer);
+                                if (buffer.size() >= FLUSH_BYTES) flush(out, buffer, mine.bytes);
+                            }
+                            layout.renderFooter(values, buffer);
+                            flush(out, buffer, mine.bytes);
+                            out.close();
+                            if (!out || rename(temporary.c_str(), path.c_str()) != 0) {
+                                throw runtime_error("Unable to write invoice " + path);
+                            }
+                            mine.invoices++;
+                            mine.lines += static_cast<size_t>(end - begin);
+                            mine.cents += cents;
+                        }
+                    }
+                    catch (const exception& e) {
+                        lock_guard<mutex> guard(errorLock);
+                        if (!failed.exchange(true)) error = e.what();
+                    }
+                };
+                if (t + 1 == threads) work();
+                else workers.emplace_back(work);
+            }
+            for (thread& worker : workers) worker.join();
+            if (failed) throw runtime_error(error);
+
+            for (const Summary& partial : partials) {
+                summary.invoices += partial.invoices;
+                summary.lines += partial.lines;
+                summary.bytes += partial.bytes;
+                summary.cents += partial.cents;
+            }
+            return summary;
+        });
+    }
+};
+
+void printInvoiceSummary(const InvoiceGenerator::Summary& summary, const string& directory, double seconds) {
+    cout << "Wrote " << summary.invoices << " invoice(s) covering " << summary.lines << " milestone(s), $"
+        << formatCents(summary.cents) << ", to " << directory << "/ in " << seconds << " s ("
+        << (seconds > 0 ? summary.invoices / seconds : 0) << " invoices/s, "
+        << (seconds > 0 ? summary.bytes / seconds / (1 << 20) : 0) << " MB/s)" << endl;
+}
+
+// Invoices every client for one month ("YYYY-MM") or for every month ("all") of a
+// receipt log, using the built-in layout or a template file
+void runInvoiceGeneration(const string& fileName, const string& directory, const string& month,
+    const string& templateFile) {
+    InvoiceTemplate layout = templateFile.empty() ? InvoiceTemplate(InvoiceTemplate::defaultText)
+        : InvoiceTemplate::load(templateFile);
+    int64_t from = numeric_limits<int64_t>::min();
+    int64_t to = numeric_limits<int64_t>::max();
+    if (month != "all") {
+        from = parseReportDate(month + "-01");
+        tm fields = {};
+        time_t when = static_cast<time_t>(from);
+#ifdef _WIN32
+        localtime_s(&fields, &when);
+#else
+        localtime_r(&when, &fields);
+#endif
+        fields.tm_mon++;
+        fields.tm_isdst = -1;
+        to = static_cast<int64_t>(mktime(&fields));
+    }
+    ReceiptStore* store = new ReceiptStore();
+    size_t loaded = store->loadReceiptFile(fileName);
+    cout << "Loaded " << loaded << " receipts from " << fileName << endl;
+    try {
+        auto start = chrono::steady_clock::now();
+        InvoiceGenerator::Summary summary = InvoiceGenerator(layout, directory).generate(*store, from, to);
+        printInvoiceSummary(summary, directory, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    catch (...) {
+        delete store;
+        throw;
+    }
+    delete store;
+}
+
+// Times invoicing rows synthetic receipts from rows / 200 clients over one year
+void runInvoiceBench(size_t rows, const string& directory) {
+    const int64_t yearStart = parseReportDate("2026-01-01");
+    const int64_t yearEnd = parseReportDate("2027-01-01");
+    ReceiptStore* store = new ReceiptStore();
+    store->reserve(rows);
+    store->generateSynthetic(rows, max<size_t>(1, rows / 200), 5000, yearStart, yearEnd, 42);
+    InvoiceTemplate layout(InvoiceTemplate::defaultText);
+    auto start = chrono::steady_clock::now();
+    InvoiceGenerator::Summary summary = InvoiceGenerator(layout, directory).generate(*store, yearStart, yearEnd);
+    printInvoiceSummary(summary, directory, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    delete store;
+}
+
+bool parseRollupGranularity(string_view name, RollupGranularity& granularity) {
+    for (int g = 0; g < ROLLUP_GRANULARITY_COUNT; g++) {
+        if (name == rollupGranularityNames[g]) {
+            granularity = static_cast<RollupGranularity>(g);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Rebuilds rollups from a receipt log and prints the per-bucket totals for [from, to)
+void runRollupReport(const string& fileName, RollupGranularity granularity, int64_t from, int64_t to) {
+    ReceiptStore* ledger = new ReceiptStore();
+    RollupStore* rollups = new RollupStore();
+    size_t loaded = ledger->loadReceiptFile(fileName);
+    auto start = chrono::steady_clock::now();
+    rollups->rebuild(*ledger);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    size_t buckets = 0, cells = 0;
+    rollups->footprint(buckets, cells);
+    cout << "Rolled up " << loaded << " receipts from " << fileName << " in " << seconds << " s ("
+        << buckets << " buckets, " << cells << " cells)" << endl;
+
+    cout << "\nTotals per " << rollupGranularityNames[granularity] << " (UTC):" << endl;
+    for (const RollupPoint& point : rollups->query(granularity, from, to, RollupFilter())) {
+        time_t when = static_cast<time_t>(point.bucketStart);
+        tm utc;
+#ifdef _WIN32
+        gmtime_s(&utc, &when);
+#else
+        gmtime_r(&when, &utc);
+#endif
+        char label[32];
+        strftime(label, sizeof(label), granularity == ROLLUP_HOUR ? "%Y-%m-%d %H:00" : granularity == ROLLUP_DAY
+            ? "%Y-%m-%d" : "%Y-%m", &utc);
+        cout << "  " << label << ": $" << formatCents(point.totals.cents) << " over " << point.totals.receipts
+            << " receipt(s)" << endl;
+    }
+    delete rollups;
+    delete ledger;
+}
+
+// Compares rollup queries with column scans over rows synthetic receipts: parallel
+// rebuild time, incremental update cost, and one client's monthly spend both ways
+void runRollupBench(size_t rows) {
+    const int64_t yearStart = parseReportDate("2026-01-01");
+    const int64_t yearEnd = parseReportDate("2027-01-01");
+    ReceiptStore* ledger = new ReceiptStore();
+    RollupStore* rollups = new RollupStore();
+    ledger->reserve(rows);
+    ledger->generateSynthetic(rows, 1000, 5000, yearStart, yearEnd, 42);
+
+    auto start = chrono::steady_clock::now();
+    rollups->rebuild(*ledger);
+    double rebuildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    size_t buckets = 0, cells = 0;
+    rollups->footprint(buckets, cells);
+    cout << "Rebuilt rollups of " << rows << " receipts in " << rebuildSeconds << " s with "
+        << thread::hardware_concurrency() << " thread(s): " << buckets << " buckets, " << cells << " cells" << endl;
+
+    const size_t updates = 100000;
+    PaymentRecord record;
+    record.clientEmail = "client7@example.com";
+    record.freelancerEmail = "freelancer42@example.com";
+    record.paymentType = "Escrow";
+    record.amount = 125.5;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < updates; i++) {
+        record.timestamp = static_cast<time_t>(yearStart + static_cast<int64_t>(i * 3600 % (yearEnd - yearStart)));
+        rollups->onPaymentReceipt(record);
+    }
+    double updateNanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / updates;
+    cout << "Incremental update: " << updateNanos << " ns per receipt" << endl;
+
+    RollupFilter filter;
+    filter.client = "client7@example.com";
+    start = chrono::steady_clock::now();
+    vector<RollupPoint> months = rollups->query(ROLLUP_MONTH, yearStart, yearEnd, filter);
+    double rollupMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    int64_t rollupCents = 0;
+    for (const RollupPoint& point : months) rollupCents += point.totals.cents;
+
+    start = chrono::steady_clock::now();
+    int64_t scanCents = 0;
+    for (const GroupTotal& total : ledger->sumBy(GROUP_BY_CLIENT, yearStart, yearEnd)) {
+        if (total.key == "client7@example.com") scanCents = total.cents;
+    }
+    double scanMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    cout << "Client spend for the year: rollup $" << formatCents(rollupCents) << " over " << months.size()
+        << " months in " << rollupMicros << " us, column scan $" << formatCents(scanCents) << " in "
+        << scanMicros << " us (scan excludes the " << updates << " incremental receipts)" << endl;
+    delete rollups;
+    delete ledger;
+}
+
+// Streams rows synthetic receipts with Zipf-like skew over a million freelancers
+// and clients into a TopNTracker, then checks its top 100 against exact totals
+void runTopNBench(size_t rows) {
+    const size_t population = 1000000;
+    const size_t n = 100;
+    TopNTracker* tracker = new TopNTracker();
+    unordered_map<string, int64_t> exactEarnings;
+    vector<string> names;
+    for (size_t i = 0; i < population; i++) names.push_back("user" + to_string(i) + "@example.com");
+
+    // Pareto-distributed ranks: a few parties account for most of the volume
+    mt19937_64 random(42);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    auto skewedRank = [&]() {
+        double rank = pow(1.0 - uniform(random), -1.0 / 0.4) - 1.0;
+        return static_cast<size_t>(min(rank, static_cast<double>(population - 1)));
+    };
+
+    vector<size_t> freelancers(rows), clients(rows);
+    vector<int64_t> amounts(rows);
+    for (size_t i = 0; i < rows; i++) {
+        freelancers[i] = skewedRank();
+        clients[i] = skewedRank();
+        amounts[i] = 5000 + static_cast<int64_t>(random() % 500000);
+    }
+
+    const int64_t weekStart = 4 * 86400 + 2900 * 7 * 86400;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < rows; i++) {
+        tracker->add(names[clients[i]], names[freelancers[i]], amounts[i], weekStart + static_cast<int64_t>(i % 86400));
+    }
+    double nanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / max<size_t>(1, rows);
+    for (size_t i = 0; i < rows; i++) exactEarnings[names[freelancers[i]]] += amounts[i];
+
+    vector<pair<int64_t, string>> exact;
+    for (const auto& entry : exactEarnings) exact.push_back(make_pair(entry.second, entry.first));
+    size_t exactCount = min(n, exact.size());
+    partial_sort(exact.begin(), exact.begin() + exactCount, exact.end(), greater<pair<int64_t, string>>());
+    exact.resize(exactCount);
+
+    vector<HeavyHitter> approximate = tracker->top(TOP_EARNERS, n);
+    size_t found = 0;
+    double worstError = 0.0;
+    for (const HeavyHitter& hitter : approximate) {
+        auto truth = exactEarnings.find(hitter.key);
+        double error = static_cast<double>(hitter.estimate - truth->second) / truth->second;
+        worstError = max(worstError, error);
+        for (const auto& entry : exact) {
+            if (entry.second == hitter.key) found++;
+        }
+    }
+    cout << "Streamed " << rows << " receipts at " << nanos << " ns each over " << exactEarnings.size()
+        << " distinct freelancers" << endl;
+    cout << "Top " << n << " earners: " << found << "/" << exactCount << " match the exact top " << n
+        << ", worst overestimate " << worstError * 100.0 << "%" << endl;
+    vector<HeavyHitter> busiest = tracker->top(TOP_CLIENT_MILESTONES, 3);
+    for (const HeavyHitter& hitter : busiest) {
+        cout << "  client " << hitter.key << ": " << hitter.lowerBound << "-" << hitter.estimate << " milestones" << endl;
+    }
+    delete tracker;
+}
+
+// Checks HyperLogLog estimates against exact sets: rows synthetic receipts over
+// 30 days are recorded from several threads, then saved to and reloaded from
+// sketchDirectory to show that persisted buckets merge back unchanged
+void runCardinalityBench(size_t rows, const string& sketchDirectory) {
+    const int64_t firstDay = 20454;  // 2026-01-01
+    const size_t clients = 200000, freelancers = 20000;
+    const char* const skills[] = {"C++", "Go", "Rust", "Python", "Design", "Writing", "SQL", "Testing"};
+    CardinalityTracker* tracker = new CardinalityTracker();
+    unsigned threads = max(2u, thread::hardware_concurrency());
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([=]() {
+            mt19937_64 random(t + 1);
+            for (size_t i = t; i < rows; i += threads) {
+                uint64_t bits = random();
+                size_t freelancer = (bits >> 20) % freelancers;
+                string skillSet = string(skills[freelancer % 8]) + ", " + skills[(freelancer / 8) % 8];
+                tracker->add("client" + to_string(bits % clients) + "@example.com",
+                    "freelancer" + to_string(freelancer) + "@example.com", skillSet,
+                    (firstDay + static_cast<int64_t>(i * 30 / rows)) * 86400 + static_cast<int64_t>(i % 86400));
+            }
+        });
+    }
+    for (thread& worker : workers) worker.join();
+    double nanos = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / max<size_t>(1, rows);
+
+    // Exact answers from the same generators
+    unordered_map<string, int> exactPayers;
+    unordered_map<string, int> exactClientsOfFreelancer0;
+    unordered_map<string, int> exactRustFreelancers;
+    for (unsigned t = 0; t < threads; t++) {
+        mt19937_64 random(t + 1);
+        for (size_t i = t; i < rows; i += threads) {
+            uint64_t bits = random();
+            size_t freelancer = (bits >> 20) % freelancers;
+            string client = "client" + to_string(bits % clients) + "@example.com";
+            if (i * 30 / rows < 7) exactPayers[client]++;
+            if (freelancer == 0) exactClientsOfFreelancer0[client]++;
+            if (freelancer % 8 == 2 || (freelancer / 8) % 8 == 2) exactRustFreelancers[to_string(freelancer)]++;
+        }
+    }
+
+    int64_t from = firstDay * 86400, to = (firstDay + 30) * 86400;
+    auto report = [](const char* metric, double estimate, size_t exact) {
+        cout << "  " << metric << ": estimate " << static_cast<uint64_t>(estimate + 0.5) << ", exact " << exact
+            << " (" << (exact ? 100.0 * (estimate - exact) / exact : 0.0) << "%)" << endl;
+    };
+    cout << "Recorded " << rows << " receipts from " << threads << " threads at " << nanos << " ns each, "
+        << tracker->footprint() / 1024 << " KB of sketches" << endl;
+    report("distinct payers in the first week", tracker->distinct(DISTINCT_PAYERS, from, from + 7 * 86400),
+        exactPayers.size());
+    report("distinct clients of freelancer0", tracker->distinct(DISTINCT_CLIENTS_PER_FREELANCER, from, to,
+        "freelancer0@example.com"), exactClientsOfFreelancer0.size());
+    report("distinct freelancers with Rust", tracker->distinct(DISTINCT_FREELANCERS_PER_SKILL, from, to, "rust"),
+        exactRustFreelancers.size());
+
+    error_code error;
+    filesystem::create_directories(sketchDirectory, error);
+    size_t files = tracker->save(sketchDirectory, "bench");
+    CardinalityTracker* reloaded = new CardinalityTracker();
+    reloaded->loadDirectory(sketchDirectory);
+    reloaded->loadDirectory(sketchDirectory);  // Merging is idempotent
+    cout << "Saved " << files << " daily sketch files to " << sketchDirectory << "; reloaded twice, payers estimate "
+        << static_cast<uint64_t>(reloaded->distinct(DISTINCT_PAYERS, from, from + 7 * 86400) + 0.5) << endl;
+    delete reloaded;
+    delete tracker;
+}
+
+// One in-flight milestone as seen by the payout forecaster
+struct PayoutExposure {
+    bool hourly = false;
+    bool escrow = false;
+    double hourlyRate = 0.0;
+    double hoursWorked = 0.0;  // Logged so far
+    double fixedAmount = 0.0;
+};
+
+// Counter-based generator (Philox4x32-10). Output is a pure function of the seed
+// and a 128-bit counter, so any thread can draw the numbers for any trial without
+// shared or per-thread state, and results do not depend on how work is split.
+class PhiloxRng {
+private:
+    uint32_t key0;
+    uint32_t key1;
+
+public:
+    explicit PhiloxRng(uint64_t seed) : key0(static_cast<uint32_t>(seed)), key1(static_cast<uint32_t>(seed >> 32)) {}
+
+    // Four independent 32-bit words for counter (a, b)
+    void generate(uint64_t a, uint64_t b, uint32_t out[4]) const {
+        uint32_t c0 = static_cast<uint32_t>(a), c1 = static_cast<uint32_t>(a >> 32);
+        uint32_t c2 = static_cast<uint32_t>(b), c3 = static_cast<uint32_t>(b >> 32);
+        uint32_t k0 = key0, k1 = key1;
+        for (int round = 0; round < 10; round++) {
+            uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+            uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+            uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+            uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+            c1 = static_cast<uint32_t>(p1);
+            c3 = static_cast<uint32_t>(p0);
+            c0 = n0;
+            c2 = n2;
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+    // Maps 32 random bits to the open interval (0, 1)
+    static double toUnit(uint32_t bits) {
+        return (bits + 0.5) * (1.0 / 4294967296.0);
+    }
+};
+
+// Model and run size for "--forecast"
+struct ForecastProfile {
+    string requestsFile = "project_requests.jsonl";  // In-flight projects, unless synthetic
+    size_t syntheticMilestones = 0;  // When set, forecast a random portfolio of this size instead
+    size_t trials = 1000000;
+    unsigned threads = thread::hardware_concurrency();
+    double horizonDays = 91.0;             // One quarter
+    double medianCompletionDays = 21.0;    // Log-normal time until a milestone completes
+    double completionSpread = 0.75;        // Its sigma
+    double medianRemainingHours = 20.0;    // Log-normal hours still to log on hourly milestones
+    double remainingHoursSpread = 0.6;
+    double cancellationRate = 0.05;        // Milestones that are never paid
+    uint64_t seed = 1;
+};
+
+enum ForecastSeries {
+    FORECAST_ESCROW,
+    FORECAST_DIRECT,
+    FORECAST_ALL,
+    FORECAST_SERIES_COUNT
+};
+
+const char* const forecastSeriesNames[FORECAST_SERIES_COUNT] = {"Escrow", "Direct", "All"};
+
+// Percentiles of cumulative payouts at the end of each week of the horizon
+struct PayoutForecast {
+    size_t milestones = 0;
+    size_t trials = 0;
+    int weeks = 0;
+    vector<double> levels;  // Percentile levels, e.g. 0.05
+    vector<double> values[FORECAST_SERIES_COUNT];  // [week * levels.size() + level]
+    vector<double> means[FORECAST_SERIES_COUNT];   // [week]
+
+    double at(ForecastSeries series, int week, size_t level) const {
+        return values[series][week * levels.size() + level];
+    }
+};
+
+// Monte Carlo forecast of payouts from in-flight milestones. Each trial draws,
+// per milestone, whether it is cancelled, when it completes and (for hourly
+// work) how many more hours are logged, then adds its payout to the week it
+// lands in. Random numbers come from a PhiloxRng keyed by (trial, milestone),
+// so results are identical for any thread count. Trials are split across
+// threads, each filling private histograms of the cumulative payout per series
+// and week; bin ranges are set from a small pilot run, and percentiles are
+// read from the merged histograms.
+class PayoutForecaster {
+private:
+    static constexpr size_t BINS = 4096;
+    static constexpr size_t PILOT_TRIALS = 2048;
+
+    const ForecastProfile& profile;
+    PhiloxRng rng;
+    int weeks;
+    // Milestones as parallel arrays for the inner loop
+    vector<uint8_t> hourly;
+    vector<uint8_t> series;
+    vector<double> rates;
+    vector<double> hoursWorked;
+    vector<double> fixedAmounts;
+
+    // Fills cumulative[series * weeks + week] for one trial
+    void runTrial(uint64_t trial, double* cumulative) const {
+        fill(cumulative, cumulative + FORECAST_SERIES_COUNT * weeks, 0.0);
+        uint32_t bits[4];
+        for (size_t m = 0; m < rates.size(); m++) {
+            rng.generate(trial, m, bits);
+            if (PhiloxRng::toUnit(bits[2]) < profile.cancellationRate) continue;
+            double radius = sqrt(-2.0 * log(PhiloxRng::toUnit(bits[0])));
+            double angle = 6.283185307179586 * PhiloxRng::toUnit(bits[1]);
+            double days = profile.medianCompletionDays * exp(profile.completionSpread * radius * cos(angle));
+            if (days >= profile.horizonDays) continue;
+            double amount = fixedAmounts[m];
+            if (hourly[m]) {
+                double remaining = profile.medianRemainingHours * exp(profile.remainingHoursSpread * radius * sin(angle));
+                amount = rates[m] * (hoursWorked[m] + remaining);
+            }
+            int week = min(weeks - 1, static_cast<int>(days / 7.0));
+            cumulative[series[m] * weeks + week] += amount;
+        }
+        for (int w = 0; w < weeks; w++) {
+            if (w > 0) {
+                cumulative[FORECAST_ESCROW * weeks + w] += cumulative[FORECAST_ESCROW * weeks + w - 1];
+                cumulative[FORECAST_DIRECT * weeks + w] += cumulative[FORECAST_DIRECT * weeks + w - 1];
+            }
+            cumulative[FORECAST_ALL * weeks + w] = cumulative[FORECAST_ESCROW * weeks + w]
+                + cumulative[FORECAST_DIRECT * weeks + w];
+        }
+    }
+
+public:
+    PayoutForecaster(const ForecastProfile& forecastProfile, const vector<PayoutExposure>& exposures)
+        : profile(forecastProfile), rng(forecastProfile.seed),
+        weeks(max(1, static_cast<int>(ceil(forecastProfile.horizonDays / 7.0)))) {
+        for (const PayoutExposure& exposure : exposures) {
+            hourly.push_back(exposure.hourly ? 1 : 0);
+            series.push_back(static_cast<uint8_t>(exposure.escrow ? FORECAST_ESCROW : FORECAST_DIRECT));
+            rates.push_back(exposure.hourlyRate);
+            hoursWorked.push_back(exposure.hoursWorked);
+            fixedAmounts.push_back(exposure.fixedAmount);
+        }
+    }
+
+    PayoutForecast run(const vector<double>& levels) const {
+        PayoutForecast forecast;
+        forecast.milestones = rates.size();
+        forecast.trials = max<size_t>(1, profile.trials);
+        forecast.weeks = weeks;
+        forecast.levels = levels;
+        size_t cells = FORECAST_SERIES_COUNT * static_cast<size_t>(weeks);
+
+        // Pilot trials bound each cell's range; later outliers land in the edge bins
+        vector<double> pilotLow(cells, numeric_limits<double>::max()), pilotHigh(cells, 0.0), cumulative(cells);
+        for (size_t t = 0; t < min(PILOT_TRIALS, forecast.trials); t++) {
+            runTrial(t, cumulative.data());
+            for (size_t c = 0; c < cells; c++) {
+                pilotLow[c] = min(pilotLow[c], cumulative[c]);
+                pilotHigh[c] = max(pilotHigh[c], cumulative[c]);
+            }
+        }
+        vector<double> origin(cells), binWidth(cells);
+        for (size_t c = 0; c < cells; c++) {
+            double spread = max(pilotHigh[c] - pilotLow[c], 1.0);
+            origin[c] = max(0.0, pilotLow[c] - spread);
+            binWidth[c] = (pilotHigh[c] + spread - origin[c]) / BINS;
+        }
+
+        unsigned threads = static_cast<unsigned>(max<size_t>(1, min<size_t>(max(1u, profile.threads),
+            forecast.trials / 1000 + 1)));
+        vector<vector<uint64_t>> histograms(threads);
+        vector<vector<double>> sums(threads, vector<double>(cells, 0.0));
+        vector<vector<uint64_t>> zeros(threads, vector<uint64_t>(cells, 0));
+        // Smallest and largest value seen per bin, so point masses such as one fixed price come out exact
+        vector<vector<double>> binLow(threads), binHigh(threads);
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            auto work = [&, t]() {
+                vector<uint64_t>& histogram = histograms[t];
+                histogram.assign(cells * BINS, 0);
+                binLow[t].assign(cells * BINS, numeric_limits<double>::max());
+                binHigh[t].assign(cells * BINS, 0.0);
+                vector<double> trialTotals(cells);
+                size_t begin = forecast.trials * t / threads, end = forecast.trials * (t + 1) / threads;
+                for (size_t trial = begin; trial < end; trial++) {
+                    runTrial(trial, trialTotals.data());
+                    for (size_t c = 0; c < cells; c++) {
+                        if (trialTotals[c] == 0.0) {
+                            zeros[t][c]++;  // Nothing paid yet is common, so it is counted exactly
+                            continue;
+                        }
+                        double bin = (trialTotals[c] - origin[c]) / binWidth[c];
+                        size_t index = bin <= 0.0 ? 0 : min(BINS - 1, static_cast<size_t>(bin));
+                        histogram[c * BINS + index]++;
+                        binLow[t][c * BINS + index] = min(binLow[t][c * BINS + index], trialTotals[c]);
+                        binHigh[t][c * BINS + index] = max(binHigh[t][c * BINS + index], trialTotals[c]);
+                        sums[t][c] += trialTotals[c];
+                    }
+                }
+            };
+            if (t + 1 == threads) work();
+            else workers.emplace_back(work);
+        }
+        for (thread& worker : workers) worker.join();
+
+        for (int s = 0; s < FORECAST_SERIES_COUNT; s++) {
+            forecast.values[s].resize(weeks * levels.size());
+            forecast.means[s].resize(weeks);
+        }
+        vector<uint64_t> merged(BINS);
+        vector<double> low(BINS), high(BINS);
+        for (size_t c = 0; c < cells; c++) {
+            int s = static_cast<int>(c / weeks), week = static_cast<int>(c % weeks);
+            fill(merged.begin(), merged.end(), 0);
+            fill(low.begin(), low.end(), numeric_limits<double>::max());
+            fill(high.begin(), high.end(), 0.0);
+            double sum = 0.0;
+            uint64_t zeroTrials = 0;
+            for (unsigned t = 0; t < threads; t++) {
+                for (size_t b = 0; b < BINS; b++) {
+                    merged[b] += histograms[t][c * BINS + b];
+                    low[b] = min(low[b], binLow[t][c * BINS + b]);
+                    high[b] = max(high[b], binHigh[t][c * BINS + b]);
+                }
+                sum += sums[t][c];
+                zeroTrials += zeros[t][c];
+            }
+            forecast.means[s][week] = sum / forecast.trials;
+            for (size_t l = 0; l < levels.size(); l++) {
+                double target = levels[l] * forecast.trials;
+                if (target <= zeroTrials) {
+                    forecast.values[s][week * levels.size() + l] = 0.0;
+                    continue;
+                }
+                uint64_t below = zeroTrials;
+                size_t b = 0;
+                while (b + 1 < BINS && below + merged[b] < target) below += merged[b++];
+                double within = merged[b] ? min(1.0, max(0.0, (target - below) / merged[b])) : 0.5;
+                forecast.values[s][week * levels.size() + l] = merged[b] ? low[b] + within * (high[b] - low[b])
+                    : origin[c] + (b + within) * binWidth[c];
+            }
+        }
+        return forecast;
+    }
+};
+
+// What happens to an undisputed escrow hold when its deadline passes
+enum EscrowExpiryAction {
+    ESCROW_RELEASE,  // Pay the freelancer as if the milestone had been completed
+    ESCROW_REFUND    // Return the funds to the client
+};
+
+// Escrow holds of open projects, indexed by expiry in a min-heap so a sweep
+// only touches holds that are due. Closing or disputing a hold leaves its heap
+// entry behind; stale entries are skipped when they surface and the heap is
+// rebuilt once they outnumber the live holds.
+class EscrowHoldBook {
+public:
+    struct Expiry {
+        long projectId;
+        int64_t expiresAt;
+    };
+
+private:
+    struct Hold {
+        int64_t expiresAt;
+        bool disputed;
+    };
+
+    typedef pair<int64_t, long> Entry;  // (expires at, project id)
+    priority_queue<Entry, vector<Entry>, greater<Entry>> byExpiry;
+    unordered_map<long, Hold> holds;
+    size_t disputed = 0;
+
+    void compact() {
+        vector<Entry> live;
+        live.reserve(holds.size() - disputed);
+        for (const auto& entry : holds) {
+            if (!entry.second.disputed) live.push_back(Entry(entry.second.expiresAt, entry.first));
+        }
+        byExpiry = priority_queue<Entry, vector<Entry>, greater<Entry>>(greater<Entry>(), move(live));
+    }
+
+public:
+    void open(long projectId, int64_t expiresAt) {
+        close(projectId);
+        holds[projectId] = Hold{expiresAt, false};
+        byExpiry.push(Entry(expiresAt, projectId));
+    }
+
+    // Forgets the hold, e.g. once the milestone is paid or cancelled
+    void close(long projectId) {
+        auto it = holds.find(projectId);
+        if (it == holds.end()) return;
+        if (it->second.disputed) disputed--;
+        holds.erase(it);
+        if (byExpiry.size() > 2 * holds.size() + 1024) compact();
+    }
+
+    // Keeps the hold until the project is completed or cancelled; false if there is none
+    bool dispute(long projectId) {
+        auto it = holds.find(projectId);
+        if (it == holds.end()) return false;
+        if (!it->second.disputed) {
+            it->second.disputed = true;
+            disputed++;
+        }
+        return true;
+    }
+
+    size_t size() const { return holds.size(); }
+    size_t disputedCount() const { return disputed; }
+
+    // Removes up to limit undisputed holds that expired by now, earliest first, into out
+    size_t takeExpired(int64_t now, size_t limit, vector<Expiry>& out) {
+        size_t taken = 0;
+        while (taken < limit && !byExpiry.empty() && byExpiry.top().first <= now) {
+            Entry entry = byExpiry.top();
+            byExpiry.pop();
+            auto it = holds.find(entry.second);
+            if (it == holds.end() || it->second.disputed || it->second.expiresAt != entry.first) continue;
+            holds.erase(it);
+            out.push_back(Expiry{entry.second, entry.first});
+            taken++;
+        }
+        return taken;
+    }
+};
+
+// Long-lived engine state shared by the network front ends: open projects
+// by id plus running balances per user email
+class EngineService {
+public:
+    struct Balance {
+        double earned = 0.0;  // Paid to the user as a freelancer
+        double spent = 0.0;   // Paid by the user as a client
+    };
+
+private:
+    unordered_map<long, Project*> projects;
+    unordered_set<long> completing;  // Running their workflow outside the lock; not to be touched
+    unordered_map<string, Balance> balances;
+    long nextProjectId;
+    string receiptFile;
+    EscrowHoldBook escrowHolds;
+    int64_t escrowHoldSeconds;  // 0 leaves escrow projects open until completed or cancelled
+    EscrowExpiryAction escrowAction;
+    mutable mutex lock;
+
+    Project* findProject(long id) const {
+        auto it = projects.find(id);
+        if (it == projects.end()) {
+            throw UnknownProjectException(id);
+        }
+        if (completing.count(id)) {
+            throw runtime_error("Project " + to_string(id) + " is being completed");
+        }
+        return it->second;
+    }
+
+    // Completes an expired escrow milestone and screens it like a workflow
+    // settlement; returns the amount to pay or throws if it cannot be paid
+    static double release(Project* project, uint8_t& anomalies) {
+        Milestone* milestone = project->getMilestone();
+        milestone->complete();
+        double amount = milestone->calculatePayment();
+        if (amount <= 0 || !isfinite(amount)) {
+            throw PaymentFailureException();
+        }
+        if (AnomalyScorer* scorer = AnomalyScorer::active()) {
+            anomalies = scorer->screen(*project->getClient(), *project->getFreelancer(), *milestone, amount);
+        }
+        milestone->paymentMethod->processPayment();
+        return amount;
+    }
+
+    // Adds a settled project's payment to both parties' balances
+    double credit(Project* project) {
+        double amount = project->getMilestone()->calculatePayment();
+        balances[UserDirectory::keyFor(project->getFreelancer()->getEmail())].earned += amount;
+        balances[UserDirectory::keyFor(project->getClient()->getEmail())].spent += amount;
+        return amount;
+    }
+
+public:
+    EngineService(const string& receiptFileName)
+        : nextProjectId(1), receiptFile(receiptFileName), escrowHoldSeconds(0), escrowAction(ESCROW_RELEASE) {
+    }
+
+    EngineService(const EngineService&) = delete;
+    EngineService& operator=(const EngineService&) = delete;
+
+    ~EngineService() {
+        for (auto& entry : projects) delete entry.second;
+        EngineMetrics::adjustGauge(GAUGE_OPEN_PROJECTS, -static_cast<int64_t>(projects.size()));
+    }
+
+    long createProject(const ProjectRequest& req) {
+        Project* project = buildProject(req, new Logger(receiptFile));
+        lock_guard<mutex> guard(lock);
+        long id = nextProjectId++;
+        projects[id] = project;
+        if (req.escrow && escrowHoldSeconds > 0) {
+            escrowHolds.open(id, static_cast<int64_t>(time(nullptr)) + escrowHoldSeconds);
+        }
+        EngineMetrics::adjustGauge(GAUGE_OPEN_PROJECTS, 1);
+        return id;
+    }
+
+    // Escrow projects created from now on expire after holdSeconds unless disputed
+    void setEscrowExpiry(int64_t holdSeconds, EscrowExpiryAction action) {
+        lock_guard<mutex> guard(lock);
+        escrowHoldSeconds = holdSeconds;
+        escrowAction = action;
+    }
+
+    // Stops an escrow project's hold from expiring; it waits for COMPLETE or CANCEL
+    void disputeProject(long id) {
+        lock_guard<mutex> guard(lock);
+        findProject(id);
+        if (!escrowHolds.dispute(id)) {
+            throw runtime_error("Project " + to_string(id) + " has no escrow hold");
+        }
+    }
+
+    // Settles up to limit escrow holds that expired by now with one receipt
+    // write for the batch; returns how many expired holds were handled.
+    // A hold that cannot be released, e.g. hourly work with no hours logged,
+    // stays in the book as disputed and waits for COMPLETE or CANCEL.
+    size_t sweepEscrow(int64_t now, size_t limit) {
+        lock_guard<mutex> guard(lock);
+        vector<EscrowHoldBook::Expiry> expired;
+        if (escrowHolds.takeExpired(now, limit, expired) == 0) return 0;
+
+        vector<PaymentRecord> records;
+        vector<EscrowHoldBook::Expiry> settled;
+        size_t deferred = 0;
+        records.reserve(expired.size());
+        settled.reserve(expired.size());
+        for (const EscrowHoldBook::Expiry& expiry : expired) {
+            if (completing.count(expiry.projectId)) {
+                // COMPLETE closes the hold if it succeeds; otherwise the hold is due again
+                escrowHolds.open(expiry.projectId, expiry.expiresAt);
+                deferred++;
+                continue;
+            }
+            Project* project = projects.at(expiry.projectId);
+            Milestone* milestone = project->getMilestone();
+            PaymentRecord record;
+            record.clientName = project->getClient()->getName();
+            record.clientEmail = project->getClient()->getEmail();
+            record.milestoneTitle = milestone->getTitle();
+            if (escrowAction == ESCROW_RELEASE) {
+                try {
+                    record.amount = release(project, record.anomalies);
+                }
+                catch (const exception& e) {
+                    escrowHolds.open(expiry.projectId, expiry.expiresAt);
+                    escrowHolds.dispute(expiry.projectId);
+                    EngineMetrics::increment(METRIC_ESCROW_HELD);
+                    cerr << "Escrow hold of project " << expiry.projectId << " not released: " << e.what() << endl;
+                    continue;
+                }
+                record.freelancerName = project->getFreelancer()->getName();
+                record.freelancerEmail = project->getFreelancer()->getEmail();
+                if (const Freelancer* worker = dynamic_cast<const Freelancer*>(project->getFreelancer())) {
+                    record.freelancerSkills = worker->getSkillSet();
+                }
+                record.paymentType = milestone->paymentMethod->getPaymentType();
+            }
+            else {
+                // Back to the client only: no freelancer line, and no earnings anywhere
+                record.paymentType = ESCROW_REFUND_TYPE;
+                record.amount = milestone->paymentMethod->getAmount();  // What the client paid in
+            }
+            record.timestamp = static_cast<time_t>(now);
+            records.push_back(record);
+            settled.push_back(expiry);
+        }
+        try {
+            Logger(receiptFile).logPaymentReceipts(records);
+        }
+        catch (...) {
+            // Nothing was credited or closed, so the holds go back as they were and are due again
+            for (const EscrowHoldBook::Expiry& expiry : settled) escrowHolds.open(expiry.projectId, expiry.expiresAt);
+            throw;
+        }
+
+        for (const EscrowHoldBook::Expiry& expiry : settled) {
+            Project* project = projects.at(expiry.projectId);
+            if (escrowAction == ESCROW_RELEASE) credit(project);
+            projects.erase(expiry.projectId);
+            delete project;
+        }
+        EngineMetrics::adjustGauge(GAUGE_OPEN_PROJECTS, -static_cast<int64_t>(settled.size()));
+        EngineMetrics::increment(escrowAction == ESCROW_RELEASE ? METRIC_ESCROW_RELEASED : METRIC_ESCROW_REFUNDED,
+            settled.size());
+        return expired.size() - deferred;
+    }
+
+    void escrowHoldCounts(size_t& held, size_t& disputed) const {
+        lock_guard<mutex> guard(lock);
+        held = escrowHolds.size();
+        disputed = escrowHolds.disputedCount();
+    }
+
+    void logHours(long id, double hours) {
+        lock_guard<mutex> guard(lock);
+        HourlyMilestone* hourly = dynamic_cast<HourlyMilestone*>(findProject(id)->getMilestone());
+        if (!hourly) {
+            throw runtime_error("Project " + to_string(id) + " is not hourly");
+        }
+        hourly->setHoursWorked(hours);
+    }
+
+    // Runs the project workflow. On success the project is closed and the paid
+    // amount returned; on failure it stays open so it can be fixed and retried.
+    // The workflow writes the receipt, so it runs outside the lock with the
+    // project marked as completing.
+    double completeProject(long id) {
+        Project* project;
+        {
+            lock_guard<mutex> guard(lock);
+            project = findProject(id);
+            completing.insert(id);
+        }
+        bool completed = project->executeProjectWorkflow();
+        lock_guard<mutex> guard(lock);
+        completing.erase(id);
+        if (!completed) {
+            throw WorkflowFailedException(to_string(id), project->getFailure());
+        }
+        double amount = credit(project);
+        projects.erase(id);
+        escrowHolds.close(id);
+        EngineMetrics::adjustGauge(GAUGE_OPEN_PROJECTS, -1);
+        delete project;
+        return amount;
+    }
+
+    // Creates and completes a project in one step, e.g. a retainer instance;
+    // a failed workflow leaves nothing open
+    double runProject(const ProjectRequest& req) {
+        Project* project = buildProject(req, new Logger(receiptFile));
+        if (!project->executeProjectWorkflow()) {
+            WorkflowFailure cause = project->getFailure();
+            delete project;
+            throw WorkflowFailedException(string(req.projectName), cause);
+        }
+        lock_guard<mutex> guard(lock);
+        double amount = credit(project);
+        delete project;
+        return amount;
+    }
+
+    Balance getBalance(const string& email) const {
+        lock_guard<mutex> guard(lock);
+        auto it = balances.find(UserDirectory::keyFor(email));
+        return it == balances.end() ? Balance() : it->second;
+    }
+
+    // Drops an open project without paying it
+    void cancelProject(long id) {
+        lock_guard<mutex> guard(lock);
+        Project* project = findProject(id);
+        projects.erase(id);
+        escrowHolds.close(id);
+        EngineMetrics::adjustGauge(GAUGE_OPEN_PROJECTS, -1);
+        delete project;
+    }
+
+    size_t openProjects() const {
+        lock_guard<mutex> guard(lock);
+        return projects.size();
+    }
+
+    // Milestones of open projects, in project id order, for payout forecasting
+    vector<PayoutExposure> payoutExposures() const {
+        lock_guard<mutex> guard(lock);
+        vector<pair<long, PayoutExposure>> open;
+        for (const auto& entry : projects) {
+            if (completing.count(entry.first)) continue;
+            Milestone* milestone = entry.second->getMilestone();
+            PayoutExposure exposure;
+            exposure.escrow = dynamic_cast<Escrow*>(milestone->paymentMethod) != nullptr;
+            if (HourlyMilestone* hourly = dynamic_cast<HourlyMilestone*>(milestone)) {
+                exposure.hourly = true;
+                exposure.hourlyRate = hourly->getHourlyRate();
+                exposure.hoursWorked = hourly->getHoursWorked();
+            }
+            else if (FixedPriceMilestone* fixed = dynamic_cast<FixedPriceMilestone*>(milestone)) {
+                exposure.fixedAmount = fixed->getFixedAmount();
+            }
+            else {
+                continue;
+            }
+            open.push_back(make_pair(entry.first, exposure));
+        }
+        sort(open.begin(), open.end(), [](const pair<long, PayoutExposure>& a, const pair<long, PayoutExposure>& b) {
+            return a.first < b.first;
+        });
+        vector<PayoutExposure> exposures;
+        for (const auto& entry : open) exposures.push_back(entry.second);
+        return exposures;
+    }
+};
+
+// Background thread settling expired escrow holds: every interval it sweeps
+// batches of up to batchSize holds until fewer than a full batch are due
+class EscrowSweeper {
+private:
+    EngineService& engine;
+    chrono::milliseconds interval;
+    size_t batchSize;
+    atomic<bool> stopping;
+    mutex wakeLock;
+    condition_variable wake;
+    thread worker;
+
+public:
+    EscrowSweeper(EngineService& service, chrono::milliseconds period, size_t batch)
+        : engine(service), interval(period), batchSize(batch), stopping(false) {
+        worker = thread([this]() {
+            unique_lock<mutex> guard(wakeLock);
+            while (!stopping) {
+                guard.unlock();
+                try {
+                    while (!stopping && engine.sweepEscrow(static_cast<int64_t>(time(nullptr)), batchSize) == batchSize) {}
+                }
+                catch (const exception& e) {
+                    cerr << "Escrow sweep failed: " << e.what() << endl;
+                }
+                guard.lock();
+                wake.wait_for(guard, interval, [this]() { return stopping.load(); });
+            }
+        });
+    }
+
+    EscrowSweeper(const EscrowSweeper&) = delete;
+    EscrowSweeper& operator=(const EscrowSweeper&) = delete;
+
+    ~EscrowSweeper() {
+        {
+            lock_guard<mutex> guard(wakeLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+};
+
+// Opens holdCount escrow projects with 14-day holds, disputes one in ten and sweeps them
+// after the deadline in batches, then times the hold book alone against a
+// month of one-minute sweeps over holds with spread-out deadlines
+void runEscrowBench(size_t holdCount, size_t batchSize, const string& receiptFile) {
+    remove(receiptFile.c_str());
+    EngineService* engine = new EngineService(receiptFile);
+    engine->setEscrowExpiry(14 * 86400, ESCROW_RELEASE);
+    ProjectRequest req;
+    req.clientName = "Client";
+    req.clientEmail = "client@company.com";
+    req.freelancerName = "Freelancer";
+    req.freelancerEmail = "dev@freelance.com";
+    req.freelancerSkills = "Testing";
+    req.freelancerRate = 50.0;
+    req.projectName = "Escrow bench";
+    req.milestoneTitle = "Delivery";
+    req.escrow = true;
+    req.amount = 250.0;
+    size_t disputes = 0;
+    {
+        ConsoleSilencer silence;
+        for (size_t i = 0; i < holdCount; i++) {
+            long id = engine->createProject(req);
+            if (i % 10 == 0) {
+                engine->disputeProject(id);
+                disputes++;
+            }
+        }
+    }
+
+    int64_t deadline = static_cast<int64_t>(time(nullptr)) + 14 * 86400 + 1;
+    size_t settled = 0, batches = 0;
+    auto begin = chrono::steady_clock::now();
+    {
+        ConsoleSilencer silence;
+        size_t swept;
+        while ((swept = engine->sweepEscrow(deadline, batchSize)) > 0) {
+            settled += swept;
+            batches++;
+        }
+    }
+    double sweepSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    EngineService::Balance paid = engine->getBalance("dev@freelance.com");
+    error_code error;
+    uintmax_t bytes = filesystem::file_size(receiptFile, error);
+    cout << "Released " << settled << " of " << holdCount << " holds (" << disputes << " disputed, "
+        << engine->openProjects() << " still open) in " << batches << " batch write(s) of up to " << batchSize
+        << ": " << sweepSeconds << " s, " << (settled ? sweepSeconds * 1e9 / settled : 0) << " ns per hold, "
+        << (error ? 0 : bytes) << " receipt bytes, " << formatCents(llround(paid.earned * 100.0)) << " credited" << endl;
+    delete engine;
+
+    // Hold book only: deadlines spread over 30 days, swept once a simulated minute
+    EscrowHoldBook* book = new EscrowHoldBook();
+    mt19937_64 random(7);
+    const int64_t start = 0;
+    begin = chrono::steady_clock::now();
+    for (size_t i = 0; i < holdCount; i++) {
+        book->open(static_cast<long>(i), start + static_cast<int64_t>(random() % (30 * 86400)));
+        if (random() % 10 == 0) book->close(static_cast<long>(random() % (i + 1)));
+    }
+    double openSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    size_t live = book->size(), expired = 0, sweeps = 0;
+    vector<EscrowHoldBook::Expiry> due;
+    begin = chrono::steady_clock::now();
+    for (int64_t now = start; now <= start + 30 * 86400; now += 60) {
+        do {
+            due.clear();
+            expired += book->takeExpired(now, batchSize, due);
+            sweeps++;
+        } while (due.size() == batchSize);
+    }
+    double bookSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "Hold book: " << live << " live holds opened in " << openSeconds << " s; " << sweeps
+        << " sweeps expired " << expired << " in " << bookSeconds << " s ("
+        << (expired ? bookSeconds * 1e9 / expired : 0) << " ns per expiry)" << endl;
+    delete book;
+}
+
+ForecastProfile parseForecastProfile(int argc, char* argv[], int first) {
+    ForecastProfile profile;
+    for (int i = first; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        const char* value = argv[i + 1];
+        if (option == "--requests") profile.requestsFile = value;
+        else if (option == "--milestones") profile.syntheticMilestones = strtoull(value, nullptr, 10);
+        else if (option == "--trials") profile.trials = strtoull(value, nullptr, 10);
+        else if (option == "--threads") profile.threads = static_cast<unsigned>(atoi(value));
+        else if (option == "--horizon") profile.horizonDays = atof(value);
+        else if (option == "--completion-days") profile.medianCompletionDays = atof(value);
+        else if (option == "--completion-spread") profile.completionSpread = atof(value);
+        else if (option == "--remaining-hours") profile.medianRemainingHours = atof(value);
+        else if (option == "--hours-spread") profile.remainingHoursSpread = atof(value);
+        else if (option == "--cancellations") profile.cancellationRate = atof(value);
+        else if (option == "--seed") profile.seed = strtoull(value, nullptr, 10);
+        else cerr << "Ignoring unknown forecast option " << option << endl;
+    }
+    return profile;
+}
+
+// Forecasts payouts over the horizon for the projects in a request file (opened
+// but not completed) or a synthetic portfolio, printing weekly percentile curves
+void runPayoutForecast(const ForecastProfile& profile) {
+    vector<PayoutExposure> exposures;
+    if (profile.syntheticMilestones > 0) {
+        mt19937_64 random(profile.seed);
+        for (size_t i = 0; i < profile.syntheticMilestones; i++) {
+            PayoutExposure exposure;
+            exposure.hourly = random() % 2 == 0;
+            exposure.escrow = random() % 2 == 0;
+            exposure.hourlyRate = 20.0 + static_cast<double>(random() % 130);
+            exposure.hoursWorked = exposure.hourly ? static_cast<double>(random() % 40) : 0.0;
+            exposure.fixedAmount = exposure.hourly ? 0.0 : 100.0 * (1 + random() % 50);
+            exposures.push_back(exposure);
+        }
+    }
+    else {
+        ProjectRequestParser parser(profile.requestsFile);
+        if (!parser.isOpen()) {
+            cerr << "Unable to open request file: " << profile.requestsFile << endl;
+            return;
+        }
+        EngineService* engine = new EngineService("payment_receipts.txt");
+        ProjectRequest req;
+        ProjectRequestParser::Status status;
+        while ((status = parser.next(req)) != ProjectRequestParser::END) {
+            if (status == ProjectRequestParser::MALFORMED) continue;
+            try {
+                engine->createProject(req);
+            }
+            catch (const exception& e) {
+                cerr << "Skipping request on line " << parser.getLineNumber() << ": " << e.what() << endl;
+            }
+        }
+        exposures = engine->payoutExposures();
+        delete engine;
+    }
+
+    const vector<double> levels = {0.05, 0.25, 0.5, 0.75, 0.95};
+    PayoutForecaster forecaster(profile, exposures);
+    auto start = chrono::steady_clock::now();
+    PayoutForecast forecast = forecaster.run(levels);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Forecast of " << forecast.milestones << " in-flight milestone(s) over " << profile.horizonDays
+        << " days: " << forecast.trials << " trials in " << seconds << " s ("
+        << (seconds > 0 ? forecast.trials * forecast.milestones / seconds / 1e6 : 0) << "M samples/s)" << endl;
+
+    char line[160];
+    for (int s = 0; s < FORECAST_SERIES_COUNT; s++) {
+        cout << "\nCumulative " << forecastSeriesNames[s] << " payouts ($)" << endl;
+        snprintf(line, sizeof(line), "%5s %13s %13s %13s %13s %13s %13s", "week", "mean", "P5", "P25", "P50", "P75", "P95");
+        cout << line << endl;
+        for (int w = 0; w < forecast.weeks; w++) {
+            ForecastSeries series = static_cast<ForecastSeries>(s);
+            snprintf(line, sizeof(line), "%5d %13.0f %13.0f %13.0f %13.0f %13.0f %13.0f", w + 1, forecast.means[s][w],
+                forecast.at(series, w, 0), forecast.at(series, w, 1), forecast.at(series, w, 2),
+                forecast.at(series, w, 3), forecast.at(series, w, 4));
+            cout << line << endl;
+        }
+    }
+}
+
+// Hierarchical timing wheel: LEVELS rings of 256 slots, each slot of a level
+// spanning all 256 slots of the level below. Timers are intrusive list nodes
+// indexed by id, so scheduling and cancelling are O(1). Each tick expires one
+// level-0 slot and, every 256 ticks, cascades one slot of the level above
+// into the levels below, so the cost per tick does not grow with the number
+// of timers.
+class TimerWheel {
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 8;
+    static constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    static constexpr uint32_t NONE = numeric_limits<uint32_t>::max();
+
+    struct Node {
+        uint64_t due = 0;
+        uint32_t next = NONE;
+        uint32_t prev = NONE;
+        int8_t level = -1;  // -1 while not scheduled
+        uint8_t slot = 0;
+    };
+
+    vector<Node> nodes;
+    uint32_t heads[LEVELS][SLOTS];
+    uint64_t current;
+    size_t scheduled = 0;
+
+    // Files a node by how far away it is; nothing goes earlier than earliest
+    void link(uint32_t id, uint64_t earliest) {
+        Node& node = nodes[id];
+        uint64_t due = max(node.due, earliest);
+        uint64_t distance = due - current;
+        int level = 0;
+        while (level + 1 < LEVELS && distance >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) level++;
+        node.level = static_cast<int8_t>(level);
+        node.slot = static_cast<uint8_t>((due >> (SLOT_BITS * level)) & (SLOTS - 1));
+        node.prev = NONE;
+        node.next = heads[level][node.slot];
+        if (node.next != NONE) nodes[node.next].prev = id;
+        heads[level][node.slot] = id;
+    }
+
+    void unlink(uint32_t id) {
+        Node& node = nodes[id];
+        if (node.prev != NONE) nodes[node.prev].next = node.next;
+        else heads[node.level][node.slot] = node.next;
+        if (node.next != NONE) nodes[node.next].prev = node.prev;
+        node.level = -1;
+    }
+
+public:
+    explicit TimerWheel(uint64_t now) : current(now) {
+        for (int level = 0; level < LEVELS; level++) fill(heads[level], heads[level] + SLOTS, NONE);
+    }
+
+    uint64_t now() const { return current; }
+    size_t size() const { return scheduled; }
+
+    bool isScheduled(uint32_t id) const { return id < nodes.size() && nodes[id].level >= 0; }
+
+    // (Re)arms timer id to expire on tick due, or on the next tick if due has passed
+    void schedule(uint32_t id, uint64_t due) {
+        if (id >= nodes.size()) nodes.resize(static_cast<size_t>(id) + 1);
+        if (isScheduled(id)) unlink(id);
+        else scheduled++;
+        nodes[id].due = due;
+        link(id, current + 1);
+    }
+
+    void cancel(uint32_t id) {
+        if (!isScheduled(id)) return;
+        unlink(id);
+        scheduled--;
+    }
+
+    // Advances one tick and appends the timers that expire on it to expired
+    void tick(vector<uint32_t>& expired) {
+        current++;
+        int top = 0;
+        while (top + 1 < LEVELS && (current & ((uint64_t(1) << (SLOT_BITS * (top + 1))) - 1)) == 0) top++;
+        for (int level = top; level >= 1; level--) {  // Highest first, so nodes can drop several levels at once
+            uint32_t slot = static_cast<uint32_t>((current >> (SLOT_BITS * level)) & (SLOTS - 1));
+            uint32_t id = heads[level][slot];
+            heads[level][slot] = NONE;
+            while (id != NONE) {
+                uint32_t next = nodes[id].next;
+                link(id, current);
+                id = next;
+            }
+        }
+        uint32_t slot = static_cast<uint32_t>(current & (SLOTS - 1));
+        uint32_t id = heads[0][slot];
+        heads[0][slot] = NONE;
+        while (id != NONE) {
+            uint32_t next = nodes[id].next;
+            nodes[id].level = -1;
+            scheduled--;
+            expired.push_back(id);
+            id = next;
+        }
+    }
+};
+
+// What each instance of a recurring milestone looks like: the fields of a fixed-price
+// project request, owned
+struct RetainerTerms {
+    string clientName, clientEmail, clientCompany;
+    string freelancerName, freelancerEmail, freelancerSkills;
+    double freelancerRate = 0.0;
+    string projectName, milestoneTitle, milestoneDesc;
+    bool escrow = true;
+    double amount = 0.0;
+
+    static RetainerTerms fromRequest(const ProjectRequest& req) {
+        RetainerTerms terms;
+        terms.clientName = string(req.clientName);
+        terms.clientEmail = string(req.clientEmail);
+        terms.clientCompany = string(req.clientCompany);
+        terms.freelancerName = string(req.freelancerName);
+        terms.freelancerEmail = string(req.freelancerEmail);
+        terms.freelancerSkills = string(req.freelancerSkills);
+        terms.freelancerRate = req.freelancerRate;
+        terms.projectName = string(req.projectName);
+        terms.milestoneTitle = string(req.milestoneTitle);
+        terms.milestoneDesc = string(req.milestoneDesc);
+        terms.escrow = req.escrow;
+        terms.amount = req.amount;
+        return terms;
+    }
+};
+
+// Recurring fixed-price milestones, e.g. monthly retainers. A template holds the
+// terms; a contract instantiates one on a schedule (every N days, or monthly on
+// the day of the month it started), optionally a limited number of times.
+// Due contracts sit in a TimerWheel with one-minute ticks, so millions of them
+// cost one slot check per minute plus the ones actually due. advanceTo() moves
+// the wheel under the lock, re-arms each due contract, then settles the
+// instances outside the lock. A failed instance is retried for the same period
+// with exponential backoff (RETRY_BASE_SECONDS doubling, MAX_ATTEMPTS tries)
+// before it is abandoned. startClock() does that every second from a
+// background thread.
+class RetainerScheduler {
+public:
+    // Settles one instance due at the given time; returns false when it failed
+    typedef function<bool(const ProjectRequest& req, int64_t due)> Settler;
+
+    static constexpr int64_t TICK_SECONDS = 60;
+    static constexpr int64_t RETRY_BASE_SECONDS = 60;
+    static constexpr uint32_t MAX_ATTEMPTS = 8;
+
+    struct Totals {
+        uint64_t settled;
+        uint64_t failed;     // Failed attempts, including ones later retried
+        uint64_t retrying;   // Instances waiting for another attempt
+        uint64_t abandoned;  // Instances that failed MAX_ATTEMPTS times
+    };
+
+private:
+    struct Contract {
+        int64_t nextDue;
+        uint32_t templateId;
+        uint32_t remaining;  // Instances still to run; 0 means until cancelled
+        uint32_t settled;
+        int16_t periodDays;  // 0 means monthly
+        uint8_t anchorDay;   // Day of the month for monthly contracts
+        bool active;
+        bool cancelled;      // Cancelled contracts also drop their pending retries
+    };
+
+    struct DueInstance {
+        uint32_t contract;
+        const RetainerTerms* terms;
+        int64_t due;
+        uint32_t attempt;  // Attempts already made
+    };
+
+    typedef pair<int64_t, DueInstance> Retry;  // (retry at, instance)
+    struct LaterRetry {
+        bool operator()(const Retry& a, const Retry& b) const { return a.first > b.first; }
+    };
+
+    deque<RetainerTerms> templates;  // Never shrinks, so references stay valid outside the lock
+    vector<Contract> contracts;
+    TimerWheel wheel;
+    vector<uint32_t> expired;
+    priority_queue<Retry, vector<Retry>, LaterRetry> retries;
+    uint64_t settledTotal = 0;
+    uint64_t failedTotal = 0;
+    uint64_t abandonedTotal = 0;
+    mutable mutex lock;
+
+    atomic<bool> stopping;
+    mutex wakeLock;
+    condition_variable wake;
+    thread clock;
+
+    static uint64_t tickFor(int64_t timestamp) {
+        return static_cast<uint64_t>((timestamp + TICK_SECONDS - 1) / TICK_SECONDS);  // Never before it is due
+    }
+
+    static int64_t following(const Contract& contract, int64_t due) {
+        time_t when = static_cast<time_t>(due);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &when);
+#else
+        localtime_r(&when, &local);
+#endif
+        local.tm_isdst = -1;
+        if (contract.periodDays > 0) {
+            local.tm_mday += contract.periodDays;
+            return static_cast<int64_t>(mktime(&local));
+        }
+        return monthAfter(due, contract.anchorDay);
+    }
+
+public:
+    // The same local time next month on anchorDay, clamped to the last day of
+    // a shorter month (Jan 31 -> Feb 28, not Mar 3)
+    static int64_t monthAfter(int64_t timestamp, int anchorDay) {
+        time_t when = static_cast<time_t>(timestamp);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &when);
+#else
+        localtime_r(&when, &local);
+#endif
+        local.tm_isdst = -1;
+        tm nextMonth = local;  // Day 0 of the month after next is the last day of next month
+        nextMonth.tm_mon += 2;
+        nextMonth.tm_mday = 0;
+        mktime(&nextMonth);
+        local.tm_mon += 1;
+        local.tm_mday = min<int>(anchorDay, nextMonth.tm_mday);
+        return static_cast<int64_t>(mktime(&local));
+    }
+
+    explicit RetainerScheduler(int64_t now) : wheel(static_cast<uint64_t>(now / TICK_SECONDS)), stopping(false) {}
+
+    RetainerScheduler(const RetainerScheduler&) = delete;
+    RetainerScheduler& operator=(const RetainerScheduler&) = delete;
+
+    ~RetainerScheduler() {
+        stopClock();
+    }
+
+    uint32_t addTemplate(const RetainerTerms& terms) {
+        lock_guard<mutex> guard(lock);
+        templates.push_back(terms);
+        return static_cast<uint32_t>(templates.size() - 1);
+    }
+
+    // Runs the template every periodDays days (0 = monthly) starting at firstDue,
+    // instances times or until cancelled when instances is 0; returns the contract id.
+    // Monthly contracts repeat on anchorDay, or on firstDue's day of the month when 0.
+    uint32_t addContract(uint32_t templateId, int periodDays, int64_t firstDue, uint32_t instances = 0,
+            int anchorDay = 0) {
+        if (periodDays < 0 || periodDays > numeric_limits<int16_t>::max()) {
+            throw runtime_error("Retainer period must be 0 (monthly) to 32767 days");
+        }
+        time_t when = static_cast<time_t>(firstDue);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &when);
+#else
+        localtime_r(&when, &local);
+#endif
+        lock_guard<mutex> guard(lock);
+        if (templateId >= templates.size()) throw runtime_error("Unknown retainer template " + to_string(templateId));
+        Contract contract;
+        contract.nextDue = firstDue;
+        contract.templateId = templateId;
+        contract.remaining = instances;
+        contract.settled = 0;
+        contract.periodDays = static_cast<int16_t>(periodDays);
+        contract.anchorDay = static_cast<uint8_t>(anchorDay > 0 && anchorDay <= 31 ? anchorDay : local.tm_mday);
+        contract.active = true;
+        contract.cancelled = false;
+        uint32_t id = static_cast<uint32_t>(contracts.size());
+        contracts.push_back(contract);
+        wheel.schedule(id, tickFor(firstDue));
+        return id;
+    }
+
+    // Stops future instances and retries; returns false for unknown or finished contracts
+    bool cancel(uint32_t id) {
+        lock_guard<mutex> guard(lock);
+        if (id >= contracts.size() || !contracts[id].active) return false;
+        contracts[id].active = false;
+        contracts[id].cancelled = true;
+        wheel.cancel(id);
+        return true;
+    }
+
+    size_t activeContracts() const {
+        lock_guard<mutex> guard(lock);
+        return wheel.size();
+    }
+
+    Totals totals() const {
+        lock_guard<mutex> guard(lock);
+        return Totals{settledTotal, failedTotal, retries.size(), abandonedTotal};
+    }
+
+    // Settles every instance due up to now, and retries whose backoff has
+    // passed; returns how many attempts ran
+    size_t advanceTo(int64_t now, const Settler& settle) {
+        vector<DueInstance> due;
+        {
+            lock_guard<mutex> guard(lock);
+            uint64_t target = static_cast<uint64_t>(now / TICK_SECONDS);
+            while (wheel.now() < target) {
+                expired.clear();
+                wheel.tick(expired);
+                for (uint32_t id : expired) {
+                    Contract& contract = contracts[id];
+                    due.push_back(DueInstance{id, &templates[contract.templateId], contract.nextDue, 0});
+                    contract.settled++;
+                    if (contract.remaining != 0 && contract.settled >= contract.remaining) {
+                        contract.active = false;
+                        continue;
+                    }
+                    contract.nextDue = following(contract, contract.nextDue);
+                    wheel.schedule(id, tickFor(contract.nextDue));
+                }
+            }
+            while (!retries.empty() && retries.top().first <= now) {
+                if (!contracts[retries.top().second.contract].cancelled) due.push_back(retries.top().second);
+                retries.pop();
+            }
+        }
+
+        uint64_t settled = 0, failed = 0, abandoned = 0;
+        vector<Retry> again;
+        string title;
+        for (const DueInstance& instance : due) {
+            const RetainerTerms& terms = *instance.terms;
+            time_t when = static_cast<time_t>(instance.due);
+            tm local;
+#ifdef _WIN32
+            localtime_s(&local, &when);
+#else
+            localtime_r(&when, &local);
+#endif
+            char period[16];
+            strftime(period, sizeof(period), " (%Y-%m-%d)", &local);
+            title = terms.milestoneTitle + period;
+
+            ProjectRequest req;
+            req.clientName = terms.clientName;
+            req.clientEmail = terms.clientEmail;
+            req.clientCompany = terms.clientCompany;
+            req.freelancerName = terms.freelancerName;
+            req.freelancerEmail = terms.freelancerEmail;
+            req.freelancerSkills = terms.freelancerSkills;
+            req.freelancerRate = terms.freelancerRate;
+            req.projectName = terms.projectName;
+            req.milestoneTitle = title;
+            req.milestoneDesc = terms.milestoneDesc;
+            req.hourly = false;
+            req.escrow = terms.escrow;
+            req.amount = terms.amount;
+            bool ok = false;
+            try {
+                ok = settle(req, instance.due);
+            }
+            catch (const exception& e) {
+                cerr << "Retainer contract " << instance.contract << " failed: " << e.what() << endl;
+            }
+            if (ok) {
+                settled++;
+                continue;
+            }
+            failed++;
+            DueInstance retry = instance;
+            if (++retry.attempt >= MAX_ATTEMPTS) {
+                abandoned++;
+                cerr << "Retainer contract " << instance.contract << " abandoned the instance due " << instance.due
+                    << " after " << retry.attempt << " attempts" << endl;
+                continue;
+            }
+            again.push_back(Retry(now + (RETRY_BASE_SECONDS << (retry.attempt - 1)), retry));
+        }
+        if (!due.empty()) {
+            EngineMetrics::increment(METRIC_RETAINER_SETTLED, settled);
+            EngineMetrics::increment(METRIC_RETAINER_FAILED, failed);
+            EngineMetrics::increment(METRIC_RETAINER_ABANDONED, abandoned);
+            lock_guard<mutex> guard(lock);
+            settledTotal += settled;
+            failedTotal += failed;
+            abandonedTotal += abandoned;
+            for (const Retry& retry : again) retries.push(retry);
+        }
+        return due.size();
+    }
+
+    // Calls advanceTo with the wall clock every second until stopClock
+    void startClock(Settler settle) {
+        stopping = false;
+        clock = thread([this, settle]() {
+            unique_lock<mutex> guard(wakeLock);
+            while (!stopping) {
+                guard.unlock();
+                advanceTo(static_cast<int64_t>(time(nullptr)), settle);
+                guard.lock();
+                wake.wait_for(guard, chrono::seconds(1), [this]() { return stopping.load(); });
+            }
+        });
+    }
+
+    void stopClock() {
+        if (!clock.joinable()) return;
+        {
+            lock_guard<mutex> guard(wakeLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        clock.join();
+    }
+};
+
+// Screens synthetic settlements with planted anomalies (hours x4, billed rate x3,
+// client spend x5, 1% each) after warming every entity's history, reporting the
+// cost per row in batches and one at a time, and what each rule caught
+void runAnomalyBench(size_t rowCount, size_t batchSize) {
+    const size_t freelancerCount = 20000, clientCount = 5000, warmup = 20;
+    mt19937_64 random(11);
+    uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    normal_distribution<float> noise(0.0f, 1.0f);
+    vector<float> typicalHours(freelancerCount), rates(freelancerCount), typicalSpend(clientCount);
+    for (float& h : typicalHours) h = 5.0f + 35.0f * uniform(random);
+    for (float& r : rates) r = 20.0f + 130.0f * uniform(random);
+    for (float& c : typicalSpend) c = 200.0f + 4800.0f * uniform(random);
+
+    AnomalyScorer* scorer = new AnomalyScorer();
+    vector<uint32_t> freelancerIds(freelancerCount), clientIds(clientCount);
+    for (size_t f = 0; f < freelancerCount; f++) freelancerIds[f] = scorer->freelancerId("dev" + to_string(f) + "@freelance.com");
+    for (size_t c = 0; c < clientCount; c++) clientIds[c] = scorer->clientId("client" + to_string(c) + "@company.com");
+
+    // planted: 0 = clean, otherwise the AnomalyRule planted in the row
+    auto generate = [&](AnomalyBatch& batch, vector<uint8_t>& planted, size_t count, bool anomalies) {
+        batch.clear();
+        planted.clear();
+        for (size_t i = 0; i < count; i++) {
+            size_t f = random() % freelancerCount, c = random() % clientCount;
+            uint8_t plant = 0;
+            float draw = uniform(random);
+            if (anomalies && draw < 0.01f) plant = ANOMALY_HOURS;
+            else if (anomalies && draw < 0.02f) plant = ANOMALY_RATE;
+            else if (anomalies && draw < 0.03f) plant = ANOMALY_CLIENT_SPEND;
+            // Hourly rows carry hours for the freelancer's history; their amount follows the client's usual spend
+            bool hourly = plant == ANOMALY_HOURS || plant == ANOMALY_RATE || (plant == 0 && (random() & 1));
+            float hours = hourly ? typicalHours[f] * max(0.1f, 1.0f + 0.15f * noise(random)) : 0.0f;
+            if (plant == ANOMALY_HOURS) hours = typicalHours[f] * 4.0f;
+            float billed = hourly ? rates[f] * (plant == ANOMALY_RATE ? 3.0f : 1.0f) : 0.0f;
+            float amount = typicalSpend[c] * max(0.1f, 1.0f + 0.2f * noise(random));
+            if (plant == ANOMALY_CLIENT_SPEND) amount = typicalSpend[c] * 5.0f;
+            batch.add(freelancerIds[f], clientIds[c], hours, billed, rates[f], amount);
+            planted.push_back(plant);
+        }
+    };
+
+    AnomalyBatch batch;
+    vector<uint8_t> planted;
+    generate(batch, planted, warmup * freelancerCount, false);
+    scorer->evaluate(batch);
+
+    generate(batch, planted, rowCount, true);
+    AnomalyBatch part;
+    vector<float> scores;
+    vector<uint8_t> flags;
+    scores.reserve(rowCount);
+    flags.reserve(rowCount);
+    auto begin = chrono::steady_clock::now();
+    for (size_t base = 0; base < rowCount; base += batchSize) {
+        size_t end = min(rowCount, base + batchSize);
+        part.clear();
+        for (size_t i = base; i < end; i++) {
+            part.add(batch.freelancers[i], batch.clients[i], batch.hours[i], batch.billedRates[i],
+                batch.profileRates[i], batch.amounts[i]);
+        }
+        scorer->evaluate(part);
+        scores.insert(scores.end(), part.scores.begin(), part.scores.end());
+        flags.insert(flags.end(), part.flags.begin(), part.flags.end());
+    }
+    double batchSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    size_t plantedCount[3] = {0, 0, 0}, caught[3] = {0, 0, 0}, clean = 0, falseAlarms = 0;
+    for (size_t i = 0; i < rowCount; i++) {
+        if (planted[i] == 0) {
+            clean++;
+            if (flags[i]) falseAlarms++;
+            continue;
+        }
+        int rule = planted[i] == ANOMALY_HOURS ? 0 : planted[i] == ANOMALY_RATE ? 1 : 2;
+        plantedCount[rule]++;
+        if (flags[i] & planted[i]) caught[rule]++;
+    }
+
+    size_t singles = min<size_t>(rowCount, 200000);
+    generate(batch, planted, singles, true);
+    begin = chrono::steady_clock::now();
+    for (size_t i = 0; i < singles; i++) {
+        part.clear();
+        part.add(batch.freelancers[i], batch.clients[i], batch.hours[i], batch.billedRates[i],
+            batch.profileRates[i], batch.amounts[i]);
+        scorer->evaluate(part);
+    }
+    double singleSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    cout << "Screened " << rowCount << " settlements in batches of " << batchSize << ": "
+        << batchSeconds * 1e9 / max<size_t>(rowCount, 1) << " ns per row; one at a time: "
+        << singleSeconds * 1e9 / max<size_t>(singles, 1) << " ns per row" << endl;
+    const char* const ruleNames[3] = {"hours", "rate", "client spend"};
+    for (int rule = 0; rule < 3; rule++) {
+        cout << "  " << ruleNames[rule] << ": caught " << caught[rule] << " of " << plantedCount[rule] << " planted" << endl;
+    }
+    cout << "  false alarms: " << falseAlarms << " of " << clean << " clean rows" << endl;
+    delete scorer;
+}
+
+// Schedules contractCount recurring contracts over 1000 templates (monthly, weekly and
+// fortnightly) and runs the wheel through days of simulated time with a settler that
+// only checks timing, reporting scheduling, per-tick and per-instance costs
+void runRetainerBench(size_t contractCount, int days) {
+    const int64_t start = parseReportDate("2026-01-01");
+    RetainerScheduler* scheduler = new RetainerScheduler(start);
+    for (int t = 0; t < 1000; t++) {
+        RetainerTerms terms;
+        terms.clientName = "Client " + to_string(t);
+        terms.clientEmail = "client" + to_string(t) + "@company.com";
+        terms.freelancerName = "Freelancer " + to_string(t);
+        terms.freelancerEmail = "dev" + to_string(t) + "@freelance.com";
+        terms.projectName = "Retainer " + to_string(t);
+        terms.milestoneTitle = "Monthly support";
+        terms.amount = 500.0 + t;
+        scheduler->addTemplate(terms);
+    }
+
+    mt19937_64 random(42);
+    auto begin = chrono::steady_clock::now();
+    for (size_t i = 0; i < contractCount; i++) {
+        uint64_t kind = random() % 10;
+        int period = kind < 7 ? 0 : kind < 9 ? 7 : 14;
+        int64_t firstDue = start + static_cast<int64_t>(random() % (30 * 86400));
+        scheduler->addContract(static_cast<uint32_t>(i % 1000), period, firstDue);
+    }
+    double scheduleSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "Scheduled " << contractCount << " contracts in " << scheduleSeconds << " s ("
+        << (contractCount ? scheduleSeconds * 1e9 / contractCount : 0) << " ns each)" << endl;
+
+    int64_t clock = start;
+    uint64_t late = 0;
+    RetainerScheduler::Settler settle = [&clock, &late](const ProjectRequest&, int64_t due) {
+        if (clock < due || clock - due >= RetainerScheduler::TICK_SECONDS) late++;
+        return true;
+    };
+    size_t instances = 0;
+    begin = chrono::steady_clock::now();
+    for (int64_t minute = 1; minute <= static_cast<int64_t>(days) * 1440; minute++) {
+        clock = start + minute * RetainerScheduler::TICK_SECONDS;
+        instances += scheduler->advanceTo(clock, settle);
+    }
+    double runSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    uint64_t ticks = static_cast<uint64_t>(days) * 1440;
+    cout << "Ran " << days << " days (" << ticks << " one-minute ticks) in " << runSeconds << " s: " << instances
+        << " instances due, " << late << " outside their minute; "
+        << (instances ? runSeconds * 1e9 / instances : 0) << " ns per instance, "
+        << runSeconds * 1e9 / ticks << " ns per tick overall" << endl;
+
+    // An idle stretch shows the bare tick cost with every contract still armed
+    RetainerScheduler* idle = new RetainerScheduler(start);
+    idle->addTemplate(RetainerTerms());
+    for (size_t i = 0; i < contractCount; i++) idle->addContract(0, 0, start + 400 * 86400 + static_cast<int64_t>(i % 86400));
+    begin = chrono::steady_clock::now();
+    idle->advanceTo(start + 365 * 86400, settle);
+    double idleSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "Idle year with " << idle->activeContracts() << " armed contracts: "
+        << idleSeconds * 1e9 / (365 * 1440) << " ns per tick" << endl;
+    delete idle;
+    delete scheduler;
+}
+
+// One notification derived from a receipt in the ledger. Each receipt notifies
+// its client (payment_sent) and freelancer (payment_received); an escrow refund
+// only notifies the client (escrow_refunded), since no one was paid. Ids are the
+// receipt's ledger offset plus the role, so they are the same on every
+// redelivery and receivers can drop duplicates.
+struct Notification {
+    string id;
+    string event;
+    string recipient, name;
+    string milestone, paymentType, timestamp;
+    double amount = 0.0;
+
+    void appendJson(string& out) const {
+        auto field = [&out](const char* key, const string& value) {
+            out += out.back() == '{' ? "\"" : ",\"";
+            out += key;
+            out += "\":\"";
+            for (char c : value) {
+                if (c == '"' || c == '\\') out += '\\';
+                if (static_cast<unsigned char>(c) < 0x20) continue;
+                out += c;
+            }
+            out += '"';
+        };
+        out += '{';
+        field("id", id);
+        field("event", event);
+        field("to", recipient);
+        field("name", name);
+        field("milestone", milestone);
+        char text[32];
+        to_chars_result end = to_chars(text, text + sizeof(text), amount);
+        out += ",\"amount\":";
+        out.append(text, end.ptr);
+        field("payment_type", paymentType);
+        field("timestamp", timestamp);
+        out += "}\n";
+    }
+};
+
+// Where the dispatcher delivers notifications. deliver() either accepts the
+// whole batch or throws, in which case the batch is retried later.
+class NotificationSink {
+public:
+    virtual ~NotificationSink() = default;
+    virtual void deliver(const vector<Notification>& batch, uint64_t batchOffset) = 0;
+};
+
+// Writes each batch as a JSON lines file named after its ledger offset, via a
+// temporary file and rename, so a redelivered batch replaces the earlier copy
+class FileNotificationSink : public NotificationSink {
+private:
+    string directory;
+
+public:
+    explicit FileNotificationSink(const string& dir) : directory(dir) {
+        error_code error;
+        filesystem::create_directories(directory, error);
+        if (error) throw runtime_error("Unable to create " + directory + ": " + error.message());
+    }
+
+    void deliver(const vector<Notification>& batch, uint64_t batchOffset) override {
+        char name[32];
+        snprintf(name, sizeof(name), "batch-%012llu.jsonl", static_cast<unsigned long long>(batchOffset));
+        string path = (filesystem::path(directory) / name).string();
+        string temp = path + ".tmp";
+        string text;
+        for (const Notification& notification : batch) notification.appendJson(text);
+        {
+            ofstream out(temp, ios::binary | ios::trunc);
+            if (!out.is_open() || !out.write(text.data(), text.size())) throw runtime_error("Unable to write " + temp);
+        }
+        if (rename(temp.c_str(), path.c_str()) != 0) throw runtime_error("Unable to rename " + temp);
+    }
+};
+
+// Transactional outbox over the receipt ledger. A receipt is appended to the
+// ledger in one write, so the ledger itself is the outbox: a notification
+// exists exactly when its receipt does, and workflows pay nothing for it. The
+// dispatcher runs separately, tails the ledger from a cursor file, turns new
+// receipts into notifications and hands them to a sink in batches. The cursor
+// only moves after a batch is accepted, and failed batches are retried with
+// exponential backoff, so delivery is at least once: a crash between delivery
+// and the cursor update repeats the batch.
+class NotificationDispatcher {
+private:
+    static constexpr size_t READ_CHUNK = 4 << 20;
+
+    string ledgerFile;
+    string cursorFile;
+    NotificationSink& sink;
+    size_t batchSize;
+    uint64_t cursor;  // Ledger offset of the first receipt not yet delivered
+    uint64_t delivered = 0;
+    uint64_t batches = 0;
+    uint64_t failures = 0;
+
+    struct Receipt {
+        uint64_t offset, end;
+        Notification client, freelancer;  // Empty recipient when the receipt has no such party
+    };
+
+    static void parseParty(string_view value, string& name, string& email) {
+        size_t open = value.rfind('<');
+        size_t close = value.rfind('>');
+        if (open == string_view::npos || close == string_view::npos || close < open) {
+            name = string(value);
+            email.clear();
+            return;
+        }
+        string_view person = value.substr(0, open);
+        while (!person.empty() && person.back() == ' ') person.remove_suffix(1);
+        name = string(person);
+        email = string(value.substr(open + 1, close - open - 1));
+    }
+
+    // Parses the complete receipts in text, which starts at ledger offset base
+    static void parseReceipts(string_view text, uint64_t base, vector<Receipt>& out) {
+        size_t pos = 0;
+        bool inReceipt = false;
+        Receipt receipt;
+        while (pos < text.size()) {
+            size_t newline = text.find('\n', pos);
+            if (newline == string_view::npos) break;  // Partial line still being written
+            string_view line = text.substr(pos, newline - pos);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            size_t lineStart = pos;
+            pos = newline + 1;
+
+            if (line == "=== PAYMENT RECEIPT ===") {
+                receipt = Receipt();
+                receipt.offset = base + lineStart;
+                inReceipt = true;
+                continue;
+            }
+            if (!inReceipt) continue;
+            if (line == "========================") {
+                receipt.end = base + pos;
+                string id = to_string(receipt.offset);
+                bool refund = receipt.client.paymentType == ESCROW_REFUND_TYPE;
+                receipt.client.id = id + "-client";
+                receipt.client.event = refund ? "escrow_refunded" : "payment_sent";
+                receipt.freelancer.id = id + "-freelancer";
+                receipt.freelancer.event = "payment_received";
+                if (refund) receipt.freelancer.recipient.clear();  // Refunds pay the freelancer nothing
+                for (Notification* n : {&receipt.client, &receipt.freelancer}) {
+                    n->milestone = receipt.client.milestone;
+                    n->amount = receipt.client.amount;
+                    n->paymentType = receipt.client.paymentType;
+                    n->timestamp = receipt.client.timestamp;
+                }
+                out.push_back(receipt);
+                inReceipt = false;
+                continue;
+            }
+            size_t colon = line.find(": ");
+            if (colon == string_view::npos) continue;
+            string_view key = line.substr(0, colon);
+            string_view value = line.substr(colon + 2);
+            if (key == "Milestone") receipt.client.milestone = string(value);
+            else if (key == "Client") parseParty(value, receipt.client.name, receipt.client.recipient);
+            else if (key == "Freelancer") parseParty(value, receipt.freelancer.name, receipt.freelancer.recipient);
+            else if (key == "Amount") {
+                if (!value.empty() && value[0] == '$') value.remove_prefix(1);
+                from_chars(value.data(), value.data() + value.size(), receipt.client.amount);
+            }
+            else if (key == "Payment Type") receipt.client.paymentType = string(value);
+            else if (key == "Timestamp") receipt.client.timestamp = string(value);
+        }
+    }
+
+    void saveCursor() {
+        string temp = cursorFile + ".tmp";
+        {
+            ofstream out(temp, ios::trunc);
+            if (!out.is_open() || !(out << cursor << "\n")) throw runtime_error("Unable to write " + temp);
+        }
+        if (rename(temp.c_str(), cursorFile.c_str()) != 0) throw runtime_error("Unable to rename " + temp);
+    }
+
+    // Delivers one batch, retrying with backoff; false if stopped first
+    bool deliverWithRetry(const vector<Notification>& batch, uint64_t batchOffset) {
+        chrono::milliseconds delay(100);
+        while (true) {
+            try {
+                sink.deliver(batch, batchOffset);
+                return true;
+            }
+            catch (const exception& e) {
+                failures++;
+                cerr << "Notification batch at " << batchOffset << " failed (" << e.what() << "), retrying in "
+                    << delay.count() << " ms" << endl;
+            }
+            for (auto slept = chrono::milliseconds(0); slept < delay; slept += chrono::milliseconds(50)) {
+                if (stopRequested) return false;
+                this_thread::sleep_for(chrono::milliseconds(50));
+            }
+            delay = min(delay * 2, chrono::milliseconds(30000));
+        }
+    }
+
+public:
+    // Set from a signal handler to stop run() between batches or retries
+    static volatile sig_atomic_t stopRequested;
+
+    static void requestStop(int) { stopRequested = 1; }
+
+    NotificationDispatcher(const string& ledger, const string& cursorPath, NotificationSink& target, size_t maxBatch)
+        : ledgerFile(ledger), cursorFile(cursorPath), sink(target), batchSize(max<size_t>(maxBatch, 2)), cursor(0) {
+        ifstream in(cursorFile);
+        if (in.is_open() && !(in >> cursor)) cursor = 0;
+    }
+
+    uint64_t getCursor() const { return cursor; }
+    uint64_t deliveredCount() const { return delivered; }
+    uint64_t batchCount() const { return batches; }
+    uint64_t failureCount() const { return failures; }
+
+    // Delivers every complete receipt currently in the ledger; returns the notifications sent
+    size_t drainOnce() {
+        size_t sent = 0;
+        vector<Receipt> receipts;
+        vector<Notification> batch;
+        string chunk;
+        while (!stopRequested) {
+            ifstream ledger(ledgerFile, ios::binary);
+            if (!ledger.is_open()) return sent;
+            ledger.seekg(0, ios::end);
+            uint64_t size = static_cast<uint64_t>(ledger.tellg());
+            if (size < cursor) {
+                // Ids are ledger offsets, so restarting at 0 would reuse ids receivers already dropped as delivered
+                throw runtime_error("Ledger " + ledgerFile + " shrank below the cursor at " + to_string(cursor)
+                    + "; remove " + cursorFile + " to redeliver it as a new ledger");
+            }
+            if (size == cursor) return sent;
+            chunk.resize(static_cast<size_t>(min<uint64_t>(size - cursor, READ_CHUNK)));
+            ledger.seekg(static_cast<streamoff>(cursor));
+            ledger.read(&chunk[0], static_cast<streamsize>(chunk.size()));
+            chunk.resize(static_cast<size_t>(ledger.gcount()));
+
+            receipts.clear();
+            parseReceipts(chunk, cursor, receipts);
+            if (receipts.empty()) return sent;  // Only a partial receipt so far
+
+            // Batches hold whole receipts so the cursor always lands on a receipt boundary
+            size_t first = 0;
+            while (first < receipts.size()) {
+                batch.clear();
+                size_t last = first;
+                while (last < receipts.size() && (batch.empty() || batch.size() + 2 <= batchSize)) {
+                    if (!receipts[last].client.recipient.empty()) batch.push_back(receipts[last].client);
+                    if (!receipts[last].freelancer.recipient.empty()) batch.push_back(receipts[last].freelancer);
+                    last++;
+                }
+                if (!batch.empty()) {
+                    if (!deliverWithRetry(batch, receipts[first].offset)) return sent;
+                    batches++;
+                    delivered += batch.size();
+                    sent += batch.size();
+                }
+                cursor = receipts[last - 1].end;
+                saveCursor();
+                first = last;
+            }
+            if (chunk.size() < READ_CHUNK) return sent;
+        }
+        return sent;
+    }
+
+    // Drains the ledger, then with follow keeps polling it until requestStop
+    void run(bool follow, chrono::milliseconds pollInterval) {
+        drainOnce();
+        while (follow && !stopRequested) {
+            this_thread::sleep_for(pollInterval);
+            drainOnce();
+        }
+    }
+};
+
+volatile sig_atomic_t NotificationDispatcher::stopRequested = 0;
+
+#ifdef __linux__
+
+// Protocol plugged into the event loop. Implementations consume as many
+// complete requests as are buffered and append all their responses to output,
+// so pipelined requests are answered with a single write.
+class RequestHandler {
+public:
+    virtual ~RequestHandler() = default;
+
+    // Returns bytes consumed from data; set closeAfterWrite to end the connection
+    virtual size_t handle(const char* data, size_t length, string& output, bool& closeAfterWrite) = 0;
+};
+
+// Line protocol for the engine service. One request per line:
+//   CREATE <project request JSON>   -> OK <project id>
+//   HOURS <project id> <hours>      -> OK
+//   COMPLETE <project id>           -> OK <amount paid>
+//   BALANCE <email>                 -> OK <earned> <spent>
+//   CANCEL <project id>             -> OK
+//   DISPUTE <project id>            -> OK (escrow hold no longer expires)
+//   STATS                           -> OK <per-stage latency summary>[; retainer totals]
+//   TRACE <N>                       -> OK (trace 1 in N new projects, 0 = off)
+//   TRACEDUMP <file name>           -> OK <spans written> (written under traces/)
+//   REPORT <clients|freelancers|types> [<from> <to>]
+//                                   -> OK <key>=<total>/<receipts>; ... (top 10, epoch seconds)
+//   ROLLUP <hour|day|month> <from> <to> [client=<key>] [freelancer=<key>] [type=<type>]
+//                                   -> OK <total>/<receipts>; <bucket start>=<total>/<receipts>; ...
+//   TOP <earners|clients> [N] [previous]
+//                                   -> OK <key>=<estimate>[<lower bound>]; ... (this or last week)
+//   DISTINCT <payers|clients|freelancers> <from> <to> [freelancer email or skill]
+//                                   -> OK <estimated distinct count>
+//   QUERY <expression>              -> OK <matches> <total> (see ReceiptQuery)
+//   FORECAST [trials]               -> OK <Escrow|Direct|All>=<P5>/<P50>/<P95>; ... (open projects, next quarter)
+//                                   (trials up to 1,000,000, 100,000 by default)
+//   RETAIN <days|monthly> <instances> <project request JSON>
+//                                   -> OK <contract id> (fixed price, first due one period from now, 0 = until cancelled)
+//   UNRETAIN <contract id>          -> OK
+//   QUIT
+// Failures answer "ERR <message>".
+class LineProtocolHandler : public RequestHandler {
+private:
+    // FORECAST runs on the event loop thread, so its size is bounded: the work is
+    // trials x open milestones, at ~100 ns each on one core (~1 s at the limit)
+    static constexpr size_t MAX_FORECAST_TRIALS = 1000000;
+    static constexpr size_t MAX_FORECAST_WORK = 10000000;
+    // TRACEDUMP only writes plain file names inside this directory
+    static constexpr const char* TRACE_DIRECTORY = "traces";
+
+    EngineService& engine;
+    const ReceiptStore* receipts;  // Answers REPORT and QUERY when set
+    const RollupStore* rollups;    // Answers ROLLUP when set
+    const TopNTracker* heavyHitters;  // Answers TOP when set
+    CardinalityTracker* cardinality;  // Answers DISTINCT when set
+    RetainerScheduler* retainers;     // Answers RETAIN and UNRETAIN when set
+    ProjectRequestParser parser;
+
+    static void appendNumber(string& out, double value) {
+        char text[32];
+        to_chars_result result = to_chars(text, text + sizeof(text), value);
+        out.append(text, result.ptr);
+    }
+
+    void execute(string_view line, string& out, bool& closeAfterWrite) {
+        size_t space = line.find(' ');
+        string_view command = line.substr(0, space);
+        string_view args = space == string_view::npos ? string_view() : line.substr(space + 1);
+
+        if (command == "CREATE") {
+            ProjectRequest req;
+            if (!parser.parse(args, req)) {
+                out += "ERR malformed project request\n";
+                return;
+            }
+            out += "OK " + to_string(engine.createProject(req)) + "\n";
+        }
+        else if (command == "HOURS") {
+            long id = 0;
+            double hours = 0.0;
+            size_t split = args.find(' ');
+            if (split == string_view::npos
+                || from_chars(args.data(), args.data() + split, id).ec != errc()
+                || from_chars(args.data() + split + 1, args.data() + args.size(), hours).ec != errc()
+                || !isfinite(hours)) {
+                out += "ERR usage: HOURS <project id> <hours>\n";
+                return;
+            }
+            engine.logHours(id, hours);
+            out += "OK\n";
+        }
+        else if (command == "COMPLETE") {
+            long id = 0;
+            if (from_chars(args.data(), args.data() + args.size(), id).ec != errc()) {
+                out += "ERR usage: COMPLETE <project id>\n";
+                return;
+            }
+            double paid = engine.completeProject(id);
+            out += "OK ";
+            appendNumber(out, paid);
+            out += "\n";
+        }
+        else if (command == "BALANCE") {
+            EngineService::Balance balance = engine.getBalance(string(args));
+            out += "OK ";
+            appendNumber(out, balance.earned);
+            out += " ";
+            appendNumber(out, balance.spent);
+            out += "\n";
+        }
+        else if (command == "CANCEL") {
+            long id = 0;
+            if (from_chars(args.data(), args.data() + args.size(), id).ec != errc()) {
+                out += "ERR usage: CANCEL <project id>\n";
+                return;
+            }
+            engine.cancelProject(id);
+            out += "OK\n";
+        }
+        else if (command == "DISPUTE") {
+            long id = 0;
+            if (from_chars(args.data(), args.data() + args.size(), id).ec != errc()) {
+                out += "ERR usage: DISPUTE <project id>\n";
+                return;
+            }
+            engine.disputeProject(id);
+            out += "OK\n";
+        }
+        else if (command == "STATS") {
+            out += "OK";
+            for (int s = 0; s < STAGE_COUNT; s++) {
+                out += s == 0 ? " " : "; ";
+                out += WorkflowProfiler::summary(static_cast<WorkflowStage>(s));
+            }
+            if (retainers) {
+                RetainerScheduler::Totals totals = retainers->totals();
+                out += "; retainers settled=" + to_string(totals.settled) + " failed=" + to_string(totals.failed)
+                    + " retrying=" + to_string(totals.retrying) + " abandoned=" + to_string(totals.abandoned);
+            }
+            out += "\n";
+        }
+        else if (command == "TRACE") {
+            uint32_t period = 0;
+            if (from_chars(args.data(), args.data() + args.size(), period).ec != errc()) {
+                out += "ERR usage: TRACE <N>\n";
+                return;
+            }
+            WorkflowTracer::setSamplingPeriod(period);
+            out += "OK\n";
+        }
+        else if (command == "TRACEDUMP") {
+            if (args.empty() || args == "." || args.find("..") != string_view::npos
+                || args.find_first_of("/\\") != string_view::npos) {
+                out += "ERR usage: TRACEDUMP <file name> (no directories)\n";
+                return;
+            }
+            error_code error;
+            filesystem::create_directories(TRACE_DIRECTORY, error);
+            out += "OK " + to_string(WorkflowTracer::dump(string(TRACE_DIRECTORY) + "/" + string(args))) + "\n";
+        }
+        else if (command == "REPORT") {
+            report(args, out);
+        }
+        else if (command == "ROLLUP") {
+            rollup(args, out);
+        }
+        else if (command == "TOP") {
+            topN(args, out);
+        }
+        else if (command == "DISTINCT") {
+            distinct(args, out);
+        }
+        else if (command == "QUERY") {
+            query(args, out);
+        }
+        else if (command == "FORECAST") {
+            forecast(args, out);
+        }
+        else if (command == "RETAIN") {
+            retain(args, out);
+        }
+        else if (command == "UNRETAIN") {
+            uint32_t id = 0;
+            if (!retainers) {
+                out += "ERR retainers not enabled\n";
+            }
+            else if (from_chars(args.data(), args.data() + args.size(), id).ec != errc()) {
+                out += "ERR usage: UNRETAIN <contract id>\n";
+            }
+            else if (!retainers->cancel(id)) {
+                out += "ERR unknown or finished retainer " + to_string(id) + "\n";
+            }
+            else {
+                out += "OK\n";
+            }
+        }
+        else if (command == "QUIT") {
+            closeAfterWrite = true;
+        }
+        else {
+            out += "ERR unknown command\n";
+        }
+    }
+
+    void retain(string_view args, string& out) {
+        if (!retainers) {
+            out += "ERR retainers not enabled\n";
+            return;
+        }
+        size_t first = args.find(' ');
+        size_t second = first == string_view::npos ? first : args.find(' ', first + 1);
+        string_view period = args.substr(0, first);
+        int days = 0;
+        uint32_t instances = 0;
+        ProjectRequest req;
+        if (second == string_view::npos
+            || (period != "monthly" && (from_chars(period.data(), period.data() + period.size(), days).ec != errc() || days <= 0))
+            || from_chars(args.data() + first + 1, args.data() + second, instances).ec != errc()
+            || !parser.parse(args.substr(second + 1), req)) {
+            out += "ERR usage: RETAIN <days|monthly> <instances> <project request JSON>\n";
+            return;
+        }
+        if (req.hourly) {
+            out += "ERR retainers must be fixed price\n";
+            return;
+        }
+        if (req.amount <= 0) {
+            out += "ERR retainer amount must be positive\n";  // Every instance would fail otherwise
+            return;
+        }
+        int64_t now = static_cast<int64_t>(time(nullptr));
+        time_t when = static_cast<time_t>(now);
+        tm local;
+        localtime_r(&when, &local);
+        int anchorDay = local.tm_mday;  // Monthly contracts keep today's day, clamped in shorter months
+        int64_t firstDue;
+        if (days > 0) {
+            local.tm_isdst = -1;
+            local.tm_mday += days;
+            firstDue = static_cast<int64_t>(mktime(&local));
+        }
+        else {
+            firstDue = RetainerScheduler::monthAfter(now, anchorDay);
+        }
+        uint32_t templateId = retainers->addTemplate(RetainerTerms::fromRequest(req));
+        out += "OK " + to_string(retainers->addContract(templateId, days, firstDue, instances, anchorDay)) + "\n";
+    }
+
+    void forecast(string_view args, string& out) const {
+        vector<PayoutExposure> exposures = engine.payoutExposures();
+        size_t limit = min(MAX_FORECAST_TRIALS, MAX_FORECAST_WORK / max<size_t>(exposures.size(), 1));
+        if (limit == 0) {
+            out += "ERR too many open milestones to forecast on the service (at most "
+                + to_string(MAX_FORECAST_WORK) + ")\n";
+            return;
+        }
+        ForecastProfile profile;
+        profile.trials = min<size_t>(100000, limit);  // The default shrinks as the portfolio grows
+        if (!args.empty() && from_chars(args.data(), args.data() + args.size(), profile.trials).ec != errc()) {
+            out += "ERR usage: FORECAST [trials]\n";
+            return;
+        }
+        if (profile.trials == 0 || profile.trials > limit) {
+            out += "ERR trials must be between 1 and " + to_string(limit) + " for " + to_string(exposures.size())
+                + " open milestone(s)\n";
+            return;
+        }
+        PayoutForecast result = PayoutForecaster(profile, exposures).run({0.05, 0.5, 0.95});
+        out += "OK";
+        for (int s = 0; s < FORECAST_SERIES_COUNT; s++) {
+            ForecastSeries series = static_cast<ForecastSeries>(s);
+            out += s == 0 ? " " : "; ";
+            out += forecastSeriesNames[s];
+            for (size_t l = 0; l < result.levels.size(); l++) {
+                out += l == 0 ? "=" : "/";
+                out += formatCents(llround(result.at(series, result.weeks - 1, l) * 100.0));
+            }
+        }
+        out += "\n";
+    }
+
+    void query(string_view args, string& out) const {
+        if (!receipts) {
+            out += "ERR receipt analytics not enabled\n";
+            return;
+        }
+        try {
+            ReceiptQuery::Result result = ReceiptQuery(string(args)).execute(*receipts, 0);
+            out += "OK " + to_string(result.matches) + " " + formatCents(result.cents) + "\n";
+        }
+        catch (const QuerySyntaxException& e) {
+            out += string("ERR ") + e.what() + "\n";
+        }
+    }
+
+    void report(string_view args, string& out) const {
+        if (!receipts) {
+            out += "ERR receipt analytics not enabled\n";
+            return;
+        }
+        size_t space = args.find(' ');
+        string_view dimensionName = args.substr(0, space);
+        int64_t from = numeric_limits<int64_t>::min();
+        int64_t to = numeric_limits<int64_t>::max();
+        if (space != string_view::npos) {
+            string_view range = args.substr(space + 1);
+            size_t split = range.find(' ');
+            if (split == string_view::npos
+                || from_chars(range.data(), range.data() + split, from).ec != errc()
+                || from_chars(range.data() + split + 1, range.data() + range.size(), to).ec != errc()) {
+                out += "ERR usage: REPORT <clients|freelancers|types> [<from> <to>]\n";
+                return;
+            }
+        }
+
+        ReceiptDimension dimension;
+        if (dimensionName == "clients") dimension = GROUP_BY_CLIENT;
+        else if (dimensionName == "freelancers") dimension = GROUP_BY_FREELANCER;
+        else if (dimensionName == "types") dimension = GROUP_BY_PAYMENT_TYPE;
+        else {
+            out += "ERR usage: REPORT <clients|freelancers|types> [<from> <to>]\n";
+            return;
+        }
+
+        vector<GroupTotal> totals = receipts->sumBy(dimension, from, to);
+        out += "OK";
+        for (size_t i = 0; i < totals.size() && i < 10; i++) {
+            out += i == 0 ? " " : "; ";
+            out += totals[i].key + "=" + formatCents(totals[i].cents) + "/" + to_string(totals[i].receipts);
+        }
+        out += "\n";
+    }
+
+    void rollup(string_view args, string& out) const {
+        if (!rollups) {
+            out += "ERR rollups not enabled\n";
+            return;
+        }
+        vector<string_view> words;
+        while (!args.empty()) {
+            size_t space = args.find(' ');
+            if (space != 0) words.push_back(args.substr(0, space));
+            args = space == string_view::npos ? string_view() : args.substr(space + 1);
+        }
+
+        RollupGranularity granularity;
+        int64_t from = 0, to = 0;
+        RollupFilter filter;
+        bool valid = words.size() >= 3 && parseRollupGranularity(words[0], granularity)
+            && from_chars(words[1].data(), words[1].data() + words[1].size(), from).ec == errc()
+            && from_chars(words[2].data(), words[2].data() + words[2].size(), to).ec == errc();
+        for (size_t i = 3; valid && i < words.size(); i++) {
+            size_t equals = words[i].find('=');
+            string_view name = words[i].substr(0, equals);
+            string_view value = equals == string_view::npos ? string_view() : words[i].substr(equals + 1);
+            if (name == "client") filter.client = value;
+            else if (name == "freelancer") filter.freelancer = value;
+            else if (name == "type") filter.paymentType = value;
+            else valid = false;
+            if (value.empty()) valid = false;
+        }
+        if (!valid) {
+            out += "ERR usage: ROLLUP <hour|day|month> <from> <to> [client=..] [freelancer=..] [type=..]\n";
+            return;
+        }
+
+        vector<RollupPoint> points = rollups->query(granularity, from, to, filter);
+        RollupTotals total;
+        for (const RollupPoint& point : points) {
+            total.cents += point.totals.cents;
+            total.receipts += point.totals.receipts;
+        }
+        out += "OK " + formatCents(total.cents) + "/" + to_string(total.receipts);
+        for (const RollupPoint& point : points) {
+            out += "; " + to_string(point.bucketStart) + "=" + formatCents(point.totals.cents) + "/"
+                + to_string(point.totals.receipts);
+        }
+        out += "\n";
+    }
+
+    void topN(string_view args, string& out) const {
+        if (!heavyHitters) {
+            out += "ERR top-N tracking not enabled\n";
+            return;
+        }
+        size_t space = args.find(' ');
+        string_view streamName = args.substr(0, space);
+        string_view rest = space == string_view::npos ? string_view() : args.substr(space + 1);
+        size_t n = 10;
+        bool previousWindow = false;
+        if (!rest.empty()) {
+            size_t split = rest.find(' ');
+            string_view count = rest.substr(0, split);
+            if (from_chars(count.data(), count.data() + count.size(), n).ec != errc()) n = 0;
+            previousWindow = split != string_view::npos && rest.substr(split + 1) == "previous";
+        }
+        TopNStream stream;
+        if (streamName == "earners") stream = TOP_EARNERS;
+        else if (streamName == "clients") stream = TOP_CLIENT_MILESTONES;
+        else n = 0;
+        if (n == 0) {
+            out += "ERR usage: TOP <earners|clients> [N] [previous]\n";
+            return;
+        }
+
+        vector<HeavyHitter> hitters = heavyHitters->top(stream, n, previousWindow, static_cast<int64_t>(time(nullptr)));
+        out += "OK";
+        for (size_t i = 0; i < hitters.size(); i++) {
+            out += i == 0 ? " " : "; ";
+            out += hitters[i].key + "=";
+            if (stream == TOP_EARNERS) {
+                out += formatCents(hitters[i].estimate) + "[" + formatCents(hitters[i].lowerBound) + "]";
+            }
+            else {
+                out += to_string(hitters[i].estimate) + "[" + to_string(hitters[i].lowerBound) + "]";
+            }
+        }
+        out += "\n";
+    }
+
+    void distinct(string_view args, string& out) const {
+        if (!cardinality) {
+            out += "ERR distinct counting not enabled\n";
+            return;
+        }
+        string_view words[3];
+        for (string_view& word : words) {
+            size_t space = args.find(' ');
+            word = args.substr(0, space);
+            args = space == string_view::npos ? string_view() : args.substr(space + 1);
+        }
+        CardinalityMetric metric = CARDINALITY_METRIC_COUNT;
+        if (words[0] == "payers") metric = DISTINCT_PAYERS;
+        else if (words[0] == "clients") metric = DISTINCT_CLIENTS_PER_FREELANCER;
+        else if (words[0] == "freelancers") metric = DISTINCT_FREELANCERS_PER_SKILL;
+        int64_t from = 0, to = 0;
+        if (metric == CARDINALITY_METRIC_COUNT
+            || from_chars(words[1].data(), words[1].data() + words[1].size(), from).ec != errc()
+            || from_chars(words[2].data(), words[2].data() + words[2].size(), to).ec != errc()
+            || (metric != DISTINCT_PAYERS && args.empty())) {
+            out += "ERR usage: DISTINCT <payers|clients|freelancers> <from> <to> [freelancer email or skill]\n";
+            return;
+        }
+        out += "OK " + to_string(llround(cardinality->distinct(metric, from, to, args))) + "\n";
+    }
+
+public:
+    LineProtocolHandler(EngineService& service, const ReceiptStore* receiptStore = nullptr,
+        const RollupStore* rollupStore = nullptr, const TopNTracker* topTracker = nullptr,
+        CardinalityTracker* distinctCounter = nullptr, RetainerScheduler* retainerScheduler = nullptr)
+        : engine(service), receipts(receiptStore), rollups(rollupStore), heavyHitters(topTracker),
+        cardinality(distinctCounter), retainers(retainerScheduler) {}
+
+    size_t handle(const char* data, size_t length, string& output, bool& closeAfterWrite) override {
+        size_t consumed = 0;
+        while (consumed < length && !closeAfterWrite) {
+            const char* start = data + consumed;
+            const char* newline = static_cast<const char*>(memchr(start, '\n', length - consumed));
+            if (!newline) break;
+            string_view line(start, newline - start);
+            consumed += line.size() + 1;
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty()) continue;
+            try {
+                execute(line, output, closeAfterWrite);
+            }
+            catch (const exception& e) {
+                output += "ERR ";
+                output += e.what();
+                output += "\n";
+            }
+        }
+        return consumed;
+    }
+};
+
+volatile sig_atomic_t serverStopRequested = 0;
+
+void requestServerStop(int) {
+    serverStopRequested = 1;
+}
+
+// Single-threaded epoll loop serving one RequestHandler over a loopback TCP
+// port or a Unix domain socket. Sockets are non-blocking and level-triggered;
+// output is only watched for writability while a response is pending.
+class EventLoopServer {
+private:
+    struct Connection {
+        int fd;
+        string input;
+        string output;
+        size_t outputSent = 0;
+        bool closeAfterWrite = false;
+        bool watchingWrite = false;
+        size_t pendingReported = 0;  // Unsent bytes last added to the pending output gauge
+    };
+
+    static constexpr int MAX_EVENTS = 1024;
+    static constexpr size_t READ_SIZE = 64 * 1024;
+    static constexpr size_t MAX_INPUT = 1 << 20;  // Drop clients that send an oversized request
+
+    RequestHandler& handler;
+    int listenFd;
+    int epollFd;
+    vector<Connection*> connections;  // Indexed by file descriptor
+    size_t connectionCount;
+    string unixPath;
+
+    static void setNonBlocking(int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    void closeConnection(Connection* conn) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        close(conn->fd);
+        connections[conn->fd] = nullptr;
+        connectionCount--;
+        EngineMetrics::adjustGauge(GAUGE_OPEN_CONNECTIONS, -1);
+        EngineMetrics::adjustGauge(GAUGE_PENDING_OUTPUT_BYTES, -static_cast<int64_t>(conn->pendingReported));
+        delete conn;
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;  // EAGAIN, or out of descriptors until some close
+            if (unixPath.empty()) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            if (static_cast<size_t>(fd) >= connections.size()) connections.resize(fd + 1024, nullptr);
+            Connection* conn = new Connection();
+            conn->fd = fd;
+            connections[fd] = conn;
+            connectionCount++;
+            EngineMetrics::adjustGauge(GAUGE_OPEN_CONNECTIONS, 1);
+
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+
+    // Returns false if the connection was closed
+    bool flushOutput(Connection* conn) {
+        while (conn->outputSent < conn->output.size()) {
+            ssize_t sent = send(conn->fd, conn->output.data() + conn->outputSent,
+                conn->output.size() - conn->outputSent, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                closeConnection(conn);
+                return false;
+            }
+            conn->outputSent += sent;
+        }
+
+        bool pending = conn->outputSent < conn->output.size();
+        size_t unsent = conn->output.size() - conn->outputSent;
+        if (unsent != conn->pendingReported) {
+            EngineMetrics::adjustGauge(GAUGE_PENDING_OUTPUT_BYTES,
+                static_cast<int64_t>(unsent) - static_cast<int64_t>(conn->pendingReported));
+            conn->pendingReported = unsent;
+        }
+        if (!pending) {
+            conn->output.clear();
+            conn->outputSent = 0;
+            if (conn->closeAfterWrite) {
+                closeConnection(conn);
+                return false;
+            }
+        }
+        if (pending != conn->watchingWrite) {
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLRDHUP | (pending ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+            event.data.fd = conn->fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+            conn->watchingWrite = pending;
+        }
+        return true;
+    }
+
+    void readInput(Connection* conn) {
+        char chunk[READ_SIZE];
+        bool peerClosed = false;
+        while (true) {
+            ssize_t got = recv(conn->fd, chunk, sizeof(chunk), 0);
+            if (got > 0) {
+                conn->input.append(chunk, got);
+                if (got < static_cast<ssize_t>(sizeof(chunk))) break;
+                continue;
+            }
+            if (got == 0) peerClosed = true;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK) peerClosed = true;
+            break;
+        }
+
+        if (!conn->input.empty() && !conn->closeAfterWrite) {
+            size_t consumed = handler.handle(conn->input.data(), conn->input.size(), conn->output, conn->closeAfterWrite);
+            conn->input.erase(0, consumed);
+        }
+        if (conn->input.size() > MAX_INPUT) conn->closeAfterWrite = true;
+        if (peerClosed && conn->output.empty()) {
+            closeConnection(conn);
+            return;
+        }
+        if (peerClosed) conn->closeAfterWrite = true;
+        flushOutput(conn);
+    }
+
+public:
+    EventLoopServer(RequestHandler& requestHandler)
+        : handler(requestHandler), listenFd(-1), epollFd(-1), connectionCount(0) {
+    }
+
+    EventLoopServer(const EventLoopServer&) = delete;
+    EventLoopServer& operator=(const EventLoopServer&) = delete;
+
+    ~EventLoopServer() {
+        for (Connection* conn : connections) {
+            if (conn) closeConnection(conn);
+        }
+        if (epollFd >= 0) close(epollFd);
+        if (listenFd >= 0) close(listenFd);
+        if (!unixPath.empty()) unlink(unixPath.c_str());
+    }
+
+    // Listens on 127.0.0.1:<port>, or on a Unix socket if the address contains '/'.
+    // reusePort lets several loops share one TCP port.
+    void listenOn(const string& address, bool reusePort = false) {
+        if (address.find('/') != string::npos) {
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            if (address.size() >= sizeof(addr.sun_path)) throw runtime_error("Socket path too long");
+            strcpy(addr.sun_path, address.c_str());
+            listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            // Clear a stale socket from an earlier run, but never a regular file or directory
+            struct stat existing;
+            if (lstat(address.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) unlink(address.c_str());
+            if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                throw runtime_error("Unable to bind " + address + ": " + strerror(errno));
+            }
+            unixPath = address;
+        }
+        else {
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(static_cast<uint16_t>(atoi(address.c_str())));
+            listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            int one = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (reusePort) setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+            if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                throw runtime_error("Unable to bind port " + address + ": " + strerror(errno));
+            }
+        }
+        if (listen(listenFd, SOMAXCONN) < 0) {
+            throw runtime_error(string("Unable to listen: ") + strerror(errno));
+        }
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    }
+
+    // Serves until serverStopRequested is set (SIGINT/SIGTERM)
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        while (!serverStopRequested) {
+            int ready = epoll_wait(epollFd, events, MAX_EVENTS, 200);
+            for (int i = 0; i < ready; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptConnections();
+                    continue;
+                }
+                Connection* conn = static_cast<size_t>(fd) < connections.size() ? connections[fd] : nullptr;
+                if (!conn) continue;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    readInput(conn);
+                    conn = connections[fd];
+                }
+                if (conn && (events[i].events & EPOLLOUT)) flushOutput(conn);
+            }
+        }
+    }
+
+    size_t getConnectionCount() const { return connectionCount; }
+};
+
+// Lets the process hold as many sockets as the hard limit allows
+void raiseDescriptorLimit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// escrowHoldDays > 0 settles undisputed escrow projects that long after creation
+void runService(const string& address, double escrowHoldDays, EscrowExpiryAction escrowAction) {
+    raiseDescriptorLimit();
+    signal(SIGINT, requestServerStop);
+    signal(SIGTERM, requestServerStop);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Receipts already on disk seed the analytics store and rollups; new ones arrive as they are logged
+    ReceiptStore receipts;
+    size_t history = receipts.loadReceiptFile("payment_receipts.txt");
+    RollupStore rollups;
+    rollups.rebuild(receipts);
+    TopNTracker heavyHitters;
+    CardinalityTracker cardinality;
+    try {
+        cardinality.loadDirectory("sketches");
+    }
+    catch (const exception& e) {
+        cerr << "Ignoring saved sketches: " << e.what() << endl;
+    }
+
+    EngineService engine("payment_receipts.txt");
+    engine.setEscrowExpiry(static_cast<int64_t>(escrowHoldDays * 86400), escrowAction);
+    RetainerScheduler retainers(static_cast<int64_t>(time(nullptr)));
+    LineProtocolHandler protocol(engine, &receipts, &rollups, &heavyHitters, &cardinality, &retainers);
+    EventLoopServer server(protocol);
+    try {
+        server.listenOn(address);
+    }
+    catch (const exception& e) {
+        cerr << "Service failed to start: " << e.what() << endl;
+        return;
+    }
+    Logger::addListener(&receipts);
+    Logger::addListener(&rollups);
+    Logger::addListener(&heavyHitters);
+    Logger::addListener(&cardinality);
+    AnomalyScorer anomalies;
+    AnomalyScorer::setActive(&anomalies);
+
+    cout << "Engine service listening on " << address << " (Ctrl+C to stop), " << history
+        << " receipt(s) loaded for REPORT, QUERY and ROLLUP" << endl;
+    {
+        ConsoleSilencer silence;
+        retainers.startClock([&engine](const ProjectRequest& req, int64_t) {
+            engine.runProject(req);
+            return true;
+        });
+        EscrowSweeper sweeper(engine, chrono::seconds(1), 1024);
+        server.run();
+        retainers.stopClock();
+    }
+    cout << "Engine service stopped with " << engine.openProjects() << " open project(s)" << endl;
+    Logger::removeListener(&receipts);
+    Logger::removeListener(&rollups);
+    Logger::removeListener(&heavyHitters);
+    Logger::removeListener(&cardinality);
+    AnomalyScorer::setActive(nullptr);
+    try {
+        error_code error;
+        filesystem::create_directories("sketches", error);
+        cout << "Saved " << cardinality.save("sketches", "service") << " daily sketch file(s) to sketches/" << endl;
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+    }
+}
+
+// HTTP/1.1 front end for the engine. Requests are parsed in place: the
+// request line and headers are string_views into the connection buffer.
+// Keep-alive is the default and pipelined requests are answered in order.
+//   POST /projects                  body: project request JSON -> 201 {"id":N}
+//   POST /projects/{id}/hours       body: {"hours": H}         -> 200
+//   POST /projects/{id}/complete                               -> 200 {"id":N,"paid":X}
+//   GET  /balances/{email}                                     -> 200 {"email":..,"earned":X,"spent":Y}
+//   GET  /health                                               -> 200 {"openProjects":N}
+//   GET  /metrics                                              -> 200 Prometheus text
+class HttpHandler : public RequestHandler {
+private:
+    static constexpr size_t MAX_BODY = 64 * 1024;
+
+    EngineService& engine;
+    ProjectRequestParser parser;
+
+    static bool equalsIgnoreCase(string_view a, string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) return false;
+        }
+        return true;
+    }
+
+    static void appendJsonString(string& out, string_view text) {
+        out += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') out += '\\';
+            if (static_cast<unsigned char>(c) < 0x20) continue;
+            out += c;
+        }
+        out += '"';
+    }
+
+    static void appendNumber(string& out, double value) {
+        char text[32];
+        to_chars_result result = to_chars(text, text + sizeof(text), value);
+        out.append(text, result.ptr);
+    }
+
+    static void appendResponse(string& out, int status, const string& body, bool keepAlive,
+        const char* contentType = "application/json") {
+        const char* reason = "OK";
+        switch (status) {
+        case 201: reason = "Created"; break;
+        case 400: reason = "Bad Request"; break;
+        case 404: reason = "Not Found"; break;
+        case 405: reason = "Method Not Allowed"; break;
+        case 413: reason = "Payload Too Large"; break;
+        case 422: reason = "Unprocessable Entity"; break;
+        case 501: reason = "Not Implemented"; break;
+        }
+        out += "HTTP/1.1 ";
+        out += to_string(status);
+        out += ' ';
+        out += reason;
+        out += "\r\nContent-Type: ";
+        out += contentType;
+        out += "\r\nContent-Length: ";
+        out += to_string(body.size());
+        out += keepAlive ? "\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+        out += body;
+    }
+
+    static string errorBody(const string& message) {
+        string body = "{\"error\":";
+        appendJsonString(body, message);
+        body += "}";
+        return body;
+    }
+
+    // Decodes %XX escapes in a path segment, e.g. "a%2Bb%40x.com"; false if one is malformed
+    static bool percentDecode(string_view text, string& out) {
+        out.clear();
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] != '%') {
+                out += text[i];
+                continue;
+            }
+            unsigned value = 0;
+            if (i + 2 >= text.size()) return false;
+            from_chars_result parsed = from_chars(text.data() + i + 1, text.data() + i + 3, value, 16);
+            if (parsed.ec != errc() || parsed.ptr != text.data() + i + 3) return false;
+            out += static_cast<char>(value);
+            i += 2;
+        }
+        return true;
+    }
+
+    // Splits "/projects/12/hours" into id 12 and action "hours"
+    static bool parseProjectPath(string_view path, long& id, string_view& action) {
+        string_view rest = path.substr(strlen("/projects/"));
+        size_t slash = rest.find('/');
+        string_view idText = rest.substr(0, slash);
+        if (from_chars(idText.data(), idText.data() + idText.size(), id).ec != errc()) return false;
+        action = slash == string_view::npos ? string_view() : rest.substr(slash + 1);
+        return true;
+    }
+
+    // Returns the HTTP status and fills body
+    int route(string_view method, string_view path, string_view requestBody, string& body, const char*& contentType) {
+        bool isGet = method == "GET";
+        bool isPost = method == "POST";
+
+        if (path == "/metrics") {
+            if (!isGet) return 405;
+            body = EngineMetrics::prometheusText();
+            contentType = "text/plain; version=0.0.4";
+            return 200;
+        }
+        if (path == "/health") {
+            if (!isGet) return 405;
+            body = "{\"openProjects\":" + to_string(engine.openProjects()) + "}";
+            return 200;
+        }
+        if (path == "/projects") {
+            if (!isPost) return 405;
+            ProjectRequest req;
+            if (!parser.parse(requestBody, req)) {
+                body = errorBody("malformed project request");
+                return 400;
+            }
+            body = "{\"id\":" + to_string(engine.createProject(req)) + "}";
+            return 201;
+        }
+        if (path.substr(0, 10) == "/projects/") {
+            long id;
+            string_view action;
+            if (!isPost) return 405;
+            if (!parseProjectPath(path, id, action)) return 404;
+            if (action == "hours") {
+                size_t key = requestBody.find("\"hours\"");
+                size_t colon = key == string_view::npos ? key : requestBody.find(':', key);
+                double hours = 0.0;
+                if (colon == string_view::npos) {
+                    body = errorBody("expected {\"hours\": <number>}");
+                    return 400;
+                }
+                size_t start = requestBody.find_first_not_of(" \t", colon + 1);
+                if (start == string_view::npos
+                    || from_chars(requestBody.data() + start, requestBody.data() + requestBody.size(), hours).ec != errc()
+                    || !isfinite(hours)) {
+                    body = errorBody("expected {\"hours\": <number>}");
+                    return 400;
+                }
+                engine.logHours(id, hours);
+                body = "{\"id\":" + to_string(id) + "}";
+                return 200;
+            }
+            if (action == "complete") {
+                double paid = engine.completeProject(id);
+                body = "{\"id\":" + to_string(id) + ",\"paid\":";
+                appendNumber(body, paid);
+                body += "}";
+                return 200;
+            }
+            return 404;
+        }
+        if (path.substr(0, 10) == "/balances/") {
+            if (!isGet) return 405;
+            string email;
+            if (!percentDecode(path.substr(10), email)) {
+                body = errorBody("malformed percent-encoding in path");
+                return 400;
+            }
+            EngineService::Balance balance = engine.getBalance(email);
+            body = "{\"email\":";
+            appendJsonString(body, email);
+            body += ",\"earned\":";
+            appendNumber(body, balance.earned);
+            body += ",\"spent\":";
+            appendNumber(body, balance.spent);
+            body += "}";
+            return 200;
+        }
+        return 404;
+    }
+
+public:
+    HttpHandler(EngineService& service) : engine(service) {}
+
+    size_t handle(const char* data, size_t length, string& output, bool& closeAfterWrite) override {
+        size_t consumed = 0;
+        while (consumed < length && !closeAfterWrite) {
+            string_view pending(data + consumed, length - consumed);
+            size_t headerEnd = pending.find("\r\n\r\n");
+            if (headerEnd == string_view::npos) break;
+            string_view head = pending.substr(0, headerEnd);
+
+            // Request line: METHOD SP TARGET SP VERSION
+            size_t lineEnd = head.find("\r\n");
+            string_view requestLine = head.substr(0, lineEnd);
+            size_t firstSpace = requestLine.find(' ');
+            size_t secondSpace = requestLine.find(' ', firstSpace + 1);
+            if (firstSpace == string_view::npos || secondSpace == string_view::npos) {
+                appendResponse(output, 400, errorBody("bad request line"), false);
+                closeAfterWrite = true;
+                break;
+            }
+            string_view method = requestLine.substr(0, firstSpace);
+            string_view target = requestLine.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+            string_view version = requestLine.substr(secondSpace + 1);
+            bool keepAlive = version == "HTTP/1.1";
+
+            size_t contentLength = 0;
+            bool lengthSeen = false, badLength = false, transferEncoded = false;
+            size_t pos = lineEnd == string_view::npos ? head.size() : lineEnd + 2;
+            while (pos < head.size()) {
+                size_t end = head.find("\r\n", pos);
+                if (end == string_view::npos) end = head.size();
+                string_view header = head.substr(pos, end - pos);
+                size_t colon = header.find(':');
+                if (colon != string_view::npos) {
+                    string_view name = header.substr(0, colon);
+                    size_t valueStart = header.find_first_not_of(' ', colon + 1);
+                    string_view value = valueStart == string_view::npos ? string_view() : header.substr(valueStart);
+                    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+                    if (equalsIgnoreCase(name, "Content-Length")) {
+                        // Digits only, and repeated headers must agree, or the body boundary is unknown
+                        size_t length = 0;
+                        from_chars_result parsed = from_chars(value.data(), value.data() + value.size(), length);
+                        if (value.empty() || parsed.ec != errc() || parsed.ptr != value.data() + value.size()
+                            || (lengthSeen && length != contentLength)) {
+                            badLength = true;
+                        }
+                        contentLength = length;
+                        lengthSeen = true;
+                    }
+                    else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+                        transferEncoded = true;
+                    }
+                    else if (equalsIgnoreCase(name, "Connection")) {
+                        if (equalsIgnoreCase(value, "close")) keepAlive = false;
+                        else if (equalsIgnoreCase(value, "keep-alive")) keepAlive = true;
+                    }
+                }
+                pos = end + 2;
+            }
+
+            if (badLength) {
+                appendResponse(output, 400, errorBody("invalid Content-Length"), false);
+                closeAfterWrite = true;
+                break;
+            }
+            if (transferEncoded) {
+                // Chunked bodies are not decoded; reading on would treat chunk data as the next request
+                appendResponse(output, 501, errorBody("Transfer-Encoding is not supported; send Content-Length"), false);
+                closeAfterWrite = true;
+                break;
+            }
+            if (contentLength > MAX_BODY) {
+                appendResponse(output, 413, errorBody("request body too large"), false);
+                closeAfterWrite = true;
+                break;
+            }
+            size_t total = headerEnd + 4 + contentLength;
+            if (pending.size() < total) break;  // Wait for the rest of the body
+            string_view requestBody = pending.substr(headerEnd + 4, contentLength);
+            consumed += total;
+
+            size_t query = target.find('?');
+            string_view path = target.substr(0, query);
+            string body;
+            const char* contentType = "application/json";
+            int status;
+            try {
+                status = route(method, path, requestBody, body, contentType);
+            }
+            catch (const UnknownProjectException& e) {
+                status = 404;
+                body = errorBody(e.what());
+            }
+            catch (const InvalidHoursException& e) {
+                status = 400;
+                body = errorBody(e.what());
+            }
+            catch (const exception& e) {
+                status = 422;
+                body = errorBody(e.what());
+            }
+            if (body.empty()) body = errorBody(status == 404 ? "not found" : "method not allowed");
+            appendResponse(output, status, body, keepAlive, contentType);
+            if (!keepAlive) closeAfterWrite = true;
+        }
+        return consumed;
+    }
+};
+
+// Serves HTTP from a fixed pool of event-loop threads. Each thread owns its
+// own epoll loop and listening socket on the shared port (SO_REUSEPORT), so
+// the kernel spreads connections across threads without a shared accept lock.
+void runHttpService(const string& port, unsigned threadCount) {
+    raiseDescriptorLimit();
+    signal(SIGINT, requestServerStop);
+    signal(SIGTERM, requestServerStop);
+    signal(SIGPIPE, SIG_IGN);
+    if (threadCount == 0) threadCount = 1;
+
+    EngineService engine("payment_receipts.txt");
+    AnomalyScorer anomalies;
+    AnomalyScorer::setActive(&anomalies);
+    vector<HttpHandler*> handlers;
+    vector<EventLoopServer*> servers;
+    try {
+        for (unsigned i = 0; i < threadCount; i++) {
+            handlers.push_back(new HttpHandler(engine));
+            servers.push_back(new EventLoopServer(*handlers.back()));
+            servers.back()->listenOn(port, true);
+        }
+    }
+    catch (const exception& e) {
+        cerr << "HTTP service failed to start: " << e.what() << endl;
+        for (EventLoopServer* server : servers) delete server;
+        for (HttpHandler* handler : handlers) delete handler;
+        AnomalyScorer::setActive(nullptr);
+        return;
+    }
+
+    cout << "HTTP API listening on http://127.0.0.1:" << port << " with "
+        << threadCount << " event loop thread(s) (Ctrl+C to stop)" << endl;
+    {
+        ConsoleSilencer silence;
+        vector<thread> loops;
+        for (EventLoopServer* server : servers) {
+            loops.emplace_back([server]() { server->run(); });
+        }
+        for (thread& loop : loops) loop.join();
+    }
+    cout << "HTTP API stopped with " << engine.openProjects() << " open project(s)" << endl;
+    AnomalyScorer::setActive(nullptr);
+
+    for (EventLoopServer* server : servers) delete server;
+    for (HttpHandler* handler : handlers) delete handler;
+}
+
+// Posts each batch as JSON lines to POST /notifications on a loopback port,
+// one connection per batch; anything but a 2xx answer is a failed delivery
+class HttpNotificationSink : public NotificationSink {
+private:
+    string port;
+
+public:
+    explicit HttpNotificationSink(const string& targetPort) : port(targetPort) {}
+
+    void deliver(const vector<Notification>& batch, uint64_t batchOffset) override {
+        string body;
+        for (const Notification& notification : batch) notification.appendJson(body);
+        string request = "POST /notifications HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/x-ndjson\r\n"
+            "X-Batch-Offset: " + to_string(batchOffset) + "\r\nContent-Length: " + to_string(body.size())
+            + "\r\nConnection: close\r\n\r\n" + body;
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(atoi(port.c_str())));
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw runtime_error(string("socket: ") + strerror(errno));
+        timeval timeout = {5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            string reason = strerror(errno);
+            close(fd);
+            throw runtime_error("connect to port " + port + ": " + reason);
+        }
+        for (size_t sent = 0; sent < request.size();) {
+            ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                close(fd);
+                throw runtime_error("send failed");
+            }
+            sent += static_cast<size_t>(n);
+        }
+        string response;
+        char buffer[4096];
+        ssize_t n;
+        while (response.find("\r\n") == string::npos && (n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, static_cast<size_t>(n));
+        }
+        close(fd);
+        int status = 0;
+        size_t space = response.find(' ');
+        if (space != string::npos) status = atoi(response.c_str() + space + 1);
+        if (status < 200 || status >= 300) {
+            throw runtime_error(status ? "HTTP " + to_string(status) : string("no response"));
+        }
+    }
+};
+
+// Local stand-in for a notification service: accepts POST /notifications,
+// appends the body to a file and answers 202, or 503 for a given share of
+// requests so the dispatcher's retries can be exercised
+class NotificationStubHandler : public RequestHandler {
+private:
+    ofstream inbox;
+    int failPercent;
+    mt19937 random;
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+
+public:
+    NotificationStubHandler(const string& inboxFile, int failurePercent)
+        : inbox(inboxFile, ios::app | ios::binary), failPercent(failurePercent), random(1) {
+        if (!inbox.is_open()) throw runtime_error("Unable to open " + inboxFile);
+    }
+
+    uint64_t acceptedCount() const { return accepted; }
+    uint64_t rejectedCount() const { return rejected; }
+
+    size_t handle(const char* data, size_t length, string& output, bool& closeAfterWrite) override {
+        string_view pending(data, length);
+        size_t headerEnd = pending.find("\r\n\r\n");
+        if (headerEnd == string_view::npos) return 0;
+        string_view head = pending.substr(0, headerEnd);
+        size_t contentLength = 0;
+        size_t header = head.find("Content-Length: ");
+        if (header != string_view::npos) {
+            const char* value = head.data() + header + 16;
+            from_chars(value, head.data() + head.size(), contentLength);
+        }
+        if (pending.size() < headerEnd + 4 + contentLength) return 0;  // Wait for the rest of the body
+        string_view body = pending.substr(headerEnd + 4, contentLength);
+
+        int status;
+        if (head.substr(0, 20) != "POST /notifications ") status = 404;
+        else if (static_cast<int>(random() % 100) < failPercent) status = 503;
+        else {
+            inbox.write(body.data(), static_cast<streamsize>(body.size()));
+            inbox.flush();
+            status = inbox ? 202 : 500;
+        }
+        if (status == 202) accepted++;
+        else rejected++;
+        output += "HTTP/1.1 " + to_string(status) + (status == 202 ? " Accepted" : " Error")
+            + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        closeAfterWrite = true;
+        return headerEnd + 4 + contentLength;
+    }
+};
+
+void runNotificationStub(const string& port, const string& inboxFile, int failPercent) {
+    signal(SIGINT, requestServerStop);
+    signal(SIGTERM, requestServerStop);
+    signal(SIGPIPE, SIG_IGN);
+    try {
+        NotificationStubHandler handler(inboxFile, failPercent);
+        EventLoopServer server(handler);
+        server.listenOn(port);
+        cout << "Notification stub listening on " << port << ", appending to " << inboxFile << ", failing "
+            << failPercent << "% of requests (Ctrl+C to stop)" << endl;
+        server.run();
+        cout << "Notification stub stopped: " << handler.acceptedCount() << " batch(es) accepted, "
+            << handler.rejectedCount() << " rejected" << endl;
+    }
+    catch (const exception& e) {
+        cerr << "Notification stub failed: " << e.what() << endl;
+    }
+}
+
+// Keep-alive load generator for the HTTP API: opens the given number of
+// connections and runs projects through the engine endpoints in rounds of up
+// to 16 per connection. Each round pipelines the POST /projects requests, then
+// for every project created its hours (hourly ones), its completion and the
+// freelancer's balance, and finally reports requests and projects per second
+void runHttpLoadTest(const string& port, size_t connectionCount, size_t projectsPerConnection) {
+    const size_t depth = 16;
+    raiseDescriptorLimit();
+
+    vector<int> sockets;
+    for (size_t i = 0; i < connectionCount; i++) {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(atoi(port.c_str())));
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            cerr << "Unable to connect to port " << port << ": " << strerror(errno) << endl;
+            if (fd >= 0) close(fd);
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockets.push_back(fd);
+    }
+    if (sockets.empty()) return;
+
+    auto post = [](const string& path, const string& body) {
+        return "POST " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " + to_string(body.size())
+            + "\r\n\r\n" + body;
+    };
+    // Freelancer emails contain '+', so the balance path exercises percent-decoding
+    auto freelancerNumber = [](size_t connection, size_t project) { return (connection * 7919 + project) % 1000; };
+    auto isHourly = [](size_t project) { return project % 2 == 1; };
+
+    size_t completed = 0, failures = 0, projects = 0;
+    vector<string> pendingInput(sockets.size());
+    // Reads count responses from connection c, keeping 2xx bodies (empty otherwise) when bodies is set
+    auto readResponses = [&](size_t c, size_t count, vector<string>* bodies) {
+        string& in = pendingInput[c];
+        size_t responses = 0;
+        char chunk[16 * 1024];
+        while (responses < count) {
+            size_t headerEnd = in.find("\r\n\r\n");
+            if (headerEnd != string::npos) {
+                size_t lengthPos = in.find("Content-Length: ");
+                size_t bodyLength = lengthPos < headerEnd ? strtoul(in.c_str() + lengthPos + 16, nullptr, 10) : 0;
+                if (in.size() >= headerEnd + 4 + bodyLength) {
+                    bool ok = in.compare(0, 10, "HTTP/1.1 2") == 0;
+                    if (ok) completed++;
+                    else failures++;
+                    if (bodies) bodies->push_back(ok ? in.substr(headerEnd + 4, bodyLength) : string());
+                    in.erase(0, headerEnd + 4 + bodyLength);
+                    responses++;
+                    continue;
+                }
+            }
+            ssize_t got = recv(sockets[c], chunk, sizeof(chunk), 0);
+            if (got <= 0) {
+                failures += count - responses;
+                if (bodies) bodies->resize(bodies->size() + count - responses);
+                break;
+            }
+            in.append(chunk, got);
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<vector<string>> created(sockets.size());
+    vector<size_t> followUps(sockets.size());
+    for (size_t done = 0; done < projectsPerConnection; done += depth) {
+        size_t count = min(depth, projectsPerConnection - done);
+        for (size_t c = 0; c < sockets.size(); c++) {
+            string batch;
+            for (size_t i = 0; i < count; i++) {
+                size_t f = freelancerNumber(c, done + i);
+                batch += post("/projects", "{\"client_name\": \"Client " + to_string(c) + "\", \"client_email\": \"client"
+                    + to_string(c) + "@company.com\", \"client_company\": \"Load\", \"freelancer_name\": \"Freelancer "
+                    + to_string(f) + "\", \"freelancer_email\": \"dev" + to_string(f) + "+http@freelance.com\", "
+                    + "\"freelancer_skills\": \"Testing\", \"freelancer_rate\": 50, \"project\": \"HTTP load\", "
+                    + "\"milestone\": \"Delivery\", \"description\": \"Synthetic\", \"milestone_type\": \""
+                    + (isHourly(done + i) ? "hourly" : "fixed") + "\", \"payment\": \"escrow\", \"amount\": 500}");
+            }
+            if (::send(sockets[c], batch.data(), batch.size(), MSG_NOSIGNAL) < 0) failures += count;
+        }
+        for (size_t c = 0; c < sockets.size(); c++) {
+            created[c].clear();
+            readResponses(c, count, &created[c]);
+        }
+
+        for (size_t c = 0; c < sockets.size(); c++) {
+            string batch;
+            followUps[c] = 0;
+            for (size_t i = 0; i < created[c].size(); i++) {
+                size_t idStart = created[c][i].find("\"id\":");
+                if (idStart == string::npos) continue;
+                string id = to_string(strtol(created[c][i].c_str() + idStart + 5, nullptr, 10));
+                if (isHourly(done + i)) {
+                    batch += post("/projects/" + id + "/hours", "{\"hours\": 8}");
+                    followUps[c]++;
+                }
+                batch += post("/projects/" + id + "/complete", "");
+                batch += "GET /balances/dev" + to_string(freelancerNumber(c, done + i))
+                    + "%2Bhttp%40freelance.com HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+                followUps[c] += 2;
+                projects++;
+            }
+            if (!batch.empty() && ::send(sockets[c], batch.data(), batch.size(), MSG_NOSIGNAL) < 0) {
+                failures += followUps[c];
+                followUps[c] = 0;
+            }
+        }
+        for (size_t c = 0; c < sockets.size(); c++) readResponses(c, followUps[c], nullptr);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (int fd : sockets) close(fd);
+
+    cout << "HTTP load test: " << sockets.size() << " connections, " << projects << " projects, " << completed
+        << " requests OK, " << failures << " failed in " << seconds << " s";
+    if (seconds > 0) {
+        cout << " (" << static_cast<size_t>(completed / seconds) << " requests/s, "
+            << static_cast<size_t>(projects / seconds) << " projects/s)";
+    }
+    cout << endl;
+}
+
+#endif
+
+// Drains the receipt ledger's notifications to a directory of batch files, or
+// with an all-digit target to POST /notifications on that loopback port
+void runNotificationDispatcher(const string& ledgerFile, const string& target, size_t batchSize, bool follow) {
+    NotificationSink* sink = nullptr;
+    try {
+        if (!target.empty() && all_of(target.begin(), target.end(), ::isdigit)) {
+#ifdef __linux__
+            sink = new HttpNotificationSink(target);
+#else
+            cerr << "Delivering to a port requires Linux" << endl;
+            return;
+#endif
+        }
+        else {
+            sink = new FileNotificationSink(target);
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Notification dispatcher failed to start: " << e.what() << endl;
+        return;
+    }
+
+    signal(SIGINT, NotificationDispatcher::requestStop);
+    signal(SIGTERM, NotificationDispatcher::requestStop);
+#ifdef __linux__
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    NotificationDispatcher dispatcher(ledgerFile, ledgerFile + ".outbox-cursor", *sink, batchSize);
+    uint64_t start = dispatcher.getCursor();
+    cout << "Dispatching notifications from " << ledgerFile << " at offset " << start << " to " << target
+        << (follow ? " (following, Ctrl+C to stop)" : "") << endl;
+    auto begin = chrono::steady_clock::now();
+    try {
+        dispatcher.run(follow, chrono::milliseconds(200));
+    }
+    catch (const exception& e) {
+        cerr << "Notification dispatcher stopped: " << e.what() << endl;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << "Delivered " << dispatcher.deliveredCount() << " notification(s) in " << dispatcher.batchCount()
+        << " batch(es) with " << dispatcher.failureCount() << " failed attempt(s) in " << seconds << " s; cursor "
+        << start << " -> " << dispatcher.getCursor() << endl;
+    delete sink;
+}
+
+// Shape of the synthetic traffic produced by the load generator
+struct LoadProfile {
+    size_t projects = 10000;
+    double ratePerSecond = 0.0;      // Project arrivals per second; 0 runs flat out
+    unsigned threads = 1;
+    double hourlyShare = 0.5;        // Hourly vs fixed-price milestones
+    double escrowShare = 0.5;        // Escrow vs direct payments
+    double invalidHoursRate = 0.01;  // Hourly projects logging negative hours
+    double paymentFailureRate = 0.01;  // Fixed-price projects with a zero amount
+    uint64_t seed = 1;
+    string target = "inproc";        // "inproc", or a service port / socket path
+    string receiptFile;              // In-process receipts; empty uses a scratch file removed afterwards
+};
+
+// One synthetic project and the outcome the generator expects from it
+struct SyntheticProject {
+    string json;
+    bool hourly;
+    double hours;
+    enum Outcome { PAID, INVALID_HOURS, PAYMENT_FAILURE } expected;
+};
+
+class WorkloadGenerator {
+private:
+    const LoadProfile& profile;
+    mt19937_64 rng;
+    uniform_real_distribution<double> unit;
+
+public:
+    WorkloadGenerator(const LoadProfile& loadProfile, uint64_t stream)
+        : profile(loadProfile), rng(loadProfile.seed * 1000003 + stream), unit(0.0, 1.0) {
+    }
+
+    SyntheticProject next(size_t index) {
+        SyntheticProject p;
+        p.hourly = unit(rng) < profile.hourlyShare;
+        bool escrow = unit(rng) < profile.escrowShare;
+        p.expected = SyntheticProject::PAID;
+        p.hours = 0.0;
+
+        double rate = 20.0 + floor(unit(rng) * 130.0);
+        double amount = 100.0 * (1 + static_cast<int>(unit(rng) * 50));
+        if (p.hourly) {
+            p.hours = 1.0 + floor(unit(rng) * 80.0);
+            if (unit(rng) < profile.invalidHoursRate) {
+                p.hours = -p.hours;
+                p.expected = SyntheticProject::INVALID_HOURS;
+            }
+        }
+        else if (unit(rng) < profile.paymentFailureRate) {
+            amount = 0.0;
+            p.expected = SyntheticProject::PAYMENT_FAILURE;
+        }
+
+        size_t client = rng() % 5000, freelancer = rng() % 20000;
+        p.json = "{\"client_name\": \"Client " + to_string(client) + "\", \"client_email\": \"client"
+            + to_string(client) + "@company.com\", \"client_company\": \"Company " + to_string(client % 500)
+            + "\", \"freelancer_name\": \"Freelancer " + to_string(freelancer) + "\", \"freelancer_email\": \"dev"
+            + to_string(freelancer) + "@freelance.com\", \"freelancer_skills\": \"Testing\", \"freelancer_rate\": "
+            + to_string(static_cast<int>(rate)) + ", \"project\": \"Load " + to_string(index)
+            + "\", \"milestone\": \"Milestone " + to_string(index) + "\", \"description\": \"Synthetic\", "
+            + "\"milestone_type\": \"" + (p.hourly ? "hourly" : "fixed") + "\", \"payment\": \""
+            + (escrow ? "escrow" : "direct") + "\", \"amount\": " + to_string(static_cast<int>(amount)) + "}";
+        return p;
+    }
+};
+
+// Where generated projects are sent: the engine in this process or a running service
+class WorkloadTarget {
+public:
+    virtual ~WorkloadTarget() = default;
+
+    // Runs one project end to end and reports what actually happened
+    virtual SyntheticProject::Outcome run(const SyntheticProject& project) = 0;
+};
+
+class InProcessTarget : public WorkloadTarget {
+private:
+    EngineService& engine;
+    ProjectRequestParser parser;
+
+public:
+    InProcessTarget(EngineService& service) : engine(service) {}
+
+    SyntheticProject::Outcome run(const SyntheticProject& project) override {
+        ProjectRequest req;
+        if (!parser.parse(project.json, req)) throw runtime_error("Generator produced bad JSON");
+        long id = engine.createProject(req);
+        if (project.hourly) {
+            try {
+                engine.logHours(id, project.hours);
+            }
+            catch (const InvalidHoursException&) {
+                engine.cancelProject(id);
+                return SyntheticProject::INVALID_HOURS;
+            }
+        }
+        try {
+            engine.completeProject(id);
+        }
+        catch (const WorkflowFailedException& e) {
+            engine.cancelProject(id);
+            if (e.getCause() == FAILURE_INVALID_HOURS) return SyntheticProject::INVALID_HOURS;
+            if (e.getCause() == FAILURE_PAYMENT) return SyntheticProject::PAYMENT_FAILURE;
+            throw;  // Any other failure is an error, not an outcome of the mix
+        }
+        return SyntheticProject::PAID;
+    }
+};
+
+#ifdef __linux__
+// Drives a --serve instance over its line protocol, one request at a time
+class LineServiceTarget : public WorkloadTarget {
+private:
+    int fd;
+    string input;
+
+    string call(const string& line) {
+        string request = line + "\n";
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+            throw runtime_error(string("Send failed: ") + strerror(errno));
+        }
+        size_t newline;
+        char chunk[4096];
+        while ((newline = input.find('\n')) == string::npos) {
+            ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+            if (got <= 0) throw runtime_error("Service closed the connection");
+            input.append(chunk, got);
+        }
+        string reply = input.substr(0, newline);
+        input.erase(0, newline + 1);
+        return reply;
+    }
+
+public:
+    LineServiceTarget(const string& address) : fd(-1) {
+        if (address.find('/') != string::npos) {
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                if (fd >= 0) close(fd);
+                throw runtime_error("Unable to connect to " + address + ": " + strerror(errno));
+            }
+        }
+        else {
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(static_cast<uint16_t>(atoi(address.c_str())));
+            fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                if (fd >= 0) close(fd);
+                throw runtime_error("Unable to connect to port " + address + ": " + strerror(errno));
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    }
+
+    LineServiceTarget(const LineServiceTarget&) = delete;
+    LineServiceTarget& operator=(const LineServiceTarget&) = delete;
+
+    ~LineServiceTarget() override {
+        close(fd);
+    }
+
+    SyntheticProject::Outcome run(const SyntheticProject& project) override {
+        string reply = call("CREATE " + project.json);
+        if (reply.compare(0, 3, "OK ") != 0) throw runtime_error("CREATE failed: " + reply);
+        string id = reply.substr(3);
+
+        if (project.hourly) {
+            reply = call("HOURS " + id + " " + to_string(project.hours));
+            if (reply != "OK") {
+                call("CANCEL " + id);
+                if (reply.find("Invalid hours") == string::npos) throw runtime_error("HOURS failed: " + reply);
+                return SyntheticProject::INVALID_HOURS;
+            }
+        }
+        reply = call("COMPLETE " + id);
+        if (reply.compare(0, 3, "OK ") != 0) {
+            call("CANCEL " + id);
+            // The service reports the cause as the exception name
+            if (reply.find(workflowFailureNames[FAILURE_INVALID_HOURS]) != string::npos) {
+                return SyntheticProject::INVALID_HOURS;
+            }
+            if (reply.find(workflowFailureNames[FAILURE_PAYMENT]) != string::npos) {
+                return SyntheticProject::PAYMENT_FAILURE;
+            }
+            throw runtime_error("COMPLETE failed: " + reply);
+        }
+        return SyntheticProject::PAID;
+    }
+};
+#endif
+
+// Reads a latency percentile (0..1) from sorted samples
+double percentileOf(const vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[min(index, sorted.size() - 1)];
+}
+
+// Generates the profile's traffic from profile.threads workers and prints the
+// outcome mix and latency distribution. With a target rate, latency is measured
+// from each project's scheduled start so a stalled engine shows up as queueing
+// delay instead of silently lowering the offered load.
+void runLoadGenerator(const LoadProfile& profile) {
+    unsigned threadCount = max(1u, profile.threads);
+    // Synthetic receipts never go to the real ledger
+    string receiptFile = profile.receiptFile.empty() ? "loadgen_receipts.txt" : profile.receiptFile;
+    if (profile.receiptFile.empty()) remove(receiptFile.c_str());
+    EngineService engine(receiptFile);
+    vector<vector<double>> latencies(threadCount);
+    vector<size_t> outcomes(3 * threadCount, 0);
+    vector<size_t> unexpected(threadCount, 0), errors(threadCount, 0);
+
+    cout << "Generating " << profile.projects << " projects against " << profile.target
+        << " with " << threadCount << " thread(s)";
+    if (profile.ratePerSecond > 0) cout << " at " << profile.ratePerSecond << " projects/s";
+    cout << "..." << endl;
+
+    auto start = chrono::steady_clock::now();
+    {
+        ConsoleSilencer silence;
+        vector<thread> workers;
+        for (unsigned t = 0; t < threadCount; t++) {
+            workers.emplace_back([&, t]() {
+                WorkloadTarget* target = nullptr;
+                try {
+                    if (profile.target == "inproc") target = new InProcessTarget(engine);
+#ifdef __linux__
+                    else target = new LineServiceTarget(profile.target);
+#else
+                    else throw runtime_error("Service targets require Linux");
+#endif
+                }
+                catch (const exception& e) {
+                    cerr << "Load generator thread " << t << ": " << e.what() << endl;
+                    errors[t] = 1;
+                    return;
+                }
+
+                WorkloadGenerator generator(profile, t);
+                size_t share = profile.projects / threadCount + (t < profile.projects % threadCount ? 1 : 0);
+                double interval = profile.ratePerSecond > 0 ? threadCount / profile.ratePerSecond : 0.0;
+                latencies[t].reserve(share);
+                for (size_t i = 0; i < share; i++) {
+                    SyntheticProject project = generator.next(i * threadCount + t);
+                    auto scheduled = start + chrono::duration_cast<chrono::steady_clock::duration>(
+                        chrono::duration<double>(interval * i));
+                    if (interval > 0) this_thread::sleep_until(scheduled);
+                    auto began = interval > 0 ? scheduled : chrono::steady_clock::now();
+                    try {
+                        SyntheticProject::Outcome outcome = target->run(project);
+                        outcomes[3 * t + outcome]++;
+                        if (outcome != project.expected) unexpected[t]++;
+                    }
+                    catch (const exception&) {
+                        errors[t]++;
+                        continue;
+                    }
+                    latencies[t].push_back(
+                        chrono::duration<double, micro>(chrono::steady_clock::now() - began).count());
+                }
+                delete target;
+            });
+        }
+        for (thread& worker : workers) worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> all;
+    size_t paid = 0, invalidHours = 0, paymentFailures = 0, unexpectedTotal = 0, errorTotal = 0;
+    for (unsigned t = 0; t < threadCount; t++) {
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+        paid += outcomes[3 * t + SyntheticProject::PAID];
+        invalidHours += outcomes[3 * t + SyntheticProject::INVALID_HOURS];
+        paymentFailures += outcomes[3 * t + SyntheticProject::PAYMENT_FAILURE];
+        unexpectedTotal += unexpected[t];
+        errorTotal += errors[t];
+    }
+    sort(all.begin(), all.end());
+
+    cout << "Load run finished in " << seconds << " s";
+    if (seconds > 0) cout << " (" << static_cast<size_t>(all.size() / seconds) << " projects/s)";
+    cout << endl;
+    cout << "  Paid: " << paid << ", InvalidHoursException: " << invalidHours
+        << ", PaymentFailureException: " << paymentFailures
+        << ", unexpected outcomes: " << unexpectedTotal << ", errors: " << errorTotal << endl;
+    cout << "  Latency (us) p50: " << percentileOf(all, 0.50) << "  p90: " << percentileOf(all, 0.90)
+        << "  p99: " << percentileOf(all, 0.99) << "  p99.9: " << percentileOf(all, 0.999)
+        << "  max: " << (all.empty() ? 0.0 : all.back()) << endl;
+    if (profile.receiptFile.empty()) remove(receiptFile.c_str());
+}
+
+// Parses "--loadgen [--projects N] [--rate R] [--threads T] [--hourly F] [--escrow F]
+// [--invalid-hours F] [--payment-failures F] [--seed S] [--target inproc|port|path] [--receipts FILE]"
+LoadProfile parseLoadProfile(int argc, char* argv[], int first) {
+    LoadProfile profile;
+    for (int i = first; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        const char* value = argv[i + 1];
+        if (option == "--projects") profile.projects = strtoull(value, nullptr, 10);
+        else if (option == "--rate") profile.ratePerSecond = atof(value);
+        else if (option == "--threads") profile.threads = static_cast<unsigned>(atoi(value));
+        else if (option == "--hourly") profile.hourlyShare = atof(value);
+        else if (option == "--escrow") profile.escrowShare = atof(value);
+        else if (option == "--invalid-hours") profile.invalidHoursRate = atof(value);
+        else if (option == "--payment-failures") profile.paymentFailureRate = atof(value);
+        else if (option == "--seed") profile.seed = strtoull(value, nullptr, 10);
+        else if (option == "--target") profile.target = value;
+        else if (option == "--receipts") profile.receiptFile = value;
+        else cerr << "Ignoring unknown load option " << option << endl;
+    }
+    return profile;
+}
+
+// Marketplace shape for "--simulate": how many projects arrive, what they look like and how
+// often settlement fails
+struct SimulationProfile {
+    double days = 90.0;
+    double arrivalsPerDay = 20000.0;
+    double monthlyGrowth = 0.0;        // Arrival rate growth per 30 days, e.g. 0.1 for 10%
+    size_t clients = 5000;
+    size_t freelancers = 20000;
+    double hourlyShare = 0.5;          // Hourly vs fixed-price milestones
+    double escrowShare = 0.5;          // Escrow vs direct payments
+    double meanDurationDays = 14.0;    // Mean time from arrival to completion
+    double paymentFailureRate = 0.02;  // Settlement attempts that fail and are retried
+    int settleAttempts = 4;            // Attempts before an escrow is refunded and the payout abandoned, at most 30
+    uint64_t seed = 1;
+};
+
+// Discrete-event simulation of the marketplace on the engine's own Client,
+// Freelancer, Milestone and Payment types. Events sit in a binary min-heap
+// ordered by time, then by scheduling order, so a seed always replays the
+// same history. Projects arrive as a Poisson process; hourly milestones log
+// work sessions until they complete, fixed-price ones complete after an
+// exponential delivery time. Completion is followed by settlement, which can
+// fail and is retried with exponential backoff. Escrow projects fund their
+// budget on arrival and release it on settlement or refund. In-flight
+// projects live in a slot array with a free list, so only the milestone
+// objects themselves are allocated per project.
+class MarketplaceSimulator {
+public:
+    // Activity during one simulated day; balances are as of midnight
+    struct DayStats {
+        uint64_t arrivals = 0;
+        uint64_t completions = 0;
+        uint64_t settlements = 0;
+        uint64_t paymentFailures = 0;
+        uint64_t abandoned = 0;
+        double hoursLogged = 0.0;
+        double payouts = 0.0;
+        double escrowBalance = 0.0;
+        size_t inFlight = 0;
+    };
+
+private:
+    static constexpr double DAY = 86400.0;
+
+    enum EventKind : uint8_t { EVENT_ARRIVAL, EVENT_HOURS, EVENT_COMPLETE, EVENT_SETTLE, EVENT_DAY_END };
+
+    struct Event {
+        double time;        // Seconds since the start of the simulation
+        uint64_t sequence;  // Breaks ties by scheduling order
+        uint32_t project;
+        EventKind kind;
+
+        bool operator>(const Event& other) const {
+            return time > other.time || (time == other.time && sequence > other.sequence);
+        }
+    };
+
+    struct InFlightProject {
+        Milestone* milestone = nullptr;  // Null while the slot is free
+        uint32_t client = 0;
+        uint32_t freelancer = 0;
+        double hours = 0.0;
+        int sessionsLeft = 0;
+        double funded = 0.0;  // Held in escrow until settlement
+        double due = 0.0;
+        double amount = 0.0;
+        int attempts = 0;
+        bool hourly = false;
+    };
+
+    const SimulationProfile& profile;
+    mt19937_64 rng;
+    uniform_real_distribution<double> unit;
+    vector<Client*> clients;
+    vector<Freelancer*> freelancers;
+    vector<InFlightProject> projects;
+    vector<uint32_t> freeSlots;
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+    uint64_t sequence = 0;
+    uint64_t processed = 0;
+    size_t peakQueue = 0;
+    size_t inFlight = 0;
+    double escrowBalance = 0.0;
+    vector<double> clientSpend;
+    vector<DayStats> days;
+    DayStats today;
+
+    double exponential(double mean) {
+        return -mean * log(1.0 - unit(rng));
+    }
+
+    void schedule(double time, EventKind kind, uint32_t project) {
+        events.push(Event{time, sequence++, project, kind});
+        peakQueue = max(peakQueue, events.size());
+    }
+
+    double arrivalRate(double time) const {
+        return profile.arrivalsPerDay * pow(1.0 + profile.monthlyGrowth, time / (30.0 * DAY)) / DAY;
+    }
+
+    void arrive(double now) {
+        schedule(now + exponential(1.0 / arrivalRate(now)), EVENT_ARRIVAL, 0);
+        today.arrivals++;
+
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = static_cast<uint32_t>(projects.size());
+            projects.emplace_back();
+        }
+        InFlightProject& project = projects[slot];
+        project = InFlightProject();
+        project.client = static_cast<uint32_t>(rng() % clients.size());
+        project.freelancer = static_cast<uint32_t>(rng() % freelancers.size());
+        project.hourly = unit(rng) < profile.hourlyShare;
+        bool escrow = unit(rng) < profile.escrowShare;
+        double duration = exponential(profile.meanDurationDays * DAY);
+        project.due = now + profile.meanDurationDays * DAY * 1.25;
+
+        double rate = freelancers[project.freelancer]->getHourlyRate();
+        double budget;
+        if (project.hourly) {
+            project.sessionsLeft = 1 + static_cast<int>(rng() % 10);
+            budget = project.sessionsLeft * 4.5 * rate;  // Expected hours at the freelancer's rate
+        }
+        else {
+            budget = 100.0 * (1 + static_cast<int>(rng() % 50));
+        }
+        Payment* payment = escrow ? static_cast<Payment*>(new Escrow(budget)) : new Direct(budget);
+        if (project.hourly) project.milestone = new HourlyMilestone("Simulated", "", payment, rate);
+        else project.milestone = new FixedPriceMilestone("Simulated", "", payment, budget);
+        if (escrow) {
+            project.funded = budget;
+            escrowBalance += budget;
+        }
+        inFlight++;
+
+        if (project.hourly) schedule(now + duration / project.sessionsLeft, EVENT_HOURS, slot);
+        else schedule(now + duration, EVENT_COMPLETE, slot);
+    }
+
+    void logHours(double now, uint32_t slot) {
+        InFlightProject& project = projects[slot];
+        double session = 1.0 + floor(unit(rng) * 8.0);
+        project.hours += session;
+        today.hoursLogged += session;
+        static_cast<HourlyMilestone*>(project.milestone)->setHoursWorked(project.hours);
+        double gap = exponential(profile.meanDurationDays * DAY / 5.5);
+        if (--project.sessionsLeft > 0) schedule(now + gap, EVENT_HOURS, slot);
+        else schedule(now + gap, EVENT_COMPLETE, slot);
+    }
+
+    void complete(double now, uint32_t slot) {
+        InFlightProject& project = projects[slot];
+        project.milestone->complete();
+        project.amount = project.milestone->calculatePayment();
+        freelancers[project.freelancer]->recordCompletion(now <= project.due);
+        today.completions++;
+        schedule(now + exponential(DAY / 4), EVENT_SETTLE, slot);
+    }
+
+    void settle(double now, uint32_t slot) {
+        InFlightProject& project = projects[slot];
+        project.attempts++;
+        if (unit(rng) < profile.paymentFailureRate) {
+            today.paymentFailures++;
+            if (project.attempts < profile.settleAttempts) {
+                schedule(now + ldexp(3600.0, project.attempts), EVENT_SETTLE, slot);
+                return;
+            }
+            today.abandoned++;  // Escrowed funds go back to the client
+        }
+        else {
+            project.milestone->paymentMethod->processPayment();
+            today.settlements++;
+            today.payouts += project.amount;
+            clientSpend[project.client] += project.amount;
+        }
+        escrowBalance -= project.funded;
+        delete project.milestone;
+        project.milestone = nullptr;
+        freeSlots.push_back(slot);
+        inFlight--;
+    }
+
+    void endDay(double now) {
+        today.escrowBalance = escrowBalance;
+        today.inFlight = inFlight;
+        days.push_back(today);
+        today = DayStats();
+        schedule(now + DAY, EVENT_DAY_END, 0);
+    }
+
+public:
+    explicit MarketplaceSimulator(const SimulationProfile& simulationProfile)
+        : profile(simulationProfile), rng(simulationProfile.seed), unit(0.0, 1.0),
+        clientSpend(max<size_t>(1, simulationProfile.clients), 0.0) {
+        for (size_t i = 0; i < max<size_t>(1, profile.clients); i++) {
+            clients.push_back(new Client("Client " + to_string(i), "client" + to_string(i) + "@company.com",
+                "Company " + to_string(i % 500)));
+        }
+        for (size_t i = 0; i < max<size_t>(1, profile.freelancers); i++) {
+            freelancers.push_back(new Freelancer("Freelancer " + to_string(i), "dev" + to_string(i) + "@freelance.com",
+                "Testing", 20.0 + static_cast<double>(rng() % 130)));
+        }
+    }
+
+    ~MarketplaceSimulator() {
+        for (InFlightProject& project : projects) delete project.milestone;
+        for (Client* client : clients) delete client;
+        for (Freelancer* freelancer : freelancers) delete freelancer;
+    }
+
+    MarketplaceSimulator(const MarketplaceSimulator&) = delete;
+    MarketplaceSimulator& operator=(const MarketplaceSimulator&) = delete;
+
+    // Runs until the configured horizon; returns the number of events processed
+    uint64_t run() {
+        double horizon = profile.days * DAY;
+        schedule(exponential(1.0 / arrivalRate(0.0)), EVENT_ARRIVAL, 0);
+        schedule(DAY, EVENT_DAY_END, 0);
+        while (!events.empty() && events.top().time <= horizon) {
+            Event event = events.top();
+            events.pop();
+            processed++;
+            switch (event.kind) {
+            case EVENT_ARRIVAL: arrive(event.time); break;
+            case EVENT_HOURS: logHours(event.time, event.project); break;
+            case EVENT_COMPLETE: complete(event.time, event.project); break;
+            case EVENT_SETTLE: settle(event.time, event.project); break;
+            case EVENT_DAY_END: endDay(event.time); break;
+            }
+        }
+        return processed;
+    }
+
+    const vector<DayStats>& getDays() const { return days; }
+    size_t getPeakQueue() const { return peakQueue; }
+    size_t getInFlight() const { return inFlight; }
+    double getEscrowBalance() const { return escrowBalance; }
+
+    // The client who paid the most, with the amount
+    pair<const Client*, double> topClient() const {
+        size_t best = max_element(clientSpend.begin(), clientSpend.end()) - clientSpend.begin();
+        return make_pair(clients[best], clientSpend[best]);
+    }
+
+    // Hash of every daily figure; equal seeds and profiles give equal fingerprints
+    uint64_t fingerprint() const {
+        uint64_t hash = 1469598103934665603ULL;
+        auto mix = [&hash](uint64_t value) {
+            hash ^= value;
+            hash *= 1099511628211ULL;
+        };
+        for (const DayStats& day : days) {
+            mix(day.arrivals);
+            mix(day.completions);
+            mix(day.settlements);
+            mix(day.paymentFailures);
+            mix(static_cast<uint64_t>(llround(day.payouts * 100.0)));
+            mix(static_cast<uint64_t>(llround(day.escrowBalance * 100.0)));
+        }
+        return hash;
+    }
+};
+
+SimulationProfile parseSimulationProfile(int argc, char* argv[], int first) {
+    SimulationProfile profile;
+    for (int i = first; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        const char* value = argv[i + 1];
+        if (option == "--days") profile.days = atof(value);
+        else if (option == "--arrivals") profile.arrivalsPerDay = atof(value);
+        else if (option == "--growth") profile.monthlyGrowth = atof(value);
+        else if (option == "--clients") profile.clients = strtoull(value, nullptr, 10);
+        else if (option == "--freelancers") profile.freelancers = strtoull(value, nullptr, 10);
+        else if (option == "--hourly") profile.hourlyShare = atof(value);
+        else if (option == "--escrow") profile.escrowShare = atof(value);
+        else if (option == "--duration") profile.meanDurationDays = atof(value);
+        else if (option == "--payment-failures") profile.paymentFailureRate = atof(value);
+        else if (option == "--attempts") profile.settleAttempts = min(max(1, atoi(value)), 30);  // 2^30 h is plenty
+        else if (option == "--seed") profile.seed = strtoull(value, nullptr, 10);
+        else cerr << "Ignoring unknown simulation option " << option << endl;
+    }
+    return profile;
+}
+
+// Simulates the profile and prints weekly load and escrow figures
+void runSimulation(const SimulationProfile& profile) {
+    cout << "Simulating " << profile.days << " days, " << profile.arrivalsPerDay << " arrivals/day";
+    if (profile.monthlyGrowth != 0.0) cout << " growing " << profile.monthlyGrowth * 100.0 << "%/month";
+    cout << ", seed " << profile.seed << endl;
+
+    MarketplaceSimulator* simulator = new MarketplaceSimulator(profile);
+    auto start = chrono::steady_clock::now();
+    uint64_t processed;
+    {
+        ConsoleSilencer silence;
+        AllocationSite site("simulation");
+        processed = simulator->run();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    char line[200];
+    snprintf(line, sizeof(line), "%5s %10s %10s %10s %9s %9s %11s %16s %16s", "week", "arrivals", "completed",
+        "settled", "failures", "abandoned", "in flight", "escrow held", "paid out");
+    cout << "\n" << line << endl;
+    const vector<MarketplaceSimulator::DayStats>& days = simulator->getDays();
+    MarketplaceSimulator::DayStats total, busiest;
+    for (size_t first = 0; first < days.size(); first += 7) {
+        MarketplaceSimulator::DayStats week;
+        for (size_t d = first; d < min(days.size(), first + 7); d++) {
+            week.arrivals += days[d].arrivals;
+            week.completions += days[d].completions;
+            week.settlements += days[d].settlements;
+            week.paymentFailures += days[d].paymentFailures;
+            week.abandoned += days[d].abandoned;
+            week.payouts += days[d].payouts;
+            week.hoursLogged += days[d].hoursLogged;
+            week.inFlight = days[d].inFlight;
+            week.escrowBalance = days[d].escrowBalance;
+            if (days[d].settlements > busiest.settlements) busiest = days[d];
+        }
+        snprintf(line, sizeof(line), "%5zu %10llu %10llu %10llu %9llu %9llu %11zu %16.2f %16.2f", first / 7 + 1,
+            static_cast<unsigned long long>(week.arrivals), static_cast<unsigned long long>(week.completions),
+            static_cast<unsigned long long>(week.settlements), static_cast<unsigned long long>(week.paymentFailures),
+            static_cast<unsigned long long>(week.abandoned), week.inFlight, week.escrowBalance, week.payouts);
+        cout << line << endl;
+        total.arrivals += week.arrivals;
+        total.settlements += week.settlements;
+        total.paymentFailures += week.paymentFailures;
+        total.payouts += week.payouts;
+        total.hoursLogged += week.hoursLogged;
+    }
+
+    pair<const Client*, double> top = simulator->topClient();
+    cout << "\nTotals: " << total.arrivals << " projects, " << total.settlements << " settled, "
+        << total.paymentFailures << " failed settlement attempts, " << total.hoursLogged << " hours logged, $"
+        << formatCents(llround(total.payouts * 100.0)) << " paid out" << endl;
+    cout << "Busiest day: " << busiest.settlements << " settlements (" << busiest.settlements / 86400.0
+        << "/s average)" << endl;
+    cout << "Top client: " << top.first->getName() << " with $" << formatCents(llround(top.second * 100.0)) << endl;
+    cout << "End state: " << simulator->getInFlight() << " projects in flight, $"
+        << formatCents(llround(simulator->getEscrowBalance() * 100.0)) << " in escrow" << endl;
+    cout << "Processed " << processed << " events in " << seconds << " s ("
+        << (seconds > 0 ? processed / seconds / 1e6 : 0) << "M events/s, peak queue " << simulator->getPeakQueue()
+        << ")" << endl;
+    snprintf(line, sizeof(line), "%016llx", static_cast<unsigned long long>(simulator->fingerprint()));
+    cout << "Fingerprint: " << line << endl;
+    delete simulator;
+}
+
+// One benchmark measurement
+struct BenchResult {
+    string name;
+    size_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double opsPerSecond;
+    HardwareSample hardware;  // Totals over all iterations, where counters were available
+};
+
+// Keeps benchmark results alive so the optimizer cannot drop the work
+volatile double benchSink = 0.0;
+
+// Times iterations calls of op after a short warm-up, counting allocations on this thread
+template <typename Op>
+BenchResult measure(const string& name, size_t iterations, Op op) {
+    for (size_t i = 0; i < min<size_t>(iterations / 10, 1000); i++) op(i);
+
+    HardwareCounters counters;
+    uint64_t allocsBefore = threadAllocations.count;
+    HardwareSample hardwareBefore = counters.read();
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) op(i);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    HardwareSample hardwareAfter = counters.read();
+    uint64_t allocs = threadAllocations.count - allocsBefore;
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = seconds * 1e9 / iterations;
+    result.allocsPerOp = static_cast<double>(allocs) / iterations;
+    result.opsPerSecond = seconds > 0 ? iterations / seconds : 0.0;
+    result.hardware = HardwareCounters::delta(hardwareBefore, hardwareAfter);
+    return result;
+}
+
+// Instructions per cycle, or a negative value when either counter is missing
+double instructionsPerCycle(const HardwareSample& sample) {
+    if (!sample.valid[HW_CYCLES] || !sample.valid[HW_INSTRUCTIONS] || sample.values[HW_CYCLES] == 0) return -1.0;
+    return static_cast<double>(sample.values[HW_INSTRUCTIONS]) / sample.values[HW_CYCLES];
+}
+
+// One synthetic project per index, alternating fixed-price/escrow and hourly/direct,
+// as run by the macro benchmarks and the diagnostic mode
+double runSyntheticWorkflow(size_t i, const string& receiptFile) {
+    Milestone* milestone = nullptr;
+    if (i % 2 == 0) {
+        milestone = new FixedPriceMilestone("Website", "Full stack", new Escrow(2500.0), 2500.0);
+    }
+    else {
+        HourlyMilestone* hm = new HourlyMilestone("Support", "Hourly work", new Direct(0.0), 50.0);
+        hm->setHoursWorked(10.0 + i % 30);
+        milestone = hm;
+    }
+    Project project("Project " + to_string(i),
+        new Client("Client", "client@company.com", "Company"),
+        new Freelancer("Freelancer", "dev@freelance.com", "Testing", 50.0),
+        milestone, new Logger(receiptFile));
+    return project.executeProjectWorkflow();
+}
+
+// Runs the benchmark suite and writes the results as JSON to outputFile.
+// Macro benchmarks run whole workflows at 10^3 up to 10^maxExponent projects.
+void runBenchmarks(const string& outputFile, int maxExponent) {
+    const string receiptFile = "bench_receipts.txt";
+    vector<BenchResult> results;
+    auto report = [&results](const BenchResult& r) {
+        results.push_back(r);
+        cerr << "  " << r.name << ": " << r.nsPerOp << " ns/op, " << r.allocsPerOp << " allocs/op, "
+            << static_cast<size_t>(r.opsPerSecond) << " ops/s";
+        double ipc = instructionsPerCycle(r.hardware);
+        if (ipc >= 0) cerr << ", IPC " << ipc;
+        for (int event : {HW_CACHE_MISSES, HW_BRANCH_MISSES}) {
+            if (r.hardware.valid[event]) {
+                cerr << ", " << static_cast<double>(r.hardware.values[event]) / r.iterations << " "
+                    << hardwareEventNames[event] << "/op";
+            }
+        }
+        cerr << endl;
+    };
+
+    HardwareCounters probe;
+    if (!probe.available()) cerr << "Hardware counters unavailable, reporting wall clock only: " << probe.reason() << endl;
+
+    cerr << "Running micro benchmarks..." << endl;
+    {
+        ConsoleSilencer silence;
+
+        report(measure("user_construction", 1000000, [](size_t) {
+            User* client = new Client("John Smith", "john@company.com", "TechCorp");
+            User* freelancer = new Freelancer("Alice Johnson", "alice@freelance.com", "C++ Development", 75.0);
+            benchSink = benchSink + client->getName().size() + freelancer->getEmail().size();
+            delete client;
+            delete freelancer;
+        }));
+
+        FixedPriceMilestone fixed("Website", "Full stack", new Escrow(2500.0), 2500.0);
+        fixed.complete();
+        report(measure("calculate_payment_fixed", 10000000, [&fixed](size_t) {
+            benchSink = benchSink + fixed.calculatePayment();
+        }));
+
+        HourlyMilestone hourly("Support", "Monthly support", new Direct(0.0), 50.0);
+        hourly.setHoursWorked(12.5);
+        hourly.complete();
+        report(measure("calculate_payment_hourly", 10000000, [&hourly](size_t) {
+            benchSink = benchSink + hourly.calculatePayment();
+        }));
+
+        Escrow escrow(2500.0);
+        report(measure("process_payment_escrow", 1000000, [&escrow](size_t) {
+            escrow.processPayment();
+        }));
+
+        Direct direct(2500.0);
+        report(measure("process_payment_direct", 1000000, [&direct](size_t) {
+            direct.processPayment();
+        }));
+
+        Logger logger(receiptFile);
+        report(measure("log_payment_receipt", 20000, [&logger](size_t) {
+            logger.logPaymentReceipt("Website", 2500.0, "Escrow");
+        }));
+
+        report(measure("execute_project_workflow", 20000, [&receiptFile](size_t) {
+            Project project("E-Commerce Website",
+                new Client("John Smith", "john@company.com", "TechCorp"),
+                new Freelancer("Alice Johnson", "alice@freelance.com", "C++ Development", 75.0),
+                new FixedPriceMilestone("Website", "Full stack", new Escrow(2500.0), 2500.0),
+                new Logger(receiptFile));
+            benchSink = benchSink + project.executeProjectWorkflow();
+        }));
+    }
+
+    cerr << "Running macro benchmarks..." << endl;
+    for (int exponent = 3; exponent <= maxExponent; exponent++) {
+        size_t projects = 1;
+        for (int i = 0; i < exponent; i++) projects *= 10;
+
+        ConsoleSilencer silence;
+        BenchResult r = measure("workflows_1e" + to_string(exponent), projects, [&receiptFile](size_t i) {
+            benchSink = benchSink + runSyntheticWorkflow(i, receiptFile);
+        });
+        report(r);
+        remove(receiptFile.c_str());
+    }
+    remove(receiptFile.c_str());
+
+    ofstream out(outputFile);
+    if (!out.is_open()) {
+        cerr << "Unable to write benchmark results to " << outputFile << endl;
+        return;
+    }
+    time_t now = time(nullptr);
+    out << "{\n  \"timestamp\": " << now << ",\n  \"compiler\": \"" << __VERSION__ << "\",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.nsPerOp << ", \"allocs_per_op\": " << r.allocsPerOp
+            << ", \"ops_per_sec\": " << r.opsPerSecond;
+        for (int event = 0; event < HW_EVENT_COUNT; event++) {
+            out << ", \"" << hardwareEventNames[event] << "_per_op\": ";
+            if (r.hardware.valid[event]) out << static_cast<double>(r.hardware.values[event]) / r.iterations;
+            else out << "null";
+        }
+        double ipc = instructionsPerCycle(r.hardware);
+        out << ", \"ipc\": ";
+        if (ipc >= 0) out << ipc;
+        else out << "null";
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    cerr << "Benchmark results written to " << outputFile << endl;
+}
+
+// Diagnostic mode: runs synthetic projects on this thread with hardware counters read
+// around every workflow stage, then reports per-project cycles, instructions, IPC and
+// misses for each stage. Falls back to wall-clock time when counters are unavailable.
+void runDiagnostics(size_t projects) {
+    const string receiptFile = "diagnose_receipts.txt";
+    HardwareStageProfile* profile = new HardwareStageProfile();
+    if (!profile->getCounters().available()) {
+        cerr << "Hardware counters unavailable: " << profile->getCounters().reason() << endl;
+    }
+
+    HardwareSample before = profile->read();
+    auto start = chrono::steady_clock::now();
+    {
+        ConsoleSilencer silence;
+        profile->install();
+        for (size_t i = 0; i < projects; i++) benchSink = benchSink + runSyntheticWorkflow(i, receiptFile);
+        profile->uninstall();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    HardwareSample total = HardwareCounters::delta(before, profile->read());
+    remove(receiptFile.c_str());
+
+    auto perProject = [projects](const HardwareSample& sample, int event) {
+        char cell[32];
+        if (sample.valid[event]) snprintf(cell, sizeof(cell), "%.1f", static_cast<double>(sample.values[event]) / projects);
+        else snprintf(cell, sizeof(cell), "n/a");
+        return string(cell);
+    };
+    auto row = [&perProject](const char* name, const HardwareSample& sample) {
+        double ipc = instructionsPerCycle(sample);
+        char ipcCell[16];
+        if (ipc >= 0) snprintf(ipcCell, sizeof(ipcCell), "%.2f", ipc);
+        else snprintf(ipcCell, sizeof(ipcCell), "n/a");
+        char line[200];
+        snprintf(line, sizeof(line), "%-10s %14s %14s %6s %14s %14s", name, perProject(sample, HW_CYCLES).c_str(),
+            perProject(sample, HW_INSTRUCTIONS).c_str(), ipcCell, perProject(sample, HW_CACHE_MISSES).c_str(),
+            perProject(sample, HW_BRANCH_MISSES).c_str());
+        cerr << line << endl;
+    };
+
+    cerr << "\n=== HARDWARE COUNTERS PER PROJECT (" << projects << " projects, "
+        << seconds * 1e9 / projects << " ns/project) ===" << endl;
+    char header[200];
+    snprintf(header, sizeof(header), "%-10s %14s %14s %6s %14s %14s", "stage", "cycles", "instructions", "IPC",
+        "cache misses", "branch misses");
+    cerr << header << endl;
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        row(workflowStageNames[stage], profile->getTotals(static_cast<WorkflowStage>(stage)));
+    }
+    row("total", total);
+    delete profile;
+}
+
+// Maps skill names to bit positions so a freelancer's skills fit in one 64-bit mask
+class SkillDictionary {
+private:
+    vector<string> skills;
+
+    static string normalize(const string& skill) {
+        size_t start = skill.find_first_not_of(" \t");
+        size_t end = skill.find_last_not_of(" \t");
+        if (start == string::npos) return "";
+        string key = skill.substr(start, end - start + 1);
+        for (char& c : key) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        return key;
+    }
+
+public:
+    static constexpr int MAX_SKILLS = 64;
+
+    // Returns the bit for a skill without registering it; -1 if unknown
+    int find(const string& skill) const {
+        string key = normalize(skill);
+        for (size_t i = 0; i < skills.size(); i++) {
+            if (skills[i] == key) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Returns the bit for a skill, registering it if new.
+    // Once 64 skills exist, further skills get no bit (-1) and never match.
+    int bitFor(const string& skill) {
+        int bit = find(skill);
+        if (bit >= 0) return bit;
+        if (skills.size() < MAX_SKILLS) {
+            skills.push_back(normalize(skill));
+            return static_cast<int>(skills.size() - 1);
+        }
+        return -1;
+    }
+
+    // Skill lists are written like "C++, SQL; Testing"
+    uint64_t maskFor(const string& skillList) {
+        uint64_t mask = 0;
+        size_t start = 0;
+        while (start <= skillList.size()) {
+            size_t end = skillList.find_first_of(",;", start);
+            if (end == string::npos) end = skillList.size();
+            string skill = skillList.substr(start, end - start);
+            if (!normalize(skill).empty()) {
+                int bit = bitFor(skill);
+                if (bit >= 0) mask |= uint64_t(1) << bit;
+            }
+            start = end + 1;
+        }
+        return mask;
+    }
+
+    // Mask of a skill list for a query, leaving the dictionary untouched;
+    // false if any listed skill has no bit, as no freelancer can have it
+    bool lookupMask(const string& skillList, uint64_t& mask) const {
+        mask = 0;
+        size_t start = 0;
+        while (start <= skillList.size()) {
+            size_t end = skillList.find_first_of(",;", start);
+            if (end == string::npos) end = skillList.size();
+            string skill = skillList.substr(start, end - start);
+            if (!normalize(skill).empty()) {
+                int bit = find(skill);
+                if (bit < 0) return false;
+                mask |= uint64_t(1) << bit;
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+};
+
+struct MatchResult {
+    size_t index;  // Position of the freelancer in the pool
+    double score;
+};
+
+// Columnar store of freelancer attributes used for ranking.
+// Each attribute lives in its own contiguous array so the scoring loop
+// streams through memory and can be auto-vectorized by the compiler.
+class FreelancerPool {
+private:
+    SkillDictionary dictionary;
+    vector<uint64_t> skillMasks;
+    vector<float> hourlyRates;
+    vector<float> onTimeRates;
+    vector<float> scratchScores;
+
+    static constexpr size_t BLOCK_SIZE = 4096;
+
+public:
+    size_t add(const Freelancer& freelancer) {
+        return add(dictionary.maskFor(freelancer.getSkillSet()),
+            freelancer.getHourlyRate(), freelancer.getOnTimeRate());
+    }
+
+    size_t add(uint64_t skillMask, double rate, double onTimeRate) {
+        skillMasks.push_back(skillMask);
+        hourlyRates.push_back(static_cast<float>(rate));
+        onTimeRates.push_back(static_cast<float>(onTimeRate));
+        return skillMasks.size() - 1;
+    }
+
+    void reserve(size_t count) {
+        skillMasks.reserve(count);
+        hourlyRates.reserve(count);
+        onTimeRates.reserve(count);
+    }
+
+    size_t size() const { return skillMasks.size(); }
+    SkillDictionary& getDictionary() { return dictionary; }
+
+    // Ranks freelancers for a project needing requiredSkills at no more than maxRate per hour.
+    // Score = 50% skill coverage + 30% rate headroom + 20% on-time history.
+    // Freelancers over budget or with no matching skill are filtered out, and a
+    // required skill no freelancer in the pool lists matches nobody.
+    vector<MatchResult> topK(const string& requiredSkills, double maxRate, size_t k) {
+        uint64_t required = 0;
+        vector<MatchResult> results;
+        if (!dictionary.lookupMask(requiredSkills, required)) return results;
+        if (k == 0 || required == 0 || maxRate <= 0) return results;
+
+        const float requiredCount = static_cast<float>(__builtin_popcountll(required));
+        const float budget = static_cast<float>(maxRate);
+        scratchScores.resize(BLOCK_SIZE);
+
+        // Min-heap on score holding the best k seen so far
+        auto worse = [](const MatchResult& a, const MatchResult& b) { return a.score > b.score; };
+        priority_queue<MatchResult, vector<MatchResult>, decltype(worse)> best(worse);
+
+        for (size_t base = 0; base < size(); base += BLOCK_SIZE) {
+            size_t count = min(BLOCK_SIZE, size() - base);
+            const uint64_t* masks = &skillMasks[base];
+            const float* rates = &hourlyRates[base];
+            const float* onTime = &onTimeRates[base];
+            float* scores = scratchScores.data();
+
+            // Branch-free filter and score pass; rejected rows get a negative score
+            for (size_t i = 0; i < count; i++) {
+                float overlap = static_cast<float>(__builtin_popcountll(masks[i] & required));
+                float coverage = overlap / requiredCount;
+                float headroom = 1.0f - 0.5f * rates[i] / budget;
+                float score = 0.5f * coverage + 0.3f * headroom + 0.2f * onTime[i];
+                bool eligible = (overlap > 0.0f) & (rates[i] <= budget);
+                scores[i] = eligible ? score : -1.0f;
+            }
+
+            float threshold = best.size() == k ? static_cast<float>(best.top().score) : 0.0f;
+            for (size_t i = 0; i < count; i++) {
+                if (scores[i] <= threshold) continue;
+                best.push(MatchResult{ base + i, scores[i] });
+                if (best.size() > k) best.pop();
+                if (best.size() == k) threshold = static_cast<float>(best.top().score);
+            }
+        }
+
+        results.reserve(best.size());
+        while (!best.empty()) {
+            results.push_back(best.top());
+            best.pop();
+        }
+        reverse(results.begin(), results.end());
+        return results;
+    }
+};
+
+// Helper function to handle input buffer cleaning
+void clearInput() {
+    cin.clear();
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+}
+
+void runCustomProject() {
+    AllocationSite site("custom project");
+    string cName, cEmail, cCompany;
+    string fName, fEmail, fSkill;
+    string pName, mTitle, mDesc;
+    double fRate, mAmount;
+    int typeChoice, payChoice;
+
+    cout << "\n--- CREATE CUSTOM PROJECT ---\n";
+
+    // Client Input
+    clearInput();
+    cout << "Enter Client Name: "; getline(cin, cName);
+    cout << "Enter Client Email: "; getline(cin, cEmail);
+    cout << "Enter Client Company: "; getline(cin, cCompany);
+
+    // Freelancer Input
+    cout << "Enter Freelancer Name: "; getline(cin, fName);
+    cout << "Enter Freelancer Email: "; getline(cin, fEmail);
+    cout << "Enter Freelancer Skill: "; getline(cin, fSkill);
+    cout << "Enter Freelancer Hourly Rate: "; cin >> fRate;
+    clearInput();
+
+    // Project Details
+    cout << "Enter Project Name: "; getline(cin, pName);
+    cout << "Enter Milestone Title: "; getline(cin, mTitle);
+    cout << "Enter Milestone Description: "; getline(cin, mDesc);
+
+    // Type Selection
+    cout << "Select Milestone Type (1: Fixed Price, 2: Hourly): ";
+    cin >> typeChoice;
+
+    // Payment Selection
+    cout << "Select Payment Method (1: Escrow, 2: Direct): ";
+    cin >> payChoice;
+
+    // Object Creation
+    User* client = new Client(cName, cEmail, cCompany);
+    User* freelancer = new Freelancer(fName, fEmail, fSkill, fRate);
+    Payment* payment = nullptr;
+    Milestone* milestone = nullptr;
+
+    // 1. Setup Payment
+    if (payChoice == 1) payment = new Escrow(0); // Amount set later based on milestone
+    else payment = new Direct(0);
+
+    // 2. Setup Milestone
+    if (typeChoice == 1) {
+        cout << "Enter Fixed Price Amount: "; cin >> mAmount;
+        // Re-create payment with correct amount for fixed price
+        delete payment;
+        if (payChoice == 1) payment = new Escrow(mAmount);
+        else payment = new Direct(mAmount);
+
+        milestone = new FixedPriceMilestone(mTitle, mDesc, payment, mAmount);
+    }
+    else {
+        // Hourly
+        double hours;
+        cout << "Enter Hours Worked: "; cin >> hours;
+
+        // Use freelancer rate for payment calculation
+        if (payChoice == 1) payment = new Escrow(0); // Calculated dynamically
+        else payment = new Direct(0);
+
+        HourlyMilestone* hm = new HourlyMilestone(mTitle, mDesc, payment, fRate);
+        try {
+            hm->setHoursWorked(hours);
+            milestone = hm;
+        }
+        catch (...) {
+            delete client; delete freelancer; delete hm;
+            cout << "Invalid hours input. Aborting.\n";
+            return;
+        }
+    }
+
+    // Execute
+    Project* project = new Project(pName, client, freelancer, milestone, new Logger("payment_receipts.txt"));
     project->executeProjectWorkflow();
     delete project;
 }
 
 void runHardcodedDemos() {
+    AllocationSite site("demos");
     Logger* logger = new Logger("payment_receipts.txt");
 
     cout << "\n--- Demo 1: Fixed Price ---" << endl;
@@ -454,20 +9437,964 @@ void runHardcodedDemos() {
     }
 }
 
-int main() {
+void runMatchingDemo() {
+    string skills;
+    double maxRate;
+    size_t poolSize = 1000000;
+
+    cout << "\n--- FIND FREELANCERS ---\n";
+    clearInput();
+    cout << "Enter Required Skills (comma separated): "; getline(cin, skills);
+    cout << "Enter Maximum Hourly Rate: "; cin >> maxRate;
+
+    FreelancerPool pool;
+    pool.reserve(poolSize);
+
+    // A few named freelancers plus a synthetic marketplace to search through
+    vector<Freelancer*> named;
+    named.push_back(new Freelancer("Alice Johnson", "alice@freelance.com", "C++ Development, Testing", 75.0));
+    named.push_back(new Freelancer("Bob Lee", "bob@freelance.com", "Web Design, JavaScript", 40.0));
+    named.push_back(new Freelancer("Carla Diaz", "carla@freelance.com", "Python, SQL, Testing", 55.0));
+    named[0]->recordCompletion(true);
+    named[2]->recordCompletion(true);
+    named[2]->recordCompletion(false);
+    for (Freelancer* f : named) pool.add(*f);
+
+    const char* catalog[] = { "C++ Development", "Web Design", "JavaScript", "Python", "SQL",
+        "Testing", "Copywriting", "DevOps", "Data Analysis", "Mobile Apps" };
+    for (const char* skill : catalog) pool.getDictionary().bitFor(skill);
+
+    mt19937 rng(42);
+    uniform_real_distribution<double> rateDist(15.0, 150.0);
+    uniform_real_distribution<double> onTimeDist(0.0, 1.0);
+    while (pool.size() < poolSize) {
+        uint64_t mask = (uint64_t(1) << (rng() % 10)) | (uint64_t(1) << (rng() % 10));
+        pool.add(mask, rateDist(rng), onTimeDist(rng));
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<MatchResult> matches = pool.topK(skills, maxRate, 5);
+    auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << "\nTop matches out of " << pool.size() << " freelancers (" << elapsed << " ms):" << endl;
+    for (const MatchResult& m : matches) {
+        if (m.index < named.size()) {
+            cout << "  Score " << m.score << " - ";
+            named[m.index]->displayInfo();
+        }
+        else {
+            cout << "  Score " << m.score << " - Marketplace freelancer #" << m.index << endl;
+        }
+    }
+    if (matches.empty()) {
+        cout << "  No freelancer matches those skills within budget." << endl;
+    }
+
+    for (Freelancer* f : named) delete f;
+}
+
+// Regression checks for edge cases, run by "--self-test". Each check throws
+// runtime_error describing the first expectation that failed.
+void expectThat(bool condition, const string& what) {
+    if (!condition) throw runtime_error(what);
+}
+
+string selfTestPath(const string& name) {
+    return (filesystem::temp_directory_path() / ("freelance_engine_selftest_" + name)).string();
+}
+
+// A row that starts just before one thread's range end but crosses the
+// importer's 4 MiB read boundary must be imported whole, by exactly one thread
+void checkImportRowAcrossRanges() {
+    string path = selfTestPath("users.csv");
+    const size_t rowLength = 48, rows = 174761, lastLength = 72;  // 8,388,600 bytes; 2 threads split at 4,194,300
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        char line[96];
+        for (size_t i = 0; i < rows; i++) {
+            snprintf(line, sizeof(line), "freelancer,U%06zu,u%06zu@x.com,Skillxxxxxx,75\n", i, i);
+            out.write(line, rowLength);
+        }
+        snprintf(line, sizeof(line), "freelancer,U%06zu,u%06zu@x.com,Skill%s,75\n", rows, rows, string(30, 'x').c_str());
+        out.write(line, lastLength);
+    }
+    expectThat(filesystem::file_size(path) == 8388600, "test file has the expected size");
+    size_t crossing = 4194288 / rowLength;  // Starts before 4,194,300 and ends after 4,194,304
+    for (unsigned threads = 1; threads <= 3; threads++) {
+        UserDirectory directory;
+        UserCsvImporter::Stats stats;
+        {
+            ConsoleSilencer silence;
+            stats = UserCsvImporter(path, directory).run(threads);
+        }
+        string label = to_string(threads) + " thread(s): ";
+        expectThat(stats.imported == rows + 1, label + "imported " + to_string(stats.imported) + " of " + to_string(rows + 1));
+        expectThat(stats.malformed == 0 && stats.invalidRate == 0, label + "no rows rejected");
+        char email[32];
+        snprintf(email, sizeof(email), "u%06zu@x.com", crossing);
+        const Freelancer* user = dynamic_cast<const Freelancer*>(directory.find(email));
+        expectThat(user && user->getHourlyRate() == 75.0, label + "row across the boundary keeps its rate");
+    }
+    remove(path.c_str());
+}
+
+// Escrow request shared by the escrow checks
+ProjectRequest selfTestEscrowRequest() {
+    ProjectRequest req;
+    req.clientName = "Client";
+    req.clientEmail = "client@company.com";
+    req.freelancerName = "Freelancer";
+    req.freelancerEmail = "dev@freelance.com";
+    req.freelancerSkills = "Testing";
+    req.freelancerRate = 50.0;
+    req.projectName = "Escrow check";
+    req.milestoneTitle = "Delivery";
+    req.escrow = true;
+    req.amount = 250.0;
+    return req;
+}
+
+// Keeps every notification the dispatcher delivers
+struct SelfTestSink : NotificationSink {
+    vector<Notification> sent;
+
+    void deliver(const vector<Notification>& batch, uint64_t) override {
+        sent.insert(sent.end(), batch.begin(), batch.end());
+    }
+};
+
+// An expired hold refunded to the client pays the freelancer nothing: not in
+// the balances, not in the live listeners and not when the ledger is reloaded
+void checkEscrowRefundEarnsNothing() {
+    string path = selfTestPath("refund_receipts.txt");
+    remove(path.c_str());
+    ReceiptStore live;
+    TopNTracker earners;
+    Logger::addListener(&live);
+    Logger::addListener(&earners);
+    try {
+        EngineService engine(path);
+        engine.setEscrowExpiry(60, ESCROW_REFUND);
+        {
+            ConsoleSilencer silence;
+            engine.createProject(selfTestEscrowRequest());
+            expectThat(engine.sweepEscrow(static_cast<int64_t>(time(nullptr)) + 120, 16) == 1, "hold refunded");
+        }
+        expectThat(engine.getBalance("dev@freelance.com").earned == 0.0, "refund credits no freelancer earnings");
+        expectThat(engine.getBalance("client@company.com").spent == 0.0, "refund charges the client nothing");
+    }
+    catch (...) {
+        Logger::removeListener(&live);
+        Logger::removeListener(&earners);
+        throw;
+    }
+    Logger::removeListener(&live);
+    Logger::removeListener(&earners);
+    expectThat(live.size() == 0, "listeners skip the refund");
+    expectThat(earners.top(TOP_EARNERS, 10).empty(), "refund adds no top earner");
+
+    ifstream in(path);
+    stringstream text;
+    text << in.rdbuf();
+    expectThat(text.str().find("Payment Type: Escrow Refund") != string::npos, "refund receipt written");
+    expectThat(text.str().find("Freelancer:") == string::npos, "refund receipt names no freelancer");
+    ReceiptStore reloaded;
+    expectThat(reloaded.loadReceiptFile(path) == 0, "ledger reload skips the refund");
+    in.close();
+
+    SelfTestSink sink;
+    string cursorPath = path + ".outbox-cursor";
+    remove(cursorPath.c_str());
+    NotificationDispatcher(path, cursorPath, sink, 16).drainOnce();
+    expectThat(sink.sent.size() == 1 && sink.sent[0].event == "escrow_refunded"
+        && sink.sent[0].recipient == "client@company.com", "refund notifies only the client, as escrow_refunded");
+    remove(cursorPath.c_str());
+    remove(path.c_str());
+}
+
+// Releasing an hourly hold with no hours logged fails; that hold must stay
+// open for COMPLETE or CANCEL while the rest of the batch is paid and screened
+void checkEscrowReleaseKeepsUnpayableHolds() {
+    string path = selfTestPath("release_receipts.txt");
+    remove(path.c_str());
+    AnomalyScorer scorer;
+    AnomalyScorer::setActive(&scorer);
+    try {
+        EngineService engine(path);
+        engine.setEscrowExpiry(60, ESCROW_RELEASE);
+        ProjectRequest fixed = selfTestEscrowRequest();
+        ProjectRequest hourly = selfTestEscrowRequest();
+        hourly.hourly = true;
+        long hourlyId;
+        {
+            ConsoleSilencer silence;
+            engine.createProject(fixed);
+            hourlyId = engine.createProject(hourly);
+            expectThat(engine.sweepEscrow(static_cast<int64_t>(time(nullptr)) + 120, 16) == 2, "both holds handled");
+        }
+        size_t held = 0, disputed = 0;
+        engine.escrowHoldCounts(held, disputed);
+        expectThat(held == 1 && disputed == 1, "unpayable hold kept in the book");
+        expectThat(engine.openProjects() == 1, "unpayable project left open");
+        expectThat(engine.getBalance("dev@freelance.com").earned == 250.0, "fixed hold released");
+        expectThat(scorer.screenedCount() == 1, "release screened");
+        {
+            ConsoleSilencer silence;
+            engine.logHours(hourlyId, 2.0);
+            engine.completeProject(hourlyId);
+        }
+        expectThat(engine.getBalance("dev@freelance.com").earned == 350.0, "held project completes later");
+    }
+    catch (...) {
+        AnomalyScorer::setActive(nullptr);
+        throw;
+    }
+    AnomalyScorer::setActive(nullptr);
+    remove(path.c_str());
+}
+
+// Deep nesting and long chains are rejected as syntax errors instead of
+// exhausting the stack, and so are amounts strtod reads as nan or inf
+void checkQueryLimits() {
+    auto rejected = [](const string& text) {
+        try {
+            ReceiptQuery query(text);
+        }
+        catch (const QuerySyntaxException&) {
+            return true;
+        }
+        return false;
+    };
+    auto repeat = [](const string& text, size_t times) {
+        string out;
+        for (size_t i = 0; i < times; i++) out += text;
+        return out;
+    };
+    expectThat(rejected(repeat("(", 200000) + "amount > 5" + repeat(")", 200000)), "deep parentheses rejected");
+    expectThat(rejected(repeat("not ", 200000) + "amount > 5"), "deep not chain rejected");
+    expectThat(rejected("amount > 5" + repeat(" or amount > 5", 200000)), "long or chain rejected");
+    expectThat(!rejected(repeat("(", 60) + "amount > 5" + repeat(")", 60)), "moderate nesting accepted");
+    expectThat(!rejected("amount > 5" + repeat(" or amount > 5", 40)), "moderate chain accepted");
+    for (const char* amount : {"nan", "inf", "-infinity", "$NaN", "1e300"}) {
+        expectThat(rejected(string("amount > ") + amount), string("amount ") + amount + " rejected");
+    }
+
+    // Time operands saturate at INT64_MAX; bounds one past them must not overflow
+    ReceiptStore store;
+    store.append("client@company.com", "dev@freelance.com", "Escrow", "Logo", 10000, parseReportDate("2026-03-10"));
+    auto matches = [&store](const string& text) { return ReceiptQuery(text).execute(store, 0).matches; };
+    expectThat(matches("time > 9223372036854775807") == 0, "nothing after the last representable time");
+    expectThat(matches("time > 99999999999999999999") == 0, "oversized time saturates");
+    expectThat(matches("time <= 9223372036854775807") == 1, "everything up to the last representable time");
+    expectThat(matches("time = 9223372036854775807") == 0, "no receipt at the last representable time");
+}
+
+// A workflow's billed rate always equals its Freelancer's rate, so the rate
+// rule must judge it against the freelancer's earlier bills, and a flagged
+// settlement must say so on its receipt
+void checkAnomalyRateAgainstHistory() {
+    string path = selfTestPath("anomaly_receipts.txt");
+    remove(path.c_str());
+    AnomalyScorer scorer;
+    AnomalyScorer::setActive(&scorer);
+    try {
+        EngineService engine(path);
+        ProjectRequest req = selfTestEscrowRequest();
+        req.hourly = true;
+        req.hours = 10.0;
+        ConsoleSilencer silence;
+        string clients[7];
+        for (int i = 0; i < 7; i++) {
+            clients[i] = "client" + to_string(i) + "@company.com";  // Fresh clients keep the spend rule quiet
+            req.clientEmail = clients[i];
+            req.freelancerRate = i < 6 ? 50.0 : 200.0;
+            engine.runProject(req);
+        }
+    }
+    catch (...) {
+        AnomalyScorer::setActive(nullptr);
+        throw;
+    }
+    AnomalyScorer::setActive(nullptr);
+
+    ifstream in(path);
+    stringstream text;
+    text << in.rdbuf();
+    string receipts = text.str();
+    size_t marker = receipts.find("Anomalies: ");
+    expectThat(marker != string::npos, "rate jump flagged on its receipt");
+    expectThat(receipts.compare(marker, 16, "Anomalies: rate\n") == 0, "only the rate rule fired");
+    expectThat(receipts.rfind("=== PAYMENT RECEIPT ===") < marker, "marker is on the last receipt");
+    expectThat(receipts.find("Anomalies: ", marker + 1) == string::npos, "steady rates not flagged");
+    in.close();
+    remove(path.c_str());
+}
+
+// Searching must not register skills, an unknown required skill matches
+// nobody, and skills past the 64th never match anything
+void checkSkillMatchingDictionary() {
+    FreelancerPool pool;
+    Freelancer tester("Tess", "tess@free.com", "Testing, SQL", 50.0);
+    pool.add(tester);
+    expectThat(pool.topK("Testing", 100.0, 5).size() == 1, "known skill matches");
+    expectThat(pool.topK("Testing, Underwater Welding", 100.0, 5).empty(), "unknown required skill matches nobody");
+    expectThat(pool.getDictionary().find("Underwater Welding") < 0, "search leaves the dictionary untouched");
+
+    for (int i = 0; pool.getDictionary().bitFor("Skill " + to_string(i)) >= 0; i++) {}
+    expectThat(pool.getDictionary().bitFor("One Too Many") < 0, "skills past the limit get no bit");
+    Freelancer late("Lou", "lou@free.com", "One Too Many", 50.0);
+    pool.add(late);
+    vector<MatchResult> lastSkill = pool.topK("Skill 61", 100.0, 5);
+    expectThat(lastSkill.empty(), "overflow skills share no bit with the last skill");
+    expectThat(pool.topK("One Too Many", 100.0, 5).empty(), "overflow skill never matches");
+}
+
+// Clients whose emails only differ in characters a file name cannot hold get
+// separate invoices, an invoice keeps its number when other clients join, and
+// only months with receipts get a directory
+void checkInvoiceNamesAndNumbers() {
+    string directory = selfTestPath("invoices");
+    filesystem::remove_all(directory);
+    InvoiceTemplate layout(InvoiceTemplate::defaultText);
+    int64_t when = parseReportDate("2026-03-10");
+    auto numberOf = [](const string& path) {
+        ifstream in(path);
+        string line;
+        getline(in, line);
+        return line;
+    };
+    auto invoicesIn = [&directory]() {
+        vector<string> paths;
+        for (const auto& entry : filesystem::directory_iterator(directory + "/2026-03")) paths.push_back(entry.path().string());
+        sort(paths.begin(), paths.end());
+        return paths;
+    };
+
+    ReceiptStore store;
+    store.append("a+b@x.com", "dev@free.com", "Escrow", "Logo", 10000, when);
+    InvoiceGenerator(layout, directory).generate(store, when, when + 86400, 1);
+    vector<string> alone = invoicesIn();
+    expectThat(alone.size() == 1, "one invoice for one client");
+    string firstNumber = numberOf(alone[0]);
+
+    store.append("a_b@x.com", "dev@free.com", "Escrow", "Logo", 20000, when);
+    store.append("0first@x.com", "dev@free.com", "Escrow", "Logo", 30000, when);
+    filesystem::remove_all(directory);
+    InvoiceGenerator(layout, directory).generate(store, when, when + 86400, 2);
+    vector<string> all = invoicesIn();
+    expectThat(all.size() == 3, "colliding names get separate files");
+    expectThat(find(all.begin(), all.end(), alone[0]) != all.end(), "file name is stable");
+    expectThat(numberOf(alone[0]) == firstNumber, "invoice number is stable");
+    expectThat(numberOf(all[0]) != numberOf(all[1]) && numberOf(all[1]) != numberOf(all[2])
+        && numberOf(all[0]) != numberOf(all[2]), "invoice numbers are distinct");
+
+    // Months between receipts have nothing to invoice and get no directory
+    ReceiptStore sparse;
+    sparse.append("a+b@x.com", "dev@free.com", "Escrow", "Logo", 10000, parseReportDate("2026-01-15"));
+    sparse.append("a+b@x.com", "dev@free.com", "Escrow", "Logo", 10000, parseReportDate("2026-04-15"));
+    filesystem::remove_all(directory);
+    InvoiceGenerator(layout, directory).generate(sparse, numeric_limits<int64_t>::min(), numeric_limits<int64_t>::max(), 1);
+    vector<string> months;
+    for (const auto& entry : filesystem::directory_iterator(directory)) months.push_back(entry.path().filename().string());
+    sort(months.begin(), months.end());
+    expectThat(months == vector<string>({"2026-01", "2026-04"}), "directories only for invoiced months");
+    filesystem::remove_all(directory);
+}
+
+// A retainer instance that fails is retried for the same period after its
+// backoff, one that keeps failing is abandoned after MAX_ATTEMPTS tries, and
+// cancelling the contract drops its pending retries
+void checkRetainerRetriesFailedInstance() {
+    const int64_t start = 1800000000;
+    RetainerScheduler scheduler(start);
+    scheduler.addTemplate(RetainerTerms());
+    scheduler.addContract(0, 1, start + 60, 1);
+    vector<int64_t> attempts;
+    RetainerScheduler::Settler flaky = [&attempts](const ProjectRequest&, int64_t due) {
+        attempts.push_back(due);
+        return attempts.size() > 1;
+    };
+    scheduler.advanceTo(start + 120, flaky);
+    RetainerScheduler::Totals totals = scheduler.totals();
+    expectThat(attempts.size() == 1 && totals.failed == 1 && totals.retrying == 1, "failed instance waits for a retry");
+    scheduler.advanceTo(start + 120 + RetainerScheduler::RETRY_BASE_SECONDS - 1, flaky);
+    expectThat(attempts.size() == 1, "retry waits for its backoff");
+    scheduler.advanceTo(start + 120 + RetainerScheduler::RETRY_BASE_SECONDS, flaky);
+    totals = scheduler.totals();
+    expectThat(attempts.size() == 2 && attempts[1] == start + 60, "retry settles the same period");
+    expectThat(totals.settled == 1 && totals.retrying == 0 && totals.abandoned == 0, "retried instance is settled");
+
+    RetainerScheduler failing(start);
+    failing.addTemplate(RetainerTerms());
+    failing.addContract(0, 1, start + 60, 1);
+    uint32_t tries = 0;
+    RetainerScheduler::Settler broken = [&tries](const ProjectRequest&, int64_t) {
+        tries++;
+        return false;
+    };
+    for (int64_t hour = 1; hour <= 24 * 7; hour++) failing.advanceTo(start + hour * 3600, broken);
+    totals = failing.totals();
+    expectThat(tries == RetainerScheduler::MAX_ATTEMPTS && totals.abandoned == 1 && totals.retrying == 0,
+        "instance is abandoned after the last attempt");
+
+    RetainerScheduler cancelled(start);
+    cancelled.addTemplate(RetainerTerms());
+    uint32_t id = cancelled.addContract(0, 1, start + 60);
+    tries = 0;
+    cancelled.advanceTo(start + 120, broken);
+    expectThat(cancelled.cancel(id), "open-ended contract cancels");
+    cancelled.advanceTo(start + 3600, broken);
+    expectThat(tries == 1 && cancelled.totals().retrying == 0, "cancelled contract is not retried");
+}
+
+// Saved sketches are read back from disk, so entries naming a register past
+// the end or a rank addHash cannot produce are rejected rather than loaded
+void checkSketchReadRejectsBadEntries() {
+    auto sparseSketch = [](uint32_t entry) {
+        stringstream bytes;
+        bytes.put(10);
+        bytes.put(0);
+        uint32_t count = 1;
+        bytes.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        bytes.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        return bytes;
+    };
+    auto rejected = [](stringstream& bytes) {
+        try {
+            HyperLogLog::read(bytes);
+        }
+        catch (const runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    stringstream good = sparseSketch(1023u << 8 | 55);
+    expectThat(!rejected(good), "last register at the highest rank loads");
+    stringstream pastEnd = sparseSketch(1024u << 8 | 1);
+    expectThat(rejected(pastEnd), "register past the end is rejected");
+    stringstream highRank = sparseSketch(5u << 8 | 56);
+    expectThat(rejected(highRank), "rank above 65 - precision is rejected");
+
+    stringstream dense;
+    dense.put(4);
+    dense.put(1);
+    for (int i = 0; i < 16; i++) dense.put(static_cast<char>(i == 7 ? 62 : 1));
+    expectThat(rejected(dense), "dense register above the highest rank is rejected");
+}
+
+// A milestone title carrying a receipt separator must not forge a second
+// receipt in the ledger: the parser and buildProject refuse it, so the
+// dispatcher sees one receipt and sends one notification pair
+void checkReceiptTextCannotForgeReceipts() {
+    const string forged = "Logo\n========================\n=== PAYMENT RECEIPT ===\n"
+        "Client: Victim <victim@bank.com>\nAmount: $999999";
+    ProjectRequestParser parser;
+    ProjectRequest parsed;
+    expectThat(!parser.parse("{\"milestone\": \"Logo\\n=== PAYMENT RECEIPT ===\"}", parsed),
+        "parser rejects an escaped newline in text");
+
+    string path = selfTestPath("forged_receipts.txt");
+    string cursorPath = path + ".outbox-cursor";
+    remove(path.c_str());
+    remove(cursorPath.c_str());
+    {
+        EngineService engine(path);
+        ConsoleSilencer silence;
+        engine.runProject(selfTestEscrowRequest());
+        ProjectRequest req = selfTestEscrowRequest();
+        req.milestoneTitle = forged;
+        bool refused = false;
+        try {
+            engine.runProject(req);
+        }
+        catch (const runtime_error&) {
+            refused = true;
+        }
+        expectThat(refused, "buildProject refuses a title with a newline");
+    }
+
+    SelfTestSink sink;
+    NotificationDispatcher(path, cursorPath, sink, 16).drainOnce();
+    expectThat(sink.sent.size() == 2, "one notification pair");
+    for (const Notification& n : sink.sent) expectThat(n.recipient != "victim@bank.com", "no forged recipient");
+    remove(cursorPath.c_str());
+    remove(path.c_str());
+}
+
+// nan and inf are not JSON and no amount or hours can be either; they must
+// never reach the ledger, balances or the anomaly screen's running statistics
+void checkNonFiniteNumbersRejected() {
+    ProjectRequestParser parser;
+    ProjectRequest req;
+    expectThat(!parser.parse("{\"amount\": nan}", req), "parser rejects nan");
+    expectThat(!parser.parse("{\"hours\": inf}", req), "parser rejects inf");
+    expectThat(!parser.parse("{\"amount\": 1e999}", req), "parser rejects an overflowing amount");
+    expectThat(parser.parse("{\"amount\": 2.5e3}", req) && req.amount == 2500.0, "parser keeps exponents");
+
+    req = selfTestEscrowRequest();
+    req.hourly = true;
+    req.hours = numeric_limits<double>::quiet_NaN();
+    bool refused = false;
+    try {
+        delete buildProject(req, new Logger(selfTestPath("unused_receipts.txt")));
+    }
+    catch (const runtime_error&) {
+        refused = true;
+    }
+    expectThat(refused, "buildProject refuses nan hours");
+
+    HourlyMilestone milestone("Work", "", new Direct(0.0), 50.0);
+    refused = false;
+    try {
+        milestone.setHoursWorked(numeric_limits<double>::infinity());
+    }
+    catch (const InvalidHoursException&) {
+        refused = true;
+    }
+    expectThat(refused, "setHoursWorked refuses infinite hours");
+}
+
+// A monthly retainer started on the 31st is first due on the last day of
+// February, not in March, and returns to the 31st in longer months
+void checkMonthlyRetainerFromMonthEnd() {
+    tm start = {};
+    start.tm_year = 2027 - 1900;
+    start.tm_mon = 0;
+    start.tm_mday = 31;
+    start.tm_hour = 12;
+    start.tm_isdst = -1;
+    int64_t january31 = static_cast<int64_t>(mktime(&start));
+    auto dayOf = [](int64_t timestamp) {
+        time_t when = static_cast<time_t>(timestamp);
+        tm local;
+        localtime_r(&when, &local);
+        return (local.tm_mon + 1) * 100 + local.tm_mday;
+    };
+    int64_t firstDue = RetainerScheduler::monthAfter(january31, 31);
+    expectThat(dayOf(firstDue) == 228, "first instance is due on Feb 28");
+
+    RetainerScheduler scheduler(january31);
+    scheduler.addTemplate(RetainerTerms());
+    scheduler.addContract(0, 0, firstDue, 3, 31);
+    vector<int> dues;
+    RetainerScheduler::Settler record = [&dues, &dayOf](const ProjectRequest&, int64_t due) {
+        dues.push_back(dayOf(due));
+        return true;
+    };
+    scheduler.advanceTo(january31 + 100 * 86400, record);
+    expectThat(dues == vector<int>({228, 331, 430}), "instances fall on Feb 28, Mar 31 and Apr 30");
+}
+
+// When the sweep cannot write its receipts, the released holds go back in
+// the book untouched and the next sweep pays them exactly once
+void checkEscrowSweepSurvivesLedgerFailure() {
+    string path = selfTestPath("unwritable_receipts.txt");
+    filesystem::remove_all(path);
+    filesystem::create_directories(path);  // A directory cannot be opened as the ledger
+    EngineService engine(path);
+    engine.setEscrowExpiry(60, ESCROW_RELEASE);
+    int64_t later = static_cast<int64_t>(time(nullptr)) + 120;
+    bool failed = false;
+    {
+        ConsoleSilencer silence;
+        engine.createProject(selfTestEscrowRequest());
+        try {
+            engine.sweepEscrow(later, 16);
+        }
+        catch (const runtime_error&) {
+            failed = true;
+        }
+    }
+    size_t held = 0, disputed = 0;
+    engine.escrowHoldCounts(held, disputed);
+    expectThat(failed, "sweep reports the ledger failure");
+    expectThat(held == 1 && disputed == 0 && engine.openProjects() == 1, "hold and project stay open");
+    expectThat(engine.getBalance("dev@freelance.com").earned == 0.0, "nothing credited");
+
+    filesystem::remove_all(path);
+    {
+        ConsoleSilencer silence;
+        expectThat(engine.sweepEscrow(later, 16) == 1, "next sweep releases the hold");
+    }
+    expectThat(engine.getBalance("dev@freelance.com").earned == 250.0 && engine.openProjects() == 0, "paid once");
+    remove(path.c_str());
+}
+
+// TOP answers for the week the clock is in, not the week of the last receipt:
+// after a quiet week the old counts are "previous", then gone
+void checkTopWindowFollowsClock() {
+    TopNTracker tracker;
+    int64_t monday = 4 * 86400 + 2900 * 7 * 86400;
+    tracker.add("client@company.com", "dev@freelance.com", 25000, monday + 3600);
+    expectThat(tracker.top(TOP_EARNERS, 5, false, monday + 86400).size() == 1, "counted this week");
+    expectThat(tracker.top(TOP_EARNERS, 5, true, monday + 86400).empty(), "nothing the week before");
+    expectThat(tracker.top(TOP_EARNERS, 5, false, monday + 8 * 86400).empty(), "quiet week reports nothing");
+    expectThat(tracker.top(TOP_EARNERS, 5, true, monday + 8 * 86400).size() == 1, "last week's counts are previous");
+    expectThat(tracker.top(TOP_EARNERS, 5, true, monday + 15 * 86400).empty(), "two weeks on they are gone");
+    expectThat(tracker.top(TOP_EARNERS, 5).size() == 1, "latest receipt's window without a clock");
+}
+
+// Rollup report bounds are UTC midnights, whatever the local time zone
+void checkUtcReportDates() {
+    expectThat(parseUtcDate("1970-01-01") == 0, "epoch");
+    expectThat(parseUtcDate("2026-03-01") == 1772323200, "after a non-leap February");
+    expectThat(parseUtcDate("2024-02-29") == 1709164800, "leap day");
+    bool rejected = false;
+    try {
+        parseUtcDate("2026-13-01");
+    }
+    catch (const runtime_error&) {
+        rejected = true;
+    }
+    expectThat(rejected, "month 13 rejected");
+}
+
+int runSelfTests() {
+    struct Check {
+        const char* name;
+        void (*run)();
+    };
+    static const Check checks[] = {
+        {"user import: row across a thread range boundary", checkImportRowAcrossRanges},
+        {"escrow: refunded hold earns the freelancer nothing", checkEscrowRefundEarnsNothing},
+        {"escrow: hold that cannot be released stays open", checkEscrowReleaseKeepsUnpayableHolds},
+        {"query: nesting depth and non-finite amounts", checkQueryLimits},
+        {"anomaly screen: billed rate judged against history", checkAnomalyRateAgainstHistory},
+        {"matching: queries never register or alias skills", checkSkillMatchingDictionary},
+        {"invoices: unique file names and stable numbers", checkInvoiceNamesAndNumbers},
+        {"retainers: failed instance is retried with backoff", checkRetainerRetriesFailedInstance},
+        {"sketches: corrupt sparse entries are rejected", checkSketchReadRejectsBadEntries},
+        {"ledger: request text cannot forge a receipt", checkReceiptTextCannotForgeReceipts},
+        {"requests: nan and inf are rejected", checkNonFiniteNumbersRejected},
+        {"retainers: monthly contract from the 31st keeps February", checkMonthlyRetainerFromMonthEnd},
+        {"escrow: sweep that cannot log keeps its holds", checkEscrowSweepSurvivesLedgerFailure},
+        {"top-N: windows follow the clock", checkTopWindowFollowsClock},
+        {"rollups: report dates are UTC midnights", checkUtcReportDates},
+    };
+    int failed = 0;
+    for (const Check& check : checks) {
+        try {
+            check.run();
+            cout << "PASS " << check.name << endl;
+        }
+        catch (const exception& e) {
+            failed++;
+            cout << "FAIL " << check.name << ": " << e.what() << endl;
+        }
+    }
+    cout << (sizeof(checks) / sizeof(checks[0]) - failed) << " of " << sizeof(checks) / sizeof(checks[0])
+        << " checks passed" << endl;
+    return failed ? 1 : 0;
+}
+
+// Dispatches to the mode selected on the command line, or the interactive menu
+int runMode(int argc, char* argv[]) {
+
+    if (argc >= 2 && string(argv[1]) == "--self-test") {
+        return runSelfTests();
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--batch") {
+        bool parseOnly = argc >= 4 && string(argv[3]) == "--parse-only";
+        runBatch(argc >= 3 ? argv[2] : "project_requests.jsonl", parseOnly);
+        return 0;
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--serve") {
+#ifdef __linux__
+        string action = argc >= 5 ? argv[4] : "release";
+        if (action != "release" && action != "refund") {
+            cerr << "Escrow expiry action must be release or refund" << endl;
+            return 1;
+        }
+        runService(argc >= 3 ? argv[2] : "7070", argc >= 4 ? atof(argv[3]) : 0.0,
+            action == "release" ? ESCROW_RELEASE : ESCROW_REFUND);
+#else
+        cerr << "Service mode requires Linux (epoll)" << endl;
+#endif
+        return 0;
+    }
+    if (argc >= 2 && (string(argv[1]) == "--http" || string(argv[1]) == "--http-load")) {
+#ifdef __linux__
+        string port = argc >= 3 ? argv[2] : "8080";
+        if (string(argv[1]) == "--http") {
+            unsigned threads = argc >= 4 ? static_cast<unsigned>(atoi(argv[3])) : thread::hardware_concurrency();
+            runHttpService(port, threads);
+        }
+        else {
+            size_t connections = argc >= 4 ? strtoul(argv[3], nullptr, 10) : 64;
+            size_t projects = argc >= 5 ? strtoul(argv[4], nullptr, 10) : 1000;
+            runHttpLoadTest(port, connections, projects);
+        }
+#else
+        cerr << "HTTP mode requires Linux (epoll)" << endl;
+#endif
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--bench") {
+        runBenchmarks(argc >= 3 ? argv[2] : "bench_results.json", argc >= 4 ? atoi(argv[3]) : 6);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--diagnose") {
+        size_t projects = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 100000;
+        if (projects == 0) {
+            cerr << "Project count must be at least 1" << endl;  // Results are reported per project
+            return 1;
+        }
+        runDiagnostics(projects);
+        return 0;
+    }
+    if (argc >= 3 && string(argv[1]) == "--receipts-report") {
+        try {
+            int64_t from = argc >= 4 ? parseReportDate(argv[3]) : numeric_limits<int64_t>::min();
+            int64_t to = argc >= 5 ? parseReportDate(argv[4]) : numeric_limits<int64_t>::max();
+            runReceiptReport(argv[2], from, to);
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+        }
+        return 0;
+    }
+    if (argc >= 4 && string(argv[1]) == "--query") {
+        try {
+            runReceiptQuery(argv[2], argv[3], argc >= 5 ? strtoull(argv[4], nullptr, 10) : 20);
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--query-bench") {
+        try {
+            runQueryBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 10000000, argc >= 4 ? argv[3]
+                : "type = Escrow and amount > 5000 and milestone ~ website and time in last_month");
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc >= 4 && string(argv[1]) == "--invoices") {
+        try {
+            runInvoiceGeneration(argv[2], argv[3], argc >= 5 ? argv[4] : "all", argc >= 6 ? argv[5] : "");
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--invoice-bench") {
+        try {
+            runInvoiceBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000,
+                argc >= 4 ? argv[3] : "bench_invoices");
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc >= 4 && string(argv[1]) == "--rollup-report") {
+        RollupGranularity granularity;
+        if (!parseRollupGranularity(argv[3], granularity)) {
+            cerr << "Granularity must be hour, day or month" << endl;
+            return 1;
+        }
+        try {
+            // Rollup buckets are UTC, so the bounds are UTC midnights too
+            int64_t from = argc >= 5 ? parseUtcDate(argv[4]) : numeric_limits<int64_t>::min();
+            int64_t to = argc >= 6 ? parseUtcDate(argv[5]) : numeric_limits<int64_t>::max();
+            runRollupReport(argv[2], granularity, from, to);
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+        }
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--rollup-bench") {
+        runRollupBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--topn-bench") {
+        runTopNBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 10000000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--distinct-bench") {
+        runCardinalityBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000,
+            argc >= 4 ? argv[3] : "bench_sketches");
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--analytics-bench") {
+        runAnalyticsBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 10000000);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--simulate") {
+        SimulationProfile profile = parseSimulationProfile(argc, argv, 2);
+        // Otherwise the arrival rate is zero or negative and event times come out inf or NaN
+        if (!(profile.arrivalsPerDay > 0) || !isfinite(profile.arrivalsPerDay) || !(profile.monthlyGrowth > -1.0)) {
+            cerr << "Arrivals must be a positive number per day and growth above -100%" << endl;
+            return 1;
+        }
+        runSimulation(profile);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--forecast") {
+        runPayoutForecast(parseForecastProfile(argc, argv, 2));
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--dispatch") {
+        if (argc < 4) {
+            cerr << "Usage: --dispatch LEDGER DIR|PORT [BATCH] [--follow]" << endl;
+            return 1;
+        }
+        bool follow = string(argv[argc - 1]) == "--follow";
+        size_t batch = argc >= 5 && string(argv[4]) != "--follow" ? strtoull(argv[4], nullptr, 10) : 512;
+        runNotificationDispatcher(argv[2], argv[3], batch, follow);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--notify-stub") {
+#ifdef __linux__
+        runNotificationStub(argc >= 3 ? argv[2] : "7080", argc >= 4 ? argv[3] : "notifications_inbox.jsonl",
+            argc >= 5 ? atoi(argv[4]) : 0);
+#else
+        cerr << "The notification stub requires Linux (epoll)" << endl;
+#endif
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--anomaly-bench") {
+        size_t batchSize = argc >= 4 ? strtoull(argv[3], nullptr, 10) : 4096;
+        if (batchSize == 0) {
+            cerr << "Batch size must be at least 1" << endl;  // The bench advances one batch at a time
+            return 1;
+        }
+        runAnomalyBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 10000000, batchSize);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--escrow-bench") {
+        runEscrowBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 100000, argc >= 4 ? strtoull(argv[3], nullptr, 10) : 1024,
+            argc >= 5 ? argv[4] : "escrow_bench_receipts.txt");
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--retainer-bench") {
+        runRetainerBench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000, argc >= 4 ? atoi(argv[3]) : 90);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--loadgen") {
+        runLoadGenerator(parseLoadProfile(argc, argv, 2));
+        return 0;
+    }
+    if (argc >= 4 && string(argv[1]) == "--generate-users") {
+        generateUserCsv(argv[3], strtoull(argv[2], nullptr, 10));
+        return 0;
+    }
+    if (argc >= 3 && string(argv[1]) == "--import-users") {
+        unsigned threads = argc >= 4 ? static_cast<unsigned>(atoi(argv[3])) : thread::hardware_concurrency();
+        runUserImport(argv[2], threads);
+        return 0;
+    }
+
     int choice;
     cout << "=== Freelance Workflow Engine ===\n";
     cout << "1. Create Custom Project (User Input)\n";
     cout << "2. Run Hardcoded Demos\n";
+    cout << "3. Find Freelancers for a Project\n";
     cout << "Choice: ";
     cin >> choice;
 
     if (choice == 1) {
         runCustomProject();
     }
+    else if (choice == 3) {
+        runMatchingDemo();
+    }
     else {
         runHardcodedDemos();
     }
 
     return 0;
+}
+
+void printStageReport() {
+    WorkflowProfiler::report(cerr);
+}
+
+// Allocation table for "--alloc-profile", normalized by projects executed when there were any
+void printAllocationReport() {
+    vector<AllocationProfiler::SiteTotals> totals = AllocationProfiler::snapshot();
+    uint64_t projects = EngineMetrics::total(METRIC_PROJECTS_EXECUTED);
+    uint64_t allAllocations = 0;
+    for (const auto& entry : totals) allAllocations += entry.count;
+    cerr << "\n=== ALLOCATIONS BY SITE ===" << endl;
+    char line[200];
+    snprintf(line, sizeof(line), "%-22s %12s %14s %10s %7s %14s", "site", "allocs", "bytes", "avg bytes",
+        "share", "allocs/project");
+    cerr << line << endl;
+    for (const auto& entry : totals) {
+        snprintf(line, sizeof(line), "%-22s %12llu %14llu %10.1f %6.1f%% %14.2f", entry.site.c_str(),
+            static_cast<unsigned long long>(entry.count), static_cast<unsigned long long>(entry.bytes),
+            entry.count ? static_cast<double>(entry.bytes) / entry.count : 0.0,
+            allAllocations ? 100.0 * entry.count / allAllocations : 0.0,
+            projects ? static_cast<double>(entry.count) / projects : 0.0);
+        cerr << line << endl;
+    }
+    cerr << "Projects executed: " << projects << endl;
+}
+
+int main(int argc, char* argv[]) {
+    // "--stage-sampling N" may accompany any mode: time workflow stages in
+    // one of every N projects and print the latency report on exit
+    // "--metrics-file PATH" likewise exports Prometheus metrics to PATH every few seconds,
+    // and "--trace-file PATH [--trace-sampling N]" writes a Chrome trace of 1 in N projects on exit
+    // "--alloc-profile" counts allocations per workflow stage and constructor and reports them on exit
+    string metricsFile, traceFile;
+    bool allocationProfile = false;  // Repeating the flag still reports once
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--stage-sampling" && i + 1 < argc) {
+            WorkflowProfiler::setSamplingPeriod(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+            continue;
+        }
+        if (string(argv[i]) == "--metrics-file" && i + 1 < argc) {
+            metricsFile = argv[++i];
+            continue;
+        }
+        if (string(argv[i]) == "--trace-file" && i + 1 < argc) {
+            traceFile = argv[++i];
+            if (WorkflowTracer::getSamplingPeriod() == 0) WorkflowTracer::setSamplingPeriod(100);
+            continue;
+        }
+        if (string(argv[i]) == "--alloc-profile") {
+            allocationProfile = true;
+            continue;
+        }
+        if (string(argv[i]) == "--trace-sampling" && i + 1 < argc) {
+            WorkflowTracer::setSamplingPeriod(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10)));
+            continue;
+        }
+        argv[kept++] = argv[i];
+    }
+    argc = kept;
+    if (WorkflowProfiler::getSamplingPeriod() > 0) atexit(printStageReport);
+    if (allocationProfile) {
+        AllocationProfiler::enable();
+        atexit(printAllocationReport);
+    }
+
+    MetricsFileExporter* metricsExporter = nullptr;
+    if (!metricsFile.empty()) metricsExporter = new MetricsFileExporter(metricsFile, chrono::seconds(5));
+    int status = runMode(argc, argv);
+    delete metricsExporter;  // Writes a final snapshot
+    if (!traceFile.empty()) {
+        try {
+            size_t spans = WorkflowTracer::dump(traceFile);
+            cerr << "Wrote " << spans << " trace spans to " << traceFile << endl;
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+        }
+    }
+    return status;
 }
\ No newline at end of file